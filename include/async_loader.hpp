@@ -0,0 +1,73 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include "ui.h"
+#include "png_decoder_pool.hpp"
+#include "sprite.hpp"
+
+// Streams images into image buffers without blocking the UI thread.
+// Worker threads decode PNG files and queue the results,
+// then the UI thread uploads them under a time budget per frame.
+class AsyncLoader {
+ private:
+    struct Decoded {
+        int id;
+        int ret;
+        DecodedPng png;
+    };
+
+    PngDecoderPool m_decoder;  // declared first to outlive decoded images
+    std::vector<std::string> m_files;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::deque<Decoded> m_queue;  // decoded but not uploaded yet
+    std::atomic<int> m_next;
+    std::atomic<int> m_decoded_num;
+    std::atomic<bool> m_cancel;
+    int m_uploaded_num;
+    double m_last_upload_ms;
+    std::string m_error_msg;
+
+    void Work();
+
+ public:
+    AsyncLoader() : m_decoder(), m_files(), m_threads(), m_mutex(), m_queue(),
+                    m_next(0), m_decoded_num(0), m_cancel(false),
+                    m_uploaded_num(0), m_last_upload_ms(0), m_error_msg() {}
+
+    ~AsyncLoader() { Stop(); }
+
+    // Starts decoding files on worker threads. (0 means hardware threads)
+    void Start(const char *const *files, int count, int thread_num = 0);
+
+    // Cancels decoding and waits for workers
+    void Stop();
+
+    // Uploads decoded images to buffers[id] until budget_ms elapses.
+    // At least one image is uploaded per call so loading always progresses.
+    // Ids of uploaded images are appended to uploaded_ids.
+    // Returns 1 when an image failed to decode.
+    int Upload(uiDrawContext *c, std::vector<ImageBuffer> &buffers,
+               double budget_ms, std::vector<int> *uploaded_ids);
+
+    int GetTotal() { return (int)m_files.size(); }
+    int GetDecodedNum() { return m_decoded_num; }
+    int GetUploadedNum() { return m_uploaded_num; }
+    int IsDone() { return m_uploaded_num == GetTotal(); }
+
+    // decoded images waiting for upload
+    int GetQueueDepth();
+
+    // time spent in the last Upload call
+    double GetLastUploadMs() { return m_last_upload_ms; }
+
+    const char *GetErrorMsg() { return m_error_msg.c_str(); }
+
+    // heap allocations of the decoder (see PngDecoderPool)
+    long long GetAllocations() { return m_decoder.GetAllocations(); }
+    long long GetAllocatedBytes() { return m_decoder.GetAllocatedBytes(); }
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// Position of an image in an atlas
+struct AtlasRect {
+    int page;
+    int x, y;
+    int width, height;
+};
+
+// Skyline bottom-left bin packer for a single page
+class SkylinePacker {
+ private:
+    struct Node {
+        int x, y, width;
+    };
+    std::vector<Node> m_skyline;
+    int m_width;
+    int m_height;
+    int m_used_height;
+
+    int Fit(size_t index, int width, int height);
+    void AddNode(size_t index, int x, int y, int width);
+
+ public:
+    SkylinePacker() : m_skyline(), m_width(0), m_height(0), m_used_height(0) {}
+
+    void Reset(int width, int height);
+
+    // Returns 1 when there is no space for the rect.
+    int Insert(int width, int height, int *x, int *y);
+
+    int GetUsedHeight() { return m_used_height; }
+};
+
+// Packs rects into pages that are page_size x page_size at most.
+// Each rect is surrounded by padding pixels to avoid bleeding.
+// Pages are shrunk to fit their contents.
+// Returns 1 when a rect is larger than page_size.
+int PackAtlas(const std::vector<int> &widths, const std::vector<int> &heights,
+              int page_size, int padding,
+              std::vector<AtlasRect> *rects,
+              std::vector<int> *page_widths, std::vector<int> *page_heights);
+
+// Copies an RGBA image into a page
+void BlitToPage(unsigned char *page, int page_width,
+                const unsigned char *image, const AtlasRect &rect);
+
+// Rect table for prebuilt atlases
+//   page <file> <width> <height>
+//   rect <file> <page> <x> <y> <width> <height>
+// File names are relative to the directory of the table.
+struct AtlasTable {
+    std::vector<std::string> page_files;
+    std::vector<int> page_widths;
+    std::vector<int> page_heights;
+    std::vector<std::string> names;
+    std::vector<AtlasRect> rects;
+};
+
+int SaveAtlasTable(const char *file_name, const AtlasTable &table);
+int LoadAtlasTable(const char *file_name, AtlasTable *table);
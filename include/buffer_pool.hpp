@@ -0,0 +1,173 @@
+#pragma once
+#include <stdlib.h>
+#include <stddef.h>
+#include <vector>
+#include <mutex>
+
+class BufferPool;
+
+// Memory block from a BufferPool. It goes back to the pool when released or destroyed.
+// The pool must outlive its buffers.
+class PooledBuffer {
+ private:
+    BufferPool *m_pool;
+    unsigned char *m_data;
+    size_t m_size;
+    size_t m_capacity;
+
+ public:
+    PooledBuffer() : m_pool(NULL), m_data(NULL), m_size(0), m_capacity(0) {}
+    PooledBuffer(BufferPool *pool, unsigned char *data, size_t size, size_t capacity)
+        : m_pool(pool), m_data(data), m_size(size), m_capacity(capacity) {}
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+    PooledBuffer(PooledBuffer &&b) noexcept
+        : m_pool(b.m_pool), m_data(b.m_data), m_size(b.m_size), m_capacity(b.m_capacity)
+    {
+        b.m_pool = NULL;
+        b.m_data = NULL;
+        b.m_size = b.m_capacity = 0;
+    }
+
+    PooledBuffer &operator=(PooledBuffer &&b) noexcept
+    {
+        if (this != &b) {
+            Release();
+            m_pool = b.m_pool;
+            m_data = b.m_data;
+            m_size = b.m_size;
+            m_capacity = b.m_capacity;
+            b.m_pool = NULL;
+            b.m_data = NULL;
+            b.m_size = b.m_capacity = 0;
+        }
+        return *this;
+    }
+
+    ~PooledBuffer() { Release(); }
+
+    // Gives the block back to the pool
+    inline void Release();
+
+    unsigned char *GetData() { return m_data; }
+    size_t GetSize() { return m_size; }
+};
+
+// Free lists of memory blocks in size buckets.
+// Each power of two is split into 4 buckets, so a block wastes 25% at most.
+// Released blocks are kept for the next request of the same bucket,
+// so repeating the same workload allocates nothing after the first round.
+// It's thread-safe.
+class BufferPool {
+ private:
+    std::mutex m_mutex;
+    std::vector<std::vector<void *>> m_free;  // free blocks of each bucket
+    long long m_allocations;  // blocks taken from the heap
+    long long m_allocated_bytes;
+    long long m_requests;
+    long long m_reuses;  // requests served from free lists
+    size_t m_cached_bytes;  // bytes in free lists
+    size_t m_max_cached_bytes;
+
+ public:
+    explicit BufferPool(size_t max_cached_bytes = 256 * 1024 * 1024)
+        : m_mutex(), m_free(), m_allocations(0), m_allocated_bytes(0),
+          m_requests(0), m_reuses(0), m_cached_bytes(0),
+          m_max_cached_bytes(max_cached_bytes) {}
+
+    BufferPool(const BufferPool &) = delete;
+    BufferPool &operator=(const BufferPool &) = delete;
+
+    ~BufferPool() { Trim(); }
+
+    // Rounds size up to its bucket
+    static int GetBucket(size_t size, size_t *capacity)
+    {
+        size_t base = 64;
+        int bucket = 0;
+        if (size < base) size = base;
+        while (base * 2 <= size) {
+            base *= 2;
+            bucket += 4;
+        }
+        size_t quarter = base / 4;
+        size_t steps = (size - base + quarter - 1) / quarter;  // 0 to 4
+        *capacity = base + steps * quarter;
+        return bucket + (int)steps;
+    }
+
+    // Returns a block of at least size bytes. capacity gets the actual size.
+    void *Allocate(size_t size, size_t *capacity)
+    {
+        int bucket = GetBucket(size, capacity);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_requests++;
+            if ((size_t)bucket < m_free.size() && !m_free[bucket].empty()) {
+                void *block = m_free[bucket].back();
+                m_free[bucket].pop_back();
+                m_cached_bytes -= *capacity;
+                m_reuses++;
+                return block;
+            }
+            m_allocations++;
+            m_allocated_bytes += *capacity;
+        }
+        return malloc(*capacity);
+    }
+
+    // capacity should be the one given by Allocate()
+    void Free(void *block, size_t capacity)
+    {
+        if (!block) return;
+        size_t bucket_capacity;
+        int bucket = GetBucket(capacity, &bucket_capacity);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_cached_bytes + capacity <= m_max_cached_bytes) {
+                if ((size_t)bucket >= m_free.size())
+                    m_free.resize(bucket + 1);
+                m_free[bucket].push_back(block);
+                m_cached_bytes += capacity;
+                return;
+            }
+        }
+        free(block);
+    }
+
+    PooledBuffer Acquire(size_t size)
+    {
+        size_t capacity;
+        unsigned char *data = (unsigned char *)Allocate(size, &capacity);
+        if (!data) return PooledBuffer();
+        return PooledBuffer(this, data, size, capacity);
+    }
+
+    // Frees cached blocks to the heap
+    void Trim()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (std::vector<void *> &blocks : m_free) {
+            for (void *block : blocks)
+                free(block);
+            blocks.clear();
+        }
+        m_cached_bytes = 0;
+    }
+
+    long long GetAllocations() { std::lock_guard<std::mutex> lock(m_mutex); return m_allocations; }
+    long long GetAllocatedBytes() { std::lock_guard<std::mutex> lock(m_mutex); return m_allocated_bytes; }
+    long long GetRequests() { std::lock_guard<std::mutex> lock(m_mutex); return m_requests; }
+    long long GetReuses() { std::lock_guard<std::mutex> lock(m_mutex); return m_reuses; }
+    size_t GetCachedBytes() { std::lock_guard<std::mutex> lock(m_mutex); return m_cached_bytes; }
+};
+
+inline void PooledBuffer::Release()
+{
+    if (m_pool)
+        m_pool->Free(m_data, m_capacity);
+    m_pool = NULL;
+    m_data = NULL;
+    m_size = m_capacity = 0;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include "ui.h"
+#include "pixel_convert.hpp"
+
+// Pixels kept in CPU memory in the smallest layout of the PNG file.
+// Grayscale stays 1 byte per pixel (2 with alpha), RGB 3 bytes,
+// and indexed images 1-byte indices with a premultiplied palette.
+// Others are kept as premultiplied RGBA. ConvertRect() expands pixels to premultiplied RGBA.
+class CompactImage {
+ private:
+    PIXEL_FORMAT m_format;  // PIXEL_FORMAT_RGBA8 is premultiplied
+    int m_width;
+    int m_height;
+    int m_has_alpha;
+    std::vector<unsigned char> m_pixels;
+    std::vector<unsigned char> m_palette;  // 256 premultiplied RGBA entries of indexed images
+
+ public:
+    CompactImage() : m_format(PIXEL_FORMAT_RGBA8), m_width(0), m_height(0), m_has_alpha(0),
+                     m_pixels(), m_palette() {}
+
+    int LoadFromPng(const char *file);
+
+    // Copies premultiplied RGBA pixels. stride is bytes per row.
+    void SetRgba(const unsigned char *pixels, int width, int height, int stride, int has_alpha);
+
+    // Writes premultiplied RGBA pixels in rect into dst (stride bytes per row).
+    // rect should be in the image.
+    void ConvertRect(const uiRect &rect, unsigned char *dst, size_t stride);
+
+    void GetSize(int *width, int *height)
+    {
+        *width = m_width;
+        *height = m_height;
+    }
+
+    PIXEL_FORMAT GetFormat() { return m_format; }
+    int HasAlpha() { return m_has_alpha; }
+
+    // CPU memory for pixels and the palette
+    size_t GetBytes() { return m_pixels.size() + m_palette.size(); }
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include "ui.h"
+
+// Collects screen areas that changed since the last frame.
+// Each sprite reports its bounds every frame.
+// Old and new bounds of moved sprites become dirty,
+// and they are merged into a few rects aligned to a tile grid.
+class DamageTracker {
+ private:
+    std::vector<uiRect> m_prev_bounds;  // bounds of the last frame for each id
+    std::vector<unsigned char> m_tracked;  // the id was reported in this frame
+    std::vector<unsigned char> m_tiles;  // dirty flags of the tile grid
+    std::vector<uiRect> m_rects;  // merged dirty rects
+    int m_width;
+    int m_height;
+    int m_tile_size;
+    int m_tiles_x;
+    int m_tiles_y;
+    int m_max_rects;
+    int m_full;  // the whole area is dirty
+
+    void MarkTiles(const uiRect &rect);
+
+ public:
+    DamageTracker() : m_prev_bounds(), m_tracked(), m_tiles(), m_rects(),
+                      m_width(0), m_height(0), m_tile_size(32),
+                      m_tiles_x(0), m_tiles_y(0), m_max_rects(16), m_full(1) {}
+
+    // Resizes the area. The whole area will be dirty.
+    void Resize(int width, int height);
+
+    // Sprites that are stored in a fixed order should use their indices as ids.
+    void SetCapacity(int count);
+
+    // Larger tiles make fewer but bigger rects.
+    void SetTileSize(int tile_size);
+
+    // Rects are merged into a bounding box when there are more than this.
+    void SetMaxRects(int max_rects) { m_max_rects = max_rects; }
+
+    // Marks the whole area as dirty
+    void Invalidate() { m_full = 1; }
+
+    // Adds an area that must be redrawn, e.g. a sprite that changed its image.
+    void AddRect(const uiRect &rect);
+
+    // Reports the screen bounds of a sprite in this frame.
+    // Unchanged bounds add nothing unless the sprite changed its image.
+    void Track(int id, const uiRect &bounds, int image_changed = 0);
+
+    // Merges dirty areas into rects.
+    // Sprites that were not tracked in this frame are treated as removed.
+    // Call it once per frame after Track().
+    void Finish();
+
+    const std::vector<uiRect> &GetRects() { return m_rects; }
+
+    int IsEmpty() { return m_rects.empty(); }
+
+    // dirty pixels in the merged rects
+    long long GetDirtyArea();
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <vector>
+#include "png_reader.hpp"
+
+// Decodes PNG files on worker threads.
+// Each decode runs with its own spng context on the worker that picked it,
+// so callers only need to upload the decoded pixels on the UI thread.
+class DecodePool {
+ private:
+    int m_thread_num;
+
+ public:
+    // 0 means the number of hardware threads
+    explicit DecodePool(int thread_num = 0);
+
+    int GetThreadNum() { return m_thread_num; }
+
+    // Decodes files[i] into (*readers)[i].
+    // Returns 1 when some files failed, and failed_index gets the first one.
+    int DecodeAll(const char *const *files, int count,
+                  std::vector<PngReader> *readers, int *failed_index,
+                  int premultiply = 1);
+};
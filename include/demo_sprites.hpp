@@ -1,9 +1,17 @@
 #pragma once
+#include <cmath>
 #include <vector>
 #include <array>
 #include <string>
 #include "ui.h"
 #include "sprite.hpp"
+#include "texture_atlas.hpp"
+#include "async_loader.hpp"
+#include "damage_tracker.hpp"
+#include "spatial_grid.hpp"
+#include "tile_residency.hpp"
+#include "tile_compositor.hpp"
+#include "render_queue.hpp"
 
 enum IMAGE_INDEX : int {
     IMAGE_CAR = 0,
@@ -24,6 +32,27 @@ const char* IMAGE_FILES[IMAGE_COUNT] = {
     "sprites/palm-tree.png"
 };
 
+// Sprites are drawn from the lowest layer (see RenderQueue)
+enum RENDER_LAYER : int {
+    LAYER_BACK = 0,
+    LAYER_BUILDINGS,
+    LAYER_PALMS,
+    LAYER_HIGHWAY,
+    LAYER_CAR,
+    LAYER_FOREGROUND
+};
+
+// pre-decoded pixels (see sprite_pack.hpp)
+const char *SPRITE_PACK = "sprites/sprites.spk";
+
+// prebuilt atlas (meson setup -Dbuild_atlas=true)
+const char *ATLAS_TABLE = "sprites/atlas.txt";
+const int ATLAS_PAGE_SIZE = 2048;
+
+// scrolling strips that are drawn from TileResidency with --residency
+const int RESIDENT_IMAGES[] = { IMAGE_BACK, IMAGE_HIGHWAY };
+const int PREFETCH_STEPS = 30;  // prefetch tiles that scroll into view within 0.3 sec
+
 // Sprites that just move horizontally
 class ScrollSprite : public Sprite {
  private:
@@ -44,30 +73,150 @@ class ScrollSprite : public Sprite {
         m_x = m_start;
     }
 
+    double GetSpeed() { return m_speed; }
+
     void Move() {
         m_current = std::fmod(m_current + m_speed, m_length);
         m_x = m_start + m_current;
+        // Sprites jump back when they wrap around.
+        // So, interpolate from where they would have been without wrapping.
+        m_prev_x = m_x - m_speed;
+        m_prev_y = m_y;
+        m_prev_rad = m_rad;
+    }
+};
+
+// Copies of an image side by side that scroll together, e.g. a background layer.
+// The copies can be composed into one strip buffer at load time. The strip wraps around,
+// so the layer is drawn with at most two blits split at the seam.
+// Otherwise, each copy is drawn as a sprite.
+class ParallaxLayer {
+ private:
+    ScrollSprite m_scroll;  // the first copy
+    int m_image_id;
+    int m_layer;  // RENDER_LAYER
+    int m_repeats;  // copies in the layer
+    double m_start;  // x-coordinate of the first copy before scrolling
+    double m_length;  // distance to wrap around. Copies are this far from each other.
+    ImageBuffer m_strip;  // copies side by side
+    int m_has_strip;
+
+ public:
+    ParallaxLayer() : m_scroll(), m_image_id(0), m_layer(0), m_repeats(1), m_start(0), m_length(0),
+                      m_strip(), m_has_strip(0) {}
+
+    void Initialize(int image_id, int layer, double x, double y, double speed, double length, int repeats)
+    {
+        m_image_id = image_id;
+        m_layer = layer;
+        m_repeats = std::max(repeats, 1);
+        m_start = x;
+        m_length = length;
+        m_scroll.SetPosition(x, y);
+        m_scroll.SetAnimation(speed, x, length);
+    }
+
+    int GetImageId() { return m_image_id; }
+    int GetLayer() { return m_layer; }
+    int GetRepeats() { return m_repeats; }
+    double GetSpeed() { return m_scroll.GetSpeed(); }
+    int IsReady() { return m_scroll.IsReady(); }
+    int HasStrip() { return m_has_strip; }
+
+    // Draws the copies from the image. The strip is freed.
+    void SetImage(ImageBuffer &buf, uiRect rect)
+    {
+        m_scroll.SetBuffer(buf);
+        m_scroll.SetSrcRect(rect);
+        m_strip.Free();
+        m_has_strip = 0;
+    }
+
+    // Composes the copies into the strip. pixels is the image with stride bytes per row.
+    // Returns 1 when the copies don't wrap around seamlessly (the image width is not the move length).
+    // c can be NULL for headless buffers.
+    int ComposeStrip(uiDrawContext *c, const unsigned char *pixels, int width, int height, int stride)
+    {
+        if (width != (int)m_length || m_repeats < 2) return 1;
+        m_strip.Free();
+        m_strip.Create(c, width * m_repeats, height, 1);
+        int dst_stride;
+        unsigned char *dst = m_strip.Lock(&dst_stride);
+        for (int y = 0; y < height; y++) {
+            for (int i = 0; i < m_repeats; i++)
+                memcpy(dst + (size_t)y * dst_stride + (size_t)i * width * 4, pixels + (size_t)y * stride, (size_t)width * 4);
+        }
+        m_strip.Unlock();
+        m_strip.FreeCpuCopy();
+        m_has_strip = 1;
+        return 0;
+    }
+
+    void Move() { m_scroll.Move(); }
+
+    // Calls func(Sprite &) for each blit of the layer between the last two steps.
+    // alpha is 0 for the previous step and 1 for the current one.
+    template <class Func>
+    void ForEachPiece(double alpha, Func func)
+    {
+        if (!IsReady()) return;
+        Sprite first = m_scroll.Interpolated(alpha);
+        double x, y;
+        first.GetPosition(&x, &y);
+        if (!m_has_strip) {
+            for (int i = 0; i < m_repeats; i++) {
+                Sprite copy = first;
+                copy.SetPosition(x + i * m_length, y);
+                func(copy);
+            }
+            return;
+        }
+
+        // The strip covers the same range as the copies before scrolling.
+        // Pixels that scroll out of the left end come back at the right end.
+        int width, height;
+        m_strip.GetSize(&width, &height);
+        int left = (int)m_start;
+        int seam = (((left - (int)std::floor(x)) % width) + width) % width;  // src x at the left end
+        Sprite piece;
+        piece.SetBuffer(m_strip);
+        piece.SetSrcRect({ seam, 0, width - seam, height });
+        piece.SetPosition(left, y);
+        func(piece);
+        if (seam == 0) return;
+        piece.SetSrcRect({ 0, 0, seam, height });
+        piece.SetPosition(left + width - seam, y);
+        func(piece);
+    }
+
+    // bounds of all blits in the current step
+    uiRect GetBounds()
+    {
+        uiRect bounds = { 0, 0, 0, 0 };
+        ForEachPiece(1.0, [&bounds](Sprite &piece) { bounds = UnionRect(bounds, piece.GetBounds()); });
+        return bounds;
     }
 };
 
 class Car : public Sprite {
  private:
     int m_count;
+    int m_base_y;  // y-coordinate of the first frame in the image buffer
     double m_target_x;
     double m_rad_speed;
 
  public:
     Car() : Sprite() {}
 
-    void Initialize(ImageBuffer &buf)
+    void Initialize(ImageBuffer &buf, uiRect rect)
     {
         SetBuffer(buf);
 
-        // There are four sprites in the image buffer.
+        // There are four sprites in the image rect.
         // So, we dont need the whole image.
-        uiRect rect = buf.GetRect();
         rect.Height /= 4;
         SetSrcRect(rect);
+        m_base_y = rect.Y;
 
         SetCenter(92, 0);
         SetPosition(200, 166);
@@ -78,12 +227,13 @@ class Car : public Sprite {
 
     void Animate()
     {
+        SavePrevState();
         m_count = (m_count + 1) % 20;
 
         // There are four sprites for car animation.
         // They are alinged vertically in the image buffer.
         // So, we can animate it by changing y-coordinate.
-        m_src_rect.Y = m_src_rect.Height * (m_count / 5);
+        m_src_rect.Y = m_base_y + m_src_rect.Height * (m_count / 5);
 
         // Move a bit vertically in uiArea.
         m_y = 165 + (m_count / 5 % 2);
@@ -123,23 +273,276 @@ class Car : public Sprite {
 
 class DemoSpriteHandler {
  private:
-    std::vector<ImageBuffer> m_image_buffers;
+    TextureAtlas m_atlas;
     Car m_car;
-    std::vector<ScrollSprite> m_scroll_sprites;
+    std::vector<ParallaxLayer> m_layers;
+
+    // for async loading
+    int m_async;
+    double m_upload_budget_ms;
+    AsyncLoader m_loader;
+    std::vector<ImageBuffer> m_image_buffers;
 
+    int m_loaded;  // LoadSprites() has been called
     std::string m_error_msg;
 
+    // areas changed by MoveSprites()
+    DamageTracker m_damage;
+    int m_area_width;
+    int m_area_height;
+    int m_car_src_y;
+
+    // view culling. Layers are indexed by their position in m_layers, and the car follows them.
+    SpatialGrid m_grid;
+    std::vector<int> m_visible;
+
+    // sprites of the current frame in draw order
+    RenderQueue m_queue;
+    std::vector<Sprite> m_frame_sprites;  // interpolated sprites that m_queue points to
+    std::vector<int> m_frame_layers;
+
+    // tiles of large strips near the view (optional)
+    TileResidency m_residency;
+    int m_use_residency;
+    std::array<int, IMAGE_COUNT> m_resident_ids;  // image ids in m_residency, or -1
+
+    // renders sprites on worker threads and draws the frame as one image buffer (optional)
+    TileCompositor m_compositor;
+    SoftRenderer m_frame;
+    int m_use_compositor;
+
+    // Loads the resident images into m_residency instead of drawing them from the atlas
+    int LoadResidentImages()
+    {
+        for (int id : RESIDENT_IMAGES) {
+            CompactImage image;
+            if (image.LoadFromPng(IMAGE_FILES[id])) {
+                m_error_msg = std::string("File not found. (") + IMAGE_FILES[id] + ")";
+                return 1;
+            }
+            m_resident_ids[id] = m_residency.AddImage(std::move(image));
+            ImageBuffer &buf = m_residency.GetBuffer(m_resident_ids[id]);
+            BindImage(id, buf, buf.GetRect());
+        }
+        return 0;
+    }
+
+    // Requests tiles in the clip rect and prefetches tiles that scroll into view soon
+    void UpdateResidency(uiDrawContext *c, const uiRect &clip, double alpha)
+    {
+        uiRect view = { 0, 0, m_area_width, m_area_height };
+        for (ParallaxLayer &layer : m_layers) {
+            int resident_id = m_resident_ids[layer.GetImageId()];
+            if (resident_id < 0 || !layer.IsReady()) continue;
+
+            // The view moves over the image against the scroll direction
+            int ahead = (int)(-layer.GetSpeed() * PREFETCH_STEPS);
+            uiRect window = view;
+            if (ahead < 0) window.X += ahead;
+            window.Width += std::abs(ahead);
+
+            layer.ForEachPiece(alpha, [&](Sprite &s) {
+                m_residency.Request(resident_id, s.GetVisibleSrcRect(clip));
+                m_residency.Prefetch(resident_id, s.GetVisibleSrcRect(window));
+            });
+        }
+        m_residency.Update(c);
+    }
+
+    // Binds an image to the sprites that use it
+    void BindImage(int image_id, ImageBuffer &buf, uiRect rect)
+    {
+        if (image_id == IMAGE_CAR)
+            m_car.Initialize(buf, rect);
+        for (ParallaxLayer &layer : m_layers) {
+            if (layer.GetImageId() == image_id)
+                layer.SetImage(buf, rect);
+        }
+        m_damage.Invalidate();
+        UpdateGrid();
+    }
+
+    // Composes strips of layers with repeated images. Resident layers keep drawing their copies.
+    // The images are read from the mapped sprite pack or the CPU copies of atlas pages,
+    // so nothing is decoded again. The CPU copies are freed after that.
+    void ComposeLayers(uiDrawContext *c)
+    {
+        for (ParallaxLayer &layer : m_layers) {
+            int id = layer.GetImageId();
+            if (layer.GetRepeats() < 2 || m_resident_ids[id] >= 0) continue;
+            int stride;
+            const unsigned char *pixels = m_atlas.GetPixels(id, &stride);
+            if (!pixels) continue;
+            uiRect rect = m_atlas.GetRect(id);
+            layer.ComposeStrip(c, pixels, rect.Width, rect.Height, stride);
+        }
+        m_atlas.FreeCpuCopies();
+        m_damage.Invalidate();
+        UpdateGrid();
+    }
+
+    // Calls func(Sprite &) for the sprites of a layer or the car between the last two steps.
+    // id is the index in m_layers, or the number of layers for the car.
+    template <class Func>
+    void ForEachSprite(int id, double alpha, Func func)
+    {
+        if (id < (int)m_layers.size()) {
+            m_layers[id].ForEachPiece(alpha, func);
+            return;
+        }
+        if (!m_car.IsReady()) return;
+        Sprite s = m_car.Interpolated(alpha);
+        func(s);
+    }
+
+    int GetLayer(int id)
+    {
+        return id < (int)m_layers.size() ? m_layers[id].GetLayer() : LAYER_CAR;
+    }
+
+    // Grid bounds cover both of the last two steps, so interpolated sprites stay inside.
+    void UpdateGrid()
+    {
+        int num = (int)m_layers.size() + 1;
+        for (int id = 0; id < num; id++) {
+            uiRect bounds = { 0, 0, 0, 0 };
+            auto add_bounds = [&bounds](Sprite &s) { bounds = UnionRect(bounds, s.GetBounds()); };
+            ForEachSprite(id, 0.0, add_bounds);
+            ForEachSprite(id, 1.0, add_bounds);
+            if (!IsRectEmpty(bounds))
+                m_grid.Update(id, bounds);
+            else
+                m_grid.Remove(id);
+        }
+    }
+
+    // Submits sprites under clip to the queue and sorts them into draw order.
+    // Only sprites in the grid cells under clip are visited.
+    // The queue doesn't copy sprites, so the interpolated ones are collected first and submitted after.
+    void SubmitSprites(const uiRect &clip, double alpha)
+    {
+        m_queue.Clear();
+        m_frame_sprites.clear();
+        m_frame_layers.clear();
+        m_grid.Query(clip, &m_visible);
+        for (int id : m_visible) {
+            int layer = GetLayer(id);
+            ForEachSprite(id, alpha, [this, &clip, layer](Sprite &s) {
+                if (RectsIntersect(s.GetBounds(), clip)) {
+                    m_frame_sprites.push_back(s);
+                    m_frame_layers.push_back(layer);
+                }
+            });
+        }
+        for (size_t i = 0; i < m_frame_sprites.size(); i++)
+            m_queue.Submit(&m_frame_sprites[i], m_frame_layers[i]);
+        m_queue.Sort();
+    }
+
+    // Renders the clip rect on worker threads and draws it with a single image buffer.
+    // The background is filled as well.
+    void DrawComposited(uiDrawContext *c, const uiRect &clip, double alpha)
+    {
+        int width, height;
+        m_frame.GetSize(&width, &height);
+        if (width != m_area_width || height != m_area_height)
+            m_frame.Resize(m_area_width, m_area_height);
+
+        m_compositor.Begin(m_frame, clip, 0xEEEEEE);
+        SubmitSprites(clip, alpha);
+        m_queue.ForEach([this](Sprite &s) { m_compositor.Add(s); });
+        m_compositor.Render(0);
+        m_compositor.Present(c);
+    }
+
+    void TrackDamage()
+    {
+        size_t i;
+        for (i = 0; i < m_layers.size(); i++) {
+            // Strips scroll inside of the same bounds
+            ParallaxLayer &layer = m_layers[i];
+            if (layer.IsReady())
+                m_damage.Track((int)i, layer.GetBounds(), layer.HasStrip() && layer.GetSpeed() != 0);
+        }
+        if (m_car.IsReady()) {
+            // The car changes its image without moving.
+            int image_changed = m_car.GetSrcRect().Y != m_car_src_y;
+            m_car_src_y = m_car.GetSrcRect().Y;
+            m_damage.Track((int)i, m_car.GetBounds(), image_changed);
+        }
+        m_damage.Finish();
+        UpdateGrid();
+    }
+
  public:
-    DemoSpriteHandler() : m_image_buffers(), m_car(), m_scroll_sprites(), m_error_msg() {}
+    DemoSpriteHandler() : m_atlas(), m_car(), m_layers(),
+                          m_async(0), m_upload_budget_ms(2.0), m_loader(), m_image_buffers(),
+                          m_loaded(0), m_error_msg(), m_damage(),
+                          m_area_width(0), m_area_height(0), m_car_src_y(0),
+                          m_grid(), m_visible(), m_queue(), m_frame_sprites(), m_frame_layers(),
+                          m_residency(), m_use_residency(0), m_resident_ids(),
+                          m_compositor(), m_frame(), m_use_compositor(0)
+    {
+        m_resident_ids.fill(-1);
+    }
+
+    // Loads images in the background and shows sprites as they arrive.
+    // Uploads are limited to budget_ms per frame.
+    void SetAsyncLoading(int async, double budget_ms)
+    {
+        m_async = async;
+        m_upload_budget_ms = budget_ms;
+    }
+
+    // Draws the strips in RESIDENT_IMAGES with tiles kept by TileResidency.
+    // Only tiles near the view are uploaded, up to budget bytes. (not with async loading)
+    void SetResidency(size_t budget, int tile_size)
+    {
+        m_use_residency = 1;
+        m_residency.SetBudget(budget);
+        m_residency.SetTileSize(tile_size);
+    }
+
+    int IsUsingResidency() { return m_use_residency && !m_async; }
+
+    TileResidency &GetResidency() { return m_residency; }
+
+    // Renders sprites with TileCompositor on thread_num threads (0 means all hardware threads).
+    // The atlas is kept in CPU memory for it. (not with async loading or residency)
+    void SetCompositor(int thread_num)
+    {
+        m_use_compositor = 1;
+        m_compositor.SetThreadNum(thread_num);
+    }
+
+    int IsUsingCompositor() { return m_use_compositor && !m_async && !m_use_residency; }
+
+    TileCompositor &GetCompositor() { return m_compositor; }
 
     const char* GetImageFileName(int image_id) {
         return IMAGE_FILES[image_id];
     }
 
+    // returns true while loading images as well
     int HasImage() {
-        return m_image_buffers.size() > 0;
+        return m_loaded;
+    }
+
+    int IsLoading() {
+        return m_async && m_loaded && !m_loader.IsDone() && !HasError();
     }
 
+    void GetLoadProgress(int *uploaded, int *total)
+    {
+        *uploaded = m_async ? m_loader.GetUploadedNum() : IMAGE_COUNT;
+        *total = IMAGE_COUNT;
+    }
+
+    // decoded images waiting for upload
+    int GetUploadQueueDepth() { return m_async ? m_loader.GetQueueDepth() : 0; }
+
+    double GetLastUploadMs() { return m_async ? m_loader.GetLastUploadMs() : 0; }
+
     int HasError() {
         return m_error_msg.length() != 0;
     }
@@ -150,93 +553,115 @@ class DemoSpriteHandler {
 
     int LoadSprites(uiDrawContext *c)
     {
-        // load images
-        m_image_buffers.resize(IMAGE_COUNT);
-        int ret = 0;
-        for (int i = 0; i < IMAGE_COUNT; i++) {
-            ret = m_image_buffers[i].CreateFromPng(c, IMAGE_FILES[i]);
-            if (ret) {
-                m_error_msg = std::string("File not found. (") + GetImageFileName(i) + ")";
-                break;
-            }
-        }
-
-        if (ret) {
-            m_image_buffers.clear();
+        m_loaded = 1;
+        // The compositor draws headless pages with SoftRenderer
+        uiDrawContext *atlas_context = IsUsingCompositor() ? NULL : c;
+        if (m_async) {
+            // Sprites are placeholders until ApplyUploads() binds images to them
+            m_image_buffers.resize(IMAGE_COUNT);
+            m_loader.Start(IMAGE_FILES, IMAGE_COUNT);
+        } else if (m_atlas.LoadFromPack(atlas_context, SPRITE_PACK, IMAGE_FILES, IMAGE_COUNT) &&
+                   m_atlas.LoadFromTable(atlas_context, ATLAS_TABLE, IMAGE_FILES, IMAGE_COUNT) &&
+                   m_atlas.Build(atlas_context, IMAGE_FILES, IMAGE_COUNT, ATLAS_PAGE_SIZE)) {
+            // load images into an atlas. use the sprite pack or the prebuilt one if exists.
+            m_error_msg = m_atlas.GetErrorMsg();
             return 1;
         }
 
-        // create the car sprite
-        {
-            ImageBuffer &buf = m_image_buffers[IMAGE_CAR];
-            m_car.Initialize(buf);
-        }
-
-        struct Queue {
+        struct Layer {
             int image_id;
+            int layer;
             double x, y;
             double speed;
             double move_length;
+            int repeats;
         };
 
-        // image id, x, y, speed, move length
-        std::vector<Queue> queues = {
-            { IMAGE_BACK, 0, 0, -0.5, 224 },
-            { IMAGE_BACK, 224, 0, -0.5, 224 },
-            { IMAGE_BACK, 448, 0, -0.5, 224 },
-            { IMAGE_BACK, 672, 0, -0.5, 224 },
-            { IMAGE_BACK, 896, 0, -0.5, 224 },
-            { IMAGE_BUILDINGS, 0, 12, -1, 256 },
-            { IMAGE_BUILDINGS, 256, 12, -1, 256 },
-            { IMAGE_BUILDINGS, 512, 12, -1, 256 },
-            { IMAGE_BUILDINGS, 768, 12, -1, 256 },
-            { IMAGE_BUILDINGS, 1024, 12, -1, 256 },
-            { IMAGE_PALMS, 0, 16, -5, 224 },
-            { IMAGE_PALMS, 224, 16, -5, 224 },
-            { IMAGE_PALMS, 448, 16, -5, 224 },
-            { IMAGE_PALMS, 672, 16, -5, 224 },
-            { IMAGE_PALMS, 896, 16, -5, 224 },
-            { IMAGE_HIGHWAY, 0, 20, -10, 896 },
-            { IMAGE_HIGHWAY, 896, 20, -10, 896 },
-            { IMAGE_PALMTREE, 1120, 52, -10, 2240 },
+        // image id, render layer, x, y, speed, move length, repeats
+        // Copies of each layer are move length apart. The car is drawn in LAYER_CAR.
+        std::vector<Layer> layers = {
+            { IMAGE_BACK, LAYER_BACK, 0, 0, -0.5, 224, 5 },
+            { IMAGE_BUILDINGS, LAYER_BUILDINGS, 0, 12, -1, 256, 5 },
+            { IMAGE_PALMS, LAYER_PALMS, 0, 16, -5, 224, 5 },
+            { IMAGE_HIGHWAY, LAYER_HIGHWAY, 0, 20, -10, 896, 2 },
+            { IMAGE_PALMTREE, LAYER_FOREGROUND, 1120, 52, -10, 2240, 1 },
         };
 
-        // Create back ground sprites
-        m_scroll_sprites.resize(queues.size());
-        for (int i = 0; i < queues.size(); i++) {
-            Queue q = queues[i];
-            ImageBuffer &buf = m_image_buffers[q.image_id];
-            ScrollSprite &sprite = m_scroll_sprites[i];
-            sprite.SetBuffer(buf);
-            uiRect rect = buf.GetRect();
-            sprite.SetSrcRect(rect);
-            sprite.SetPosition(q.x, q.y);
-            sprite.SetAnimation(q.speed, q.x, q.move_length);
+        // Create back ground layers
+        m_layers.resize(layers.size());
+        for (size_t i = 0; i < layers.size(); i++) {
+            Layer l = layers[i];
+            m_layers[i].Initialize(l.image_id, l.layer, l.x, l.y, l.speed, l.move_length, l.repeats);
+        }
+
+        if (!m_async) {
+            for (int id = 0; id < IMAGE_COUNT; id++)
+                BindImage(id, m_atlas.GetBuffer(id), m_atlas.GetRect(id));
+            if (m_use_residency && LoadResidentImages())
+                return 1;
+            ComposeLayers(atlas_context);
         }
 
         return 0;
     }
 
-    void DrawSprites(uiDrawContext *c)
+    // Uploads decoded images within the budget. Call it at the start of frames.
+    void ApplyUploads(uiDrawContext *c)
+    {
+        if (!IsLoading()) return;
+        std::vector<int> ids;
+        if (m_loader.Upload(c, m_image_buffers, m_upload_budget_ms, &ids)) {
+            m_error_msg = m_loader.GetErrorMsg();
+            return;
+        }
+        for (int id : ids) {
+            ImageBuffer &buf = m_image_buffers[id];
+            BindImage(id, buf, buf.GetRect());
+        }
+    }
+
+    // Draws sprites between the last two steps. (see FrameScheduler)
+    // They are drawn in the order of their render layers, and sprites that share an image buffer in a layer are batched.
+    void DrawSprites(uiDrawContext *c, const uiRect &clip, double alpha)
     {
         if (HasError()) return;
-        int i;
-        for (i = 0; i < m_scroll_sprites.size() - 1; i++) {
-            m_scroll_sprites[i].Draw(c);
+        if (IsUsingCompositor()) {
+            DrawComposited(c, clip, alpha);
+            return;
         }
-        m_car.Draw(c);
-        m_scroll_sprites[i].Draw(c);
+        if (IsUsingResidency())
+            UpdateResidency(c, clip, alpha);
+        SubmitSprites(clip, alpha);
+        m_queue.Draw(c, 0);
     }
 
     void MoveSprites()
     {
         if (HasError()) return;
-        for (ScrollSprite &s : m_scroll_sprites) {
-            s.Move();
+        for (ParallaxLayer &layer : m_layers) {
+            layer.Move();
         }
-        m_car.Animate();
+        if (m_car.IsReady())
+            m_car.Animate();
+        TrackDamage();
     }
 
+    // Call it when drawing. A new size makes the whole area dirty.
+    void SetAreaSize(int width, int height)
+    {
+        if (width == m_area_width && height == m_area_height) return;
+        m_area_width = width;
+        m_area_height = height;
+        m_damage.Resize(width, height);
+        m_grid.Resize(width, height);
+    }
+
+    // Rects changed by the last MoveSprites()
+    const std::vector<uiRect> &GetDamage() { return m_damage.GetRects(); }
+
+    // returns false when the last MoveSprites() changed nothing on screen
+    int HasDamage() { return !m_damage.IsEmpty(); }
+
     void SetCarTargetX(double mouse_x)
     {
         m_car.SetTargetX(mouse_x);
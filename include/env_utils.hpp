@@ -2,4 +2,5 @@
 
 std::string GetExecutablePath();
 std::string GetDirectory(const std::string& path);
+std::string GetFileName(const std::string& path);
 void SetCwd(const std::string& path);
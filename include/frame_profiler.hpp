@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include <chrono>
+
+enum FRAME_PHASE : int {
+    PHASE_STEP = 0,  // simulation
+    PHASE_UPDATE,  // image buffer uploads
+    PHASE_DRAW,  // sprite drawing
+    PHASE_FRAME,  // interval between frames
+    PHASE_COUNT
+};
+
+// Records wall-clock timings of frame phases with std::chrono::steady_clock.
+// Each phase keeps the last window_size samples, so percentiles follow
+// the recent frames instead of the whole run.
+class FrameProfiler {
+ private:
+    struct History {
+        std::vector<double> samples;  // ring buffer in ms
+        size_t next;
+        size_t count;
+    };
+
+    History m_history[PHASE_COUNT];
+    std::chrono::steady_clock::time_point m_begin[PHASE_COUNT];
+    size_t m_window_size;
+    bool m_marked;  // Mark() has been called
+
+ public:
+    explicit FrameProfiler(int window_size = 240);
+
+    // Drops all samples
+    void Reset();
+
+    void Begin(int phase) { m_begin[phase] = std::chrono::steady_clock::now(); }
+
+    // Records the time since Begin(phase)
+    void End(int phase);
+
+    // Records the time since the last Mark() as a PHASE_FRAME sample.
+    // Call it once per frame.
+    void Mark();
+
+    void AddSample(int phase, double ms);
+
+    int GetSampleNum(int phase) { return (int)m_history[phase].count; }
+
+    // p in [0, 100]. Returns 0 when there are no samples.
+    double GetPercentile(int phase, double p);
+
+    double GetMean(int phase);
+
+    static const char *GetPhaseName(int phase);
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+
+// Runs the simulation at a fixed timestep regardless of timer jitter.
+// Advance() tells how many steps to run for the elapsed time,
+// and GetAlpha() tells how far the renderer is between the last two steps.
+class FrameScheduler {
+ private:
+    double m_step_sec;
+    int m_max_steps;  // avoid spiral of death after stalls
+    double m_accumulator;  // time not simulated yet
+    std::chrono::steady_clock::time_point m_last;
+    bool m_started;
+
+    double Elapsed(std::chrono::steady_clock::time_point now)
+    {
+        std::chrono::duration<double> elapsed = now - m_last;
+        return elapsed.count();
+    }
+
+ public:
+    explicit FrameScheduler(double step_sec = 0.01, int max_steps = 5)
+        : m_step_sec(step_sec), m_max_steps(max_steps), m_accumulator(0.0),
+          m_last(), m_started(false) {}
+
+    void Reset() { m_started = false; }
+
+    double GetStepSec() { return m_step_sec; }
+
+    // Returns the number of simulation steps to run now.
+    // The first call returns 1 to initialize the state.
+    int Advance()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        if (!m_started) {
+            m_started = true;
+            m_last = now;
+            m_accumulator = 0.0;
+            return 1;
+        }
+        m_accumulator += Elapsed(now);
+        m_last = now;
+
+        int steps = (int)(m_accumulator / m_step_sec);
+        if (steps > m_max_steps) {
+            // drop the time we can't catch up with
+            steps = m_max_steps;
+            m_accumulator = 0.0;
+        } else {
+            m_accumulator -= steps * m_step_sec;
+        }
+        return steps;
+    }
+
+    // Interpolation factor in [0, 1] between the previous and current steps
+    double GetAlpha()
+    {
+        if (!m_started) return 1.0;
+        double alpha = (m_accumulator + Elapsed(std::chrono::steady_clock::now())) / m_step_sec;
+        return std::min(std::max(alpha, 0.0), 1.0);
+    }
+};
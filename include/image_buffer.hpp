@@ -0,0 +1,427 @@
+#pragma once
+#include <string.h>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include "ui.h"
+#ifdef UI_IMAGE_BUFFER_EXT
+#include "ui_image_buffer_ext.h"  // libui patched with libui_ext.diff (meson -Dimage_buffer_ext=true)
+#endif
+#include "png_reader.hpp"
+#include "buffer_pool.hpp"
+#include "soft_renderer.hpp"
+
+// wrapper for uiImageBuffer
+// When it is created without a draw context, pixels are kept in CPU memory
+// instead, and the buffer can only be drawn with SoftRenderer.
+// Sprites point to buffers, so containers of buffers must not reallocate after binding them to sprites.
+class ImageBuffer {
+ private:
+    // pre-scaled copy of the image
+    struct ScaledLevel {
+        double scale;
+        ImageBuffer *buffer;
+    };
+
+    uiImageBuffer *m_image_buffer;
+    int m_width;
+    int m_height;
+    int m_has_alpha;
+    std::vector<unsigned char> m_pixels;  // CPU copy for headless mode, or staging memory for Lock()
+    PooledBuffer m_pooled;  // CPU copy adopted from a pool instead of m_pixels (see Adopt())
+    int m_locked;
+    unsigned char *m_mapped;  // surface memory from uiImageBufferLock() while locked
+    std::vector<ScaledLevel> m_levels;  // sorted by scale
+    std::vector<ImageBuffer *> m_tiles;  // row-major (see CreateTiledFromPng())
+    int m_tile_size;
+    int m_tile_cols;
+
+    unsigned char *GetCpuPixels()
+    {
+        if (m_pooled.GetData()) return m_pooled.GetData();
+        return m_pixels.empty() ? NULL : m_pixels.data();
+    }
+
+ public:
+    ImageBuffer() : m_image_buffer(NULL), m_width(0), m_height(0),
+                    m_has_alpha(0), m_pixels(), m_pooled(), m_locked(0), m_mapped(NULL), m_levels(),
+                    m_tiles(), m_tile_size(0), m_tile_cols(0) {}
+
+    // Buffers own libui objects. They can be moved (e.g. in std::vector) but not copied.
+    ImageBuffer(const ImageBuffer &) = delete;
+    ImageBuffer &operator=(const ImageBuffer &) = delete;
+
+    ImageBuffer(ImageBuffer &&b) noexcept
+        : m_image_buffer(b.m_image_buffer), m_width(b.m_width), m_height(b.m_height),
+          m_has_alpha(b.m_has_alpha), m_pixels(std::move(b.m_pixels)),
+          m_pooled(std::move(b.m_pooled)), m_locked(b.m_locked), m_mapped(b.m_mapped),
+          m_levels(std::move(b.m_levels)), m_tiles(std::move(b.m_tiles)),
+          m_tile_size(b.m_tile_size), m_tile_cols(b.m_tile_cols)
+    {
+        b.m_image_buffer = NULL;
+        b.m_levels.clear();
+        b.m_tiles.clear();
+    }
+
+    ImageBuffer &operator=(ImageBuffer &&b) noexcept
+    {
+        if (this == &b) return *this;
+        Free();
+        m_image_buffer = b.m_image_buffer;
+        m_width = b.m_width;
+        m_height = b.m_height;
+        m_has_alpha = b.m_has_alpha;
+        m_pixels = std::move(b.m_pixels);
+        m_pooled = std::move(b.m_pooled);
+        m_locked = b.m_locked;
+        m_mapped = b.m_mapped;
+        m_levels = std::move(b.m_levels);
+        m_tiles = std::move(b.m_tiles);
+        m_tile_size = b.m_tile_size;
+        m_tile_cols = b.m_tile_cols;
+        b.m_image_buffer = NULL;
+        b.m_levels.clear();
+        b.m_tiles.clear();
+        return *this;
+    }
+
+    ~ImageBuffer() {
+        FreeScaledLevels();
+        FreeTiles();
+        if (m_image_buffer)
+            uiFreeImageBuffer(m_image_buffer);
+    }
+
+    // Decodes the file into the memory of Lock().
+    // With image_buffer_ext, PngReader decodes straight into the surface of the libui buffer.
+    // Otherwise, the staging memory is freed after the upload. (call SetCpuCopy() for UpdateRect() without the ext)
+    int CreateFromPng(uiDrawContext *c, const char* file_name)
+    {
+        PngReader reader;
+        int ret = reader.ReadHeader(file_name);
+        if (ret) return 1;
+        int width, height, stride;
+        reader.GetSize(&width, &height);
+        Create(c, width, height, reader.HasAlpha());
+        unsigned char *pixels = Lock(&stride);
+        ret = reader.DecodeInto(pixels, stride);
+        Unlock();
+        FreeCpuCopy();
+        return ret;
+    }
+
+    // c can be NULL for headless mode.
+    // The old libui buffer, pixels, and scaled levels are freed.
+    // Libui buffers keep a CPU copy only when keep_cpu_copy is 1, e.g. for SoftRenderer or
+    // UpdateRect() without image_buffer_ext. Update() writes into the copy as well. (headless buffers always have one)
+    void Create(uiDrawContext *c, int width, int height, int has_alpha, int keep_cpu_copy = 0)
+    {
+        Free();
+        m_width = width;
+        m_height = height;
+        m_has_alpha = has_alpha;
+        if (c)
+            m_image_buffer = uiNewImageBuffer(c, m_width, m_height, m_has_alpha);
+        if (!c || keep_cpu_copy)
+            m_pixels.resize((size_t)m_width * m_height * 4);
+    }
+
+    // Takes over pixels decoded by PngDecoderPool. (width * 4 bytes per row)
+    // Libui buffers upload them and give them back to the pool at once, so they have no CPU copy.
+    // Headless buffers keep them as the CPU copy until FreeCpuCopy() or destruction.
+    void Adopt(uiDrawContext *c, int width, int height, int has_alpha, PooledBuffer &&pixels)
+    {
+        Free();
+        m_width = width;
+        m_height = height;
+        m_has_alpha = has_alpha;
+        if (c) {
+            m_image_buffer = uiNewImageBuffer(c, m_width, m_height, m_has_alpha);
+            uiImageBufferUpdate(m_image_buffer, pixels.GetData());
+            pixels.Release();
+        } else {
+            m_pooled = std::move(pixels);
+        }
+    }
+
+    void Update(const void* data)
+    {
+        if (m_image_buffer)
+            uiImageBufferUpdate(m_image_buffer, data);
+        unsigned char *pixels = GetCpuPixels();
+        if (pixels)
+            memcpy(pixels, data, (size_t)m_width * m_height * 4);
+    }
+
+    // Returns memory to write premultiplied RGBA pixels of the whole buffer.
+    // stride gets bytes per row (width * 4). Call Unlock() after writing.
+    // Locking a locked buffer returns the same memory.
+    // - Headless buffers and libui buffers with a CPU copy return the copy, and Unlock() uploads it.
+    // - Other libui buffers map their surface with uiImageBufferLock() when libui is built with
+    //   image_buffer_ext (see CanLockInPlace()). The old pixels are not read back, so write every pixel.
+    // - Without it, they allocate staging memory that is kept as the CPU copy until FreeCpuCopy(),
+    //   and Unlock() uploads the whole buffer with uiImageBufferUpdate.
+    unsigned char *Lock(int *stride)
+    {
+        *stride = m_width * 4;
+        if (m_mapped) return m_mapped;
+        m_locked = 1;
+#ifdef UI_IMAGE_BUFFER_EXT
+        if (m_image_buffer && !GetCpuPixels()) {
+            m_mapped = (unsigned char *)uiImageBufferLock(m_image_buffer, stride);
+            return m_mapped;
+        }
+#endif
+        if (!GetCpuPixels())
+            m_pixels.resize((size_t)m_width * m_height * 4);
+        return GetCpuPixels();
+    }
+
+    void Unlock()
+    {
+        if (!m_locked) return;
+        m_locked = 0;
+#ifdef UI_IMAGE_BUFFER_EXT
+        if (m_mapped) {
+            uiImageBufferUnlock(m_image_buffer);
+            m_mapped = NULL;
+            return;
+        }
+#endif
+        if (m_image_buffer)
+            uiImageBufferUpdate(m_image_buffer, GetCpuPixels());
+    }
+
+    // Returns 1 when Lock() writes into the pixels without staging memory,
+    // i.e. headless buffers, buffers with a CPU copy, or libui buffers with image_buffer_ext.
+    int CanLockInPlace()
+    {
+#ifdef UI_IMAGE_BUFFER_EXT
+        return 1;
+#else
+        return !m_image_buffer || GetCpuPixels() != NULL;
+#endif
+    }
+
+    // Gives the buffer a CPU copy of its current pixels in data (width * height * 4 bytes)
+    // without uploading them, e.g. for UpdateRect() or BuildScaledLevels().
+    void SetCpuCopy(const void *data)
+    {
+        if (!GetCpuPixels())
+            m_pixels.resize((size_t)m_width * m_height * 4);
+        memcpy(GetCpuPixels(), data, (size_t)m_width * m_height * 4);
+    }
+
+    // Points r at the Lock() memory, so sprites can be drawn into the buffer. (untiled buffers only)
+    // libui can't draw into uiImageBuffer, so SoftRenderer rasterizes them.
+    // Call EndRender() to upload the result.
+    void BeginRender(SoftRenderer &r)
+    {
+        int stride;
+        unsigned char *pixels = Lock(&stride);
+        r.SetTarget(pixels, m_width, m_height);
+    }
+
+    void EndRender() { Unlock(); }
+
+    // Updates pixels in rect only.
+    // data points to the first pixel of the rect, and stride is bytes per row of data.
+    // Only the rows in rect are copied into the CPU copy, if any.
+    // With image_buffer_ext, libui buffers upload the rows with uiImageBufferUpdateRect() and need no CPU copy.
+    // Without it, libui can only update whole buffers, so libui buffers upload the whole CPU copy after the copy.
+    // They need the CPU copy from Create() with keep_cpu_copy 1 or SetCpuCopy().
+    // Returns 1 when rect is out of the buffer or the copy is needed but missing.
+    int UpdateRect(const uiRect &rect, const void *data, int stride)
+    {
+        if (rect.X < 0 || rect.Y < 0 || rect.Width <= 0 || rect.Height <= 0 ||
+            rect.X + rect.Width > m_width || rect.Y + rect.Height > m_height)
+            return 1;
+        unsigned char *pixels = GetCpuPixels();
+#ifdef UI_IMAGE_BUFFER_EXT
+        if (m_image_buffer)
+            uiImageBufferUpdateRect(m_image_buffer, &rect, data, stride);
+        if (!pixels)
+            return m_image_buffer ? 0 : 1;
+#else
+        if (!pixels)
+            return 1;
+#endif
+
+        const unsigned char *src = (const unsigned char *)data;
+        size_t row_size = (size_t)rect.Width * 4;
+        for (int y = 0; y < rect.Height; y++) {
+            unsigned char *dst = pixels + ((size_t)(rect.Y + y) * m_width + rect.X) * 4;
+            memcpy(dst, src + (size_t)y * stride, row_size);
+        }
+#ifndef UI_IMAGE_BUFFER_EXT
+        if (m_image_buffer)
+            uiImageBufferUpdate(m_image_buffer, pixels);
+#endif
+        return 0;
+    }
+
+    // Returns 1 when UpdateRect() uploads only the rows in the rect without a CPU copy,
+    // i.e. headless buffers or libui buffers with image_buffer_ext.
+    int CanUploadRect()
+    {
+#ifdef UI_IMAGE_BUFFER_EXT
+        return 1;
+#else
+        return !m_image_buffer;
+#endif
+    }
+
+    // Frees the CPU copy of libui buffers. UpdateRect() fails after it unless CanUploadRect().
+    // Headless buffers keep their pixels.
+    void FreeCpuCopy()
+    {
+        if (m_image_buffer) {
+            std::vector<unsigned char>().swap(m_pixels);
+            m_pooled.Release();
+        }
+    }
+
+    void GetSize(int *width, int *height)
+    {
+        *width = m_width;
+        *height = m_height;
+    }
+
+    uiRect GetRect() {
+        return { 0, 0, m_width, m_height };
+    }
+
+    int HasAlpha() { return m_has_alpha; }
+
+    uiImageBuffer *GetLibuiBuffer() { return m_image_buffer; }
+
+    // returns NULL when the pixels are not kept in CPU memory
+    const unsigned char *GetPixels() { return GetCpuPixels(); }
+
+    // Builds a mip chain (1/2, 1/4, ...) with a 2x2 box filter and
+    // bilinear upscales by 2, 3, ..., max_upscale from the CPU copy.
+    // Sprites draw the closest level, so the backend resamples at near 1:1.
+    // Levels are not rebuilt by Update(). Call it again after changing pixels.
+    // Downscaled atlases can bleed neighbor pixels into the edges of sub-rects.
+    // Returns 1 when there is no CPU copy.
+    int BuildScaledLevels(uiDrawContext *c, int mip_levels, int max_upscale);
+
+    void FreeScaledLevels()
+    {
+        for (ScaledLevel &level : m_levels)
+            delete level.buffer;
+        m_levels.clear();
+    }
+
+    int HasScaledLevels() { return !m_levels.empty(); }
+
+    // Returns the level closest to scale in log space, or this buffer itself.
+    // level_scale gets the scale of the returned buffer.
+    ImageBuffer *GetScaledLevel(double scale, double *level_scale)
+    {
+        ImageBuffer *best = this;
+        *level_scale = 1.0;
+        if (m_levels.empty() || scale <= 0) return best;
+        double best_diff = std::fabs(std::log2(scale));
+        for (ScaledLevel &level : m_levels) {
+            double diff = std::fabs(std::log2(scale / level.scale));
+            if (diff < best_diff) {
+                best_diff = diff;
+                best = level.buffer;
+                *level_scale = level.scale;
+            }
+        }
+        return best;
+    }
+
+    // bytes of all levels
+    size_t GetScaledLevelBytes()
+    {
+        size_t bytes = 0;
+        for (ScaledLevel &level : m_levels)
+            bytes += (size_t)level.buffer->m_width * level.buffer->m_height * 4;
+        return bytes;
+    }
+
+    // Decodes a PNG file row by row into tile_size x tile_size tiles.
+    // A band of tiles is uploaded and its CPU copy is freed as soon as its last row arrives,
+    // so the peak memory is a band of tiles instead of the whole image.
+    // Headless tiles keep their pixels. The tiled buffer itself has no libui buffer or CPU copy,
+    // so draw it with ForEachTile(). (Sprite does)
+    int CreateTiledFromPng(uiDrawContext *c, const char *file_name, int tile_size = 512);
+
+    // Makes tiles without pixels. Give them pixels with GetTile() and Create() later.
+    // Draws skip tiles that have no pixels. (see TileResidency)
+    void CreateTiled(int width, int height, int has_alpha, int tile_size);
+
+    void FreeTiles()
+    {
+        for (ImageBuffer *tile : m_tiles)
+            delete tile;
+        m_tiles.clear();
+        m_tile_size = m_tile_cols = 0;
+    }
+
+    int IsTiled() { return !m_tiles.empty(); }
+    int GetTileSize() { return m_tile_size; }
+    int GetTileCount() { return (int)m_tiles.size(); }
+
+    void GetTileGrid(int *cols, int *rows)
+    {
+        *cols = m_tile_cols;
+        *rows = m_tile_cols ? (int)m_tiles.size() / m_tile_cols : 0;
+    }
+
+    ImageBuffer *GetTile(int col, int row) { return m_tiles[row * m_tile_cols + col]; }
+
+    // Frees the libui buffer, the CPU copy, and the tiles. The size is kept.
+    void Free()
+    {
+        FreeScaledLevels();
+        FreeTiles();
+        m_locked = 0;
+        m_mapped = NULL;
+        if (m_image_buffer) {
+            uiFreeImageBuffer(m_image_buffer);
+            m_image_buffer = NULL;
+        }
+        std::vector<unsigned char>().swap(m_pixels);
+        m_pooled.Release();
+    }
+
+    // Calls func(tile, tile_src, tile_dst) for each tile under src, or func(this, src, dst) for untiled buffers.
+    // dst is split at the same ratio as src, so neighbor pieces share their edges.
+    // Axis-aligned draws at integer scales match the untiled image. Rotated draws, fractional scales,
+    // and bilinear filtering (it doesn't cross tile borders) can differ by a texel along the borders.
+    template <class Func>
+    void ForEachTile(const uiRect &src, const uiRect &dst, Func func)
+    {
+        if (m_tiles.empty()) {
+            func(this, src, dst);
+            return;
+        }
+        int src_x0 = std::max(src.X, 0);
+        int src_y0 = std::max(src.Y, 0);
+        int src_x1 = std::min(src.X + src.Width, m_width);
+        int src_y1 = std::min(src.Y + src.Height, m_height);
+        if (src_x0 >= src_x1 || src_y0 >= src_y1) return;
+
+        for (int row = src_y0 / m_tile_size; row * m_tile_size < src_y1; row++) {
+            int y0 = std::max(src_y0, row * m_tile_size);
+            int y1 = std::min(src_y1, (row + 1) * m_tile_size);
+            int dst_y0 = dst.Y + (int)((long long)(y0 - src.Y) * dst.Height / src.Height);
+            int dst_y1 = dst.Y + (int)((long long)(y1 - src.Y) * dst.Height / src.Height);
+            if (dst_y0 == dst_y1) continue;
+            for (int col = src_x0 / m_tile_size; col * m_tile_size < src_x1; col++) {
+                int x0 = std::max(src_x0, col * m_tile_size);
+                int x1 = std::min(src_x1, (col + 1) * m_tile_size);
+                int dst_x0 = dst.X + (int)((long long)(x0 - src.X) * dst.Width / src.Width);
+                int dst_x1 = dst.X + (int)((long long)(x1 - src.X) * dst.Width / src.Width);
+                if (dst_x0 == dst_x1) continue;
+                uiRect tile_src = { x0 - col * m_tile_size, y0 - row * m_tile_size, x1 - x0, y1 - y0 };
+                uiRect tile_dst = { dst_x0, dst_y0, dst_x1 - dst_x0, dst_y1 - dst_y0 };
+                func(m_tiles[row * m_tile_cols + col], tile_src, tile_dst);
+            }
+        }
+    }
+};
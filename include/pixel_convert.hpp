@@ -0,0 +1,59 @@
+#pragma once
+#include <stddef.h>
+
+// Pixel conversion kernels for 32-bit RGBA images.
+// Alpha kernels work in place, and format conversions write RGBA from decoded PNG rows.
+// All kernels give the same results on every CPU.
+// The fastest kernel is picked at runtime (AVX2, SSE2, or scalar).
+
+enum PIXEL_KERNEL : int {
+    PIXEL_KERNEL_SCALAR = 0,
+    PIXEL_KERNEL_SSE2,
+    PIXEL_KERNEL_AVX2,
+    PIXEL_KERNEL_COUNT
+};
+
+// c = round(c * a / 255) for each color channel
+void PremultiplyAlpha(unsigned char *pixels, size_t count);
+
+// c = min(255, (c * 255 + a / 2) / a), or 0 when a == 0
+void UnpremultiplyAlpha(unsigned char *pixels, size_t count);
+
+// RGBA <-> BGRA
+void SwapRedBlue(unsigned char *pixels, size_t count);
+
+// Layouts of decoded PNG rows. 16-bit samples are host-endian.
+// Colors are straight (not premultiplied).
+enum PIXEL_FORMAT : int {
+    PIXEL_FORMAT_RGBA8 = 0,
+    PIXEL_FORMAT_RGB8,
+    PIXEL_FORMAT_GRAY8,
+    PIXEL_FORMAT_GRAY_ALPHA8,
+    PIXEL_FORMAT_RGBA16,
+    PIXEL_FORMAT_RGB16,
+    PIXEL_FORMAT_GRAY16,
+    PIXEL_FORMAT_GRAY_ALPHA16,
+    PIXEL_FORMAT_INDEXED8,  // 1-byte indices into a palette of 256 RGBA entries
+    PIXEL_FORMAT_COUNT
+};
+
+size_t GetPixelFormatSize(PIXEL_FORMAT format);  // bytes per pixel
+int PixelFormatHasAlpha(PIXEL_FORMAT format);
+const char *GetPixelFormatName(PIXEL_FORMAT format);
+
+// Converts count pixels of src into 32-bit RGBA at dst. 16-bit samples are rounded to 8 bits.
+// Colors are premultiplied unless premultiply is 0.
+// Indexed pixels take palette entries as they are, so premultiply the palette instead.
+// dst can be src only for PIXEL_FORMAT_RGBA8.
+void ConvertToRgba(PIXEL_FORMAT format, const unsigned char *src, unsigned char *dst, size_t count,
+                   int premultiply, const unsigned char *palette = NULL);
+
+// Unpacks 1, 2, or 4-bit indices (the first pixel in the high bits) into 1-byte indices
+void UnpackIndices(const unsigned char *src, unsigned char *dst, size_t count, int bit_depth);
+
+// The best kernel supported by the CPU is selected by default.
+// SetPixelKernel returns 1 if the CPU doesn't support the kernel.
+PIXEL_KERNEL GetPixelKernel();
+int SetPixelKernel(PIXEL_KERNEL kernel);
+int IsPixelKernelSupported(PIXEL_KERNEL kernel);
+const char *GetPixelKernelName(PIXEL_KERNEL kernel);
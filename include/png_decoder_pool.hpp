@@ -0,0 +1,46 @@
+#pragma once
+#include <stddef.h>
+#include "buffer_pool.hpp"
+
+// Decoded image whose pixels belong to a PngDecoderPool
+struct DecodedPng {
+    PooledBuffer pixels;
+    int width;
+    int height;
+    int has_alpha;
+    size_t row_size;  // bytes per row
+
+    DecodedPng() : pixels(), width(0), height(0), has_alpha(0), row_size(0) {}
+};
+
+// Decodes PNG files with pooled memory, so reloading the same set of images
+// allocates nothing after the first round.
+//   - Files are read into pooled memory and decoded from there.
+//   - spng allocates its context and working memory from a pool (spng_ctx_new2).
+//     libspng can't reset a context for another stream,
+//     so contexts are still made per decode, but their memory is recycled.
+//   - Pixels are pooled buffers. Hand them over to ImageBuffer::Adopt(),
+//     and they go back to the pool when the image buffer is done with them.
+// The pool must outlive the decoded images. Decode() can be called from several threads.
+class PngDecoderPool {
+ private:
+    BufferPool m_files;
+    BufferPool m_contexts;
+    BufferPool m_pixels;
+
+ public:
+    PngDecoderPool() : m_files(), m_contexts(), m_pixels() {}
+
+    // Pixels are converted to premultiplied alpha unless premultiply is 0.
+    // Returns 1 on failure.
+    int Decode(const char *file_name, DecodedPng *out, int premultiply = 1);
+
+    // sums of all pools
+    long long GetAllocations();
+    long long GetAllocatedBytes();
+    long long GetRequests();
+    long long GetReuses();
+
+    // Frees memory cached by the pools
+    void Trim();
+};
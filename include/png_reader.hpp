@@ -1,18 +1,53 @@
 #pragma once
 #include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <vector>
+#include <functional>
+#include "pixel_convert.hpp"
+
+struct spng_ctx;
+struct spng_alloc;
 
 class PngReader {
+ public:
+    // Receives decoded row y. Returns nonzero to stop decoding.
+    typedef std::function<int(int y, const unsigned char *row)> RowCallback;
+
  private:
     unsigned char *m_data;
     int m_width;
     int m_height;
     int m_has_alpha;
 
+    // opened by ReadHeader() until DecodeInto() or Close()
+    FILE *m_file;
+    spng_ctx *m_ctx;
+    int m_fmt;  // spng output format
+    int m_flags;  // spng decode flags
+    PIXEL_FORMAT m_pixel_format;  // layout of decoded rows before the conversion
+    int m_bit_depth;
+    size_t m_row_size;  // bytes per row of RGBA pixels
+    size_t m_native_row_size;  // decoded bytes per row before the conversion
+    std::vector<unsigned char> m_native_row;  // a decoded row for non-RGBA formats
+    std::vector<unsigned char> m_indices;  // unpacked indices of a row for low bit depths
+    std::vector<unsigned char> m_palette;  // 256 straight RGBA entries of indexed images
+    std::vector<unsigned char> m_premultiplied_palette;
+
+    int ReadHeader(spng_ctx *ctx);
+    int DecodeProgressive(unsigned char *dst, size_t stride, int convert, int premultiply);
+    void ConvertRow(const unsigned char *src, unsigned char *dst, int premultiply);
+
  public:
-    PngReader() : m_data(NULL), m_width(0), m_height(0), m_has_alpha(0) {}
+    PngReader() : m_data(NULL), m_width(0), m_height(0), m_has_alpha(0),
+                  m_file(NULL), m_ctx(NULL), m_fmt(0), m_flags(0),
+                  m_pixel_format(PIXEL_FORMAT_RGBA8), m_bit_depth(8),
+                  m_row_size(0), m_native_row_size(0), m_native_row(), m_indices(),
+                  m_palette(), m_premultiplied_palette() {}
 
     ~PngReader()
     {
+        Close();
         if (m_data)
             free(m_data);
     }
@@ -27,5 +62,48 @@ class PngReader {
 
     int HasAlpha() { return m_has_alpha; }
 
-    int ReadFromFile(const char* file_name);
+    // Pixels are converted to premultiplied alpha unless premultiply is 0.
+    int ReadFromFile(const char* file_name, int premultiply = 1);
+
+    // Reads the size and color type only. GetSize() and HasAlpha() work after it.
+    // Every color type and bit depth is decoded as 32-bit RGBA.
+    // Call DecodeInto() next to decode pixels into your own memory,
+    // e.g. ImageBuffer::Lock(), which maps the surface of the libui buffer with image_buffer_ext,
+    // without the buffer of PngReader.
+    int ReadHeader(const char* file_name);
+
+    // ReadHeader() for a PNG file in memory. data must be alive until DecodeInto() or Close().
+    // spng allocates its memory with alloc unless it's NULL. (see PngDecoderPool)
+    int ReadHeaderFromMemory(const void *data, size_t size, spng_alloc *alloc = NULL);
+
+    size_t GetRowSize() { return m_row_size; }
+
+    // Layout of rows given by DecodeNativeInto().
+    // Grayscale with tRNS is decoded with alpha, and indexed pixels are unpacked to 1 byte.
+    PIXEL_FORMAT GetPixelFormat() { return m_pixel_format; }
+
+    // 256 RGBA entries of indexed images, or NULL for other images.
+    // Entries are premultiplied unless premultiply is 0.
+    const unsigned char *GetPalette(int premultiply = 1)
+    {
+        if (m_palette.empty()) return NULL;
+        return premultiply ? m_premultiplied_palette.data() : m_palette.data();
+    }
+
+    // Decodes rows into dst. stride is bytes per row of dst.
+    // The file is closed after decoding.
+    int DecodeInto(unsigned char *dst, size_t stride, int premultiply = 1);
+
+    // Decodes rows one by one into a single row of memory and passes them to callback
+    // from top to bottom, so the whole image is never in memory.
+    // Interlaced images are decoded as a whole first because their rows are finished at the last pass.
+    // The file is closed after decoding. Returns 1 on failure or when callback stops it.
+    int DecodeRows(const RowCallback &callback, int premultiply = 1);
+
+    // Decodes rows of GetPixelFormat() into dst without converting them to RGBA.
+    // The file is closed after decoding.
+    int DecodeNativeInto(unsigned char *dst, size_t stride);
+
+    // Closes the file opened by ReadHeader()
+    void Close();
 };
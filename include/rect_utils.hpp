@@ -0,0 +1,67 @@
+#pragma once
+#include <cmath>
+#include <algorithm>
+#include "ui.h"
+
+// helpers for uiRect in pixels
+
+inline int IsRectEmpty(const uiRect &r)
+{
+    return r.Width <= 0 || r.Height <= 0;
+}
+
+inline uiRect IntersectRect(const uiRect &a, const uiRect &b)
+{
+    int x0 = std::max(a.X, b.X);
+    int y0 = std::max(a.Y, b.Y);
+    int x1 = std::min(a.X + a.Width, b.X + b.Width);
+    int y1 = std::min(a.Y + a.Height, b.Y + b.Height);
+    uiRect r = { x0, y0, std::max(x1 - x0, 0), std::max(y1 - y0, 0) };
+    return r;
+}
+
+inline int RectsIntersect(const uiRect &a, const uiRect &b)
+{
+    return a.X < b.X + b.Width && b.X < a.X + a.Width &&
+           a.Y < b.Y + b.Height && b.Y < a.Y + a.Height;
+}
+
+inline uiRect UnionRect(const uiRect &a, const uiRect &b)
+{
+    if (IsRectEmpty(a)) return b;
+    if (IsRectEmpty(b)) return a;
+    int x0 = std::min(a.X, b.X);
+    int y0 = std::min(a.Y, b.Y);
+    int x1 = std::max(a.X + a.Width, b.X + b.Width);
+    int y1 = std::max(a.Y + a.Height, b.Y + b.Height);
+    uiRect r = { x0, y0, x1 - x0, y1 - y0 };
+    return r;
+}
+
+inline int RectsEqual(const uiRect &a, const uiRect &b)
+{
+    return a.X == b.X && a.Y == b.Y && a.Width == b.Width && a.Height == b.Height;
+}
+
+// Conservative bounding box of rect rotated by rad around (x, y)
+inline uiRect RotatedBounds(const uiRect &rect, double x, double y, double rad)
+{
+    if (rad == 0.0) return rect;
+    double c = std::cos(rad);
+    double s = std::sin(rad);
+    double min_x = 1e300, min_y = 1e300, max_x = -1e300, max_y = -1e300;
+    for (int i = 0; i < 4; i++) {
+        double dx = rect.X + ((i & 1) ? rect.Width : 0) - x;
+        double dy = rect.Y + ((i & 2) ? rect.Height : 0) - y;
+        double px = x + c * dx - s * dy;
+        double py = y + s * dx + c * dy;
+        min_x = std::min(min_x, px);
+        min_y = std::min(min_y, py);
+        max_x = std::max(max_x, px);
+        max_y = std::max(max_y, py);
+    }
+    int x0 = (int)std::floor(min_x);
+    int y0 = (int)std::floor(min_y);
+    uiRect r = { x0, y0, (int)std::ceil(max_x) - x0, (int)std::ceil(max_y) - y0 };
+    return r;
+}
@@ -0,0 +1,98 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "ui.h"
+#include "sprite.hpp"
+#include "sprite_instances.hpp"
+
+// Sprites submitted for a frame and drawn in the order of their sort keys.
+// A key packs the layer (8 bits), the depth in the layer (32 bits), and the id of the image buffer (24 bits),
+// so sprites of the same layer and depth that share an image buffer are next to each other
+// and drawn as one batch (see DrawSpriteInstances).
+// Keys are sorted with an LSD radix sort. It's stable, so sprites with the same key keep their submit order.
+// Items point to the submitted sprites, which are drawn in place without copies.
+class RenderQueue {
+ private:
+    static const int RADIX_BITS = 12;  // max bits of a digit
+    static const int ID_CACHE_SIZE = 64;  // power of 2
+
+    struct Item {
+        uint64_t key;
+        Sprite *sprite;
+    };
+
+    std::vector<Item> m_items;
+    std::vector<Item> m_temp;  // for radix passes
+    std::vector<uint32_t> m_counts;  // bucket offsets of each pass
+    std::vector<SpriteInstance> m_instances;
+    std::vector<ImageBuffer *> m_buffers;  // image buffer of each id. kept across frames.
+    ImageBuffer *m_id_cache[ID_CACHE_SIZE];  // buffers found by GetBufferId(), indexed by a hash of the pointer
+    int m_id_cache_ids[ID_CACHE_SIZE];
+    uint64_t m_diff;  // bits that differ between submitted keys
+    int m_is_sorted;  // 1 when keys were submitted in order
+    double m_sort_ms;  // time of the last Sort()
+
+    // Walks items in draw order and yields the sprites they point to
+    class SpriteIterator {
+     private:
+        const Item *m_item;
+
+     public:
+        explicit SpriteIterator(const Item *item) : m_item(item) {}
+        Sprite &operator*() const { return *m_item->sprite; }
+        Sprite *operator->() const { return m_item->sprite; }
+        SpriteIterator &operator++()
+        {
+            ++m_item;
+            return *this;
+        }
+        bool operator!=(const SpriteIterator &it) const { return m_item != it.m_item; }
+    };
+
+ public:
+    RenderQueue() : m_items(), m_temp(), m_counts(), m_instances(), m_buffers(),
+                    m_id_cache(), m_id_cache_ids(), m_diff(0), m_is_sorted(1), m_sort_ms(0) {}
+
+    static uint64_t MakeKey(int layer, unsigned depth, int buffer_id)
+    {
+        return ((uint64_t)(layer & 0xFF) << 56) | ((uint64_t)depth << 24) | (uint64_t)(buffer_id & 0xFFFFFF);
+    }
+
+    // Call it at the start of frames
+    void Clear();
+
+    // Ids are given in the order buffers are seen.
+    // Sprites usually share a few buffers (e.g. atlas pages), so it looks them up linearly
+    // behind a small direct-mapped cache.
+    int GetBufferId(ImageBuffer *buf);
+
+    // Adds the sprite with its key. Sprites without buffers are ignored.
+    // The sprite is not copied, so it must stay alive and unmoved until the queue is drawn or cleared.
+    void Submit(Sprite *sprite, int layer, unsigned depth = 0);
+
+    // Sorts submitted sprites by their keys
+    void Sort();
+
+    int GetSize() { return (int)m_items.size(); }
+
+    // time of the last Sort()
+    double GetSortTime() { return m_sort_ms; }
+
+    // Calls func(Sprite &) for each sprite in draw order. Call Sort() first.
+    template <class Func>
+    void ForEach(Func func)
+    {
+        for (const Item &item : m_items)
+            func(*item.sprite);
+    }
+
+    // Draws sprites in draw order and returns the number of batches. Call Sort() first.
+    // Target can be uiDrawContext * or SoftRenderer &.
+    template <class Target>
+    int Draw(Target &&target, int fast)
+    {
+        const Item *items = m_items.data();
+        return DrawSpriteInstances(target, SpriteIterator(items),
+                                   SpriteIterator(items + m_items.size()), fast, m_instances);
+    }
+};
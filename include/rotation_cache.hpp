@@ -0,0 +1,77 @@
+#pragma once
+#include <stddef.h>
+#include <list>
+#include <map>
+#include <memory>
+#include "ui.h"
+#include "image_buffer.hpp"
+
+// Rotated images of sprites rasterized at quantized angles.
+// Sprites that use the cache snap to the nearest angle and draw
+// the cached image as a plain 1:1 blit instead of a rotated draw.
+// Least recently used images are evicted when the cache exceeds its memory cap.
+// Call Clear() when source images change.
+class RotationCache {
+ public:
+    // A rotated image. Draw it at (dst.X + offset_x, dst.Y + offset_y)
+    // where dst is the unrotated dst rect of the sprite.
+    struct Variant {
+        std::unique_ptr<ImageBuffer> buffer;
+        int offset_x, offset_y;
+        int width, height;
+    };
+
+ private:
+    struct Key {
+        const ImageBuffer *source;
+        int src_x, src_y, src_w, src_h;
+        int dst_w, dst_h;
+        int pivot_x, pivot_y;  // rotation center in the dst rect (1/8 px)
+        int angle;  // angle index
+        int fast;
+
+        bool operator<(const Key &k) const;
+    };
+    typedef std::list<std::pair<Key, Variant>> Entries;
+
+    Entries m_entries;  // most recently used first
+    std::map<Key, Entries::iterator> m_index;
+    int m_steps;
+    size_t m_max_bytes;
+    size_t m_bytes;
+    long long m_hits;
+    long long m_misses;
+    long long m_evictions;
+
+    void Evict();
+
+ public:
+    explicit RotationCache(int steps = 200, size_t max_bytes = 64 * 1024 * 1024);
+
+    // Angles are quantized into steps per turn. It clears the cache.
+    void SetSteps(int steps);
+    int GetSteps() { return m_steps; }
+
+    void SetMaxBytes(size_t max_bytes);
+
+    void Clear();
+
+    // Returns the rotated image of src_rect of source drawn into a dst_w x dst_h rect
+    // that is rotated by rad around (pivot_x, pivot_y) in the dst rect.
+    // It rasterizes the image on the first use. c can be NULL for headless buffers.
+    // Returns NULL when source has no CPU copy. (see ImageBuffer::SetCpuCopy)
+    const Variant *Get(uiDrawContext *c, ImageBuffer &source, const uiRect &src_rect,
+                       int dst_w, int dst_h, double pivot_x, double pivot_y,
+                       double rad, int fast);
+
+    // Rasterizes all angles at once, e.g. at load time.
+    void Prepare(uiDrawContext *c, ImageBuffer &source, const uiRect &src_rect,
+                 int dst_w, int dst_h, double pivot_x, double pivot_y, int fast);
+
+    size_t GetBytes() { return m_bytes; }
+    int GetVariantNum() { return (int)m_entries.size(); }
+    long long GetHits() { return m_hits; }
+    long long GetMisses() { return m_misses; }
+    long long GetEvictions() { return m_evictions; }
+    void ResetStats() { m_hits = m_misses = m_evictions = 0; }
+};
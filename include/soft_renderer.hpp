@@ -0,0 +1,91 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include <algorithm>
+#include "ui.h"
+
+// Software rasterizer that composites premultiplied RGBA images
+// into an in-memory framebuffer.
+// It follows the same src rect, dst rect, and rotation semantics as
+// uiImageBufferDraw with uiDrawMatrixRotate.
+// So, sprites can be drawn and checked without any display.
+class SoftRenderer {
+ private:
+    std::vector<unsigned char> m_storage;
+    unsigned char *m_pixels;  // premultiplied RGBA in m_storage or in the memory of SetTarget()
+    int m_width;
+    int m_height;
+    uiRect m_clip;  // all drawing is limited to this rect
+
+ public:
+    SoftRenderer() : m_storage(), m_pixels(NULL), m_width(0), m_height(0), m_clip() {}
+
+    // m_pixels can point to m_storage
+    SoftRenderer(const SoftRenderer &) = delete;
+    SoftRenderer &operator=(const SoftRenderer &) = delete;
+
+    void Resize(int width, int height)
+    {
+        m_width = width;
+        m_height = height;
+        m_storage.assign((size_t)width * height * 4, 0);
+        m_pixels = m_storage.data();
+        ResetClip();
+    }
+
+    // Draws into memory owned by the caller (width * 4 bytes per row) instead.
+    // Renderers on the same memory can draw disjoint clip rects on different threads.
+    void SetTarget(unsigned char *pixels, int width, int height)
+    {
+        std::vector<unsigned char>().swap(m_storage);
+        m_pixels = pixels;
+        m_width = width;
+        m_height = height;
+        ResetClip();
+    }
+
+    // The framebuffer is kept between frames.
+    // So, you can redraw only the changed areas with clipping.
+    void SetClip(const uiRect &rect)
+    {
+        m_clip = rect;
+        if (m_clip.X < 0) { m_clip.Width += m_clip.X; m_clip.X = 0; }
+        if (m_clip.Y < 0) { m_clip.Height += m_clip.Y; m_clip.Y = 0; }
+        m_clip.Width = std::max(std::min(m_clip.Width, m_width - m_clip.X), 0);
+        m_clip.Height = std::max(std::min(m_clip.Height, m_height - m_clip.Y), 0);
+    }
+
+    void ResetClip() { m_clip = { 0, 0, m_width, m_height }; }
+
+    void GetSize(int *width, int *height)
+    {
+        *width = m_width;
+        *height = m_height;
+    }
+
+    unsigned char *GetData() { return m_pixels; }
+
+    // Fills the framebuffer with an opaque color (0xRRGGBB)
+    void Clear(uint32_t color);
+
+    // Fills a rect with an opaque color (0xRRGGBB)
+    void FillRect(const uiRect &rect, uint32_t color);
+
+    // Draws src_rect of an image into dst_rect.
+    // The dst rect is rotated by rad around (x, y).
+    // Pixels don't depend on the clip rect, so clipped draws match parts of a full draw.
+    // Uses nearest-neighbor sampling when fast is true, bilinear otherwise.
+    void DrawImage(const unsigned char *image, int image_width, int image_height,
+                   const uiRect &src_rect, const uiRect &dst_rect,
+                   double x, double y, double rad, int fast);
+
+    // DrawImage without rotation. It skips the inverse rotation per pixel.
+    void DrawImageAxisAligned(const unsigned char *image, int image_width, int image_height,
+                              const uiRect &src_rect, const uiRect &dst_rect, int fast);
+
+    // FNV-1a hash of the framebuffer to compare frames across runs
+    uint32_t Checksum();
+
+    // Saves the framebuffer as a binary PPM file. (alpha is dropped)
+    int SaveAsPpm(const char *file_name);
+};
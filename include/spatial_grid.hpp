@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+#include "ui.h"
+
+// Uniform grid of sprite bounds for view culling.
+// The grid covers the visible area. Each sprite is listed in the cells its bounds overlap,
+// and sprites outside of the area are in no cells, so queries never see them.
+// Updates are incremental: a sprite that stays in the same cells only updates its bounds.
+class SpatialGrid {
+ private:
+    struct Entry {
+        uiRect bounds;
+        int x0, y0, x1, y1;  // cell range (empty when x0 > x1)
+        unsigned int stamp;  // last query that visited the entry
+        int active;
+    };
+
+    std::vector<std::vector<int>> m_cells;  // ids in each cell
+    std::vector<Entry> m_entries;  // indexed by id
+    int m_width;
+    int m_height;
+    int m_cell_size;
+    int m_cols;
+    int m_rows;
+    unsigned int m_stamp;
+    long long m_cell_moves;  // updates that changed cells
+
+    void GetCellRange(const uiRect &bounds, int *x0, int *y0, int *x1, int *y1);
+    void Link(int id);
+    void Unlink(int id);
+
+ public:
+    SpatialGrid() : m_cells(), m_entries(), m_width(0), m_height(0), m_cell_size(128),
+                    m_cols(0), m_rows(0), m_stamp(0), m_cell_moves(0) {}
+
+    // Resizes the visible area. Sprites are re-inserted with their last bounds.
+    void Resize(int width, int height);
+
+    // Larger cells make fewer cell moves but more candidates per query.
+    void SetCellSize(int cell_size);
+
+    // Sprites that are stored in a fixed order should use their indices as ids.
+    void Update(int id, const uiRect &bounds);
+
+    void Remove(int id);
+
+    void Clear();
+
+    // Gets ids of sprites whose bounds intersect rect, in ascending order.
+    // So, sprites indexed in draw order are still drawn in order.
+    void Query(const uiRect &rect, std::vector<int> *ids);
+
+    long long GetCellMoves() { return m_cell_moves; }
+};
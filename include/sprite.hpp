@@ -1,116 +1,204 @@
 #pragma once
+#include <cmath>
+#include <vector>
+#include <algorithm>
 #include "ui.h"
-#include "png_reader.hpp"
+#include "image_buffer.hpp"
+#include "soft_renderer.hpp"
+#include "rect_utils.hpp"
+#include "rotation_cache.hpp"
+#include "sprite_instances.hpp"
 
-// wrapper for uiImageBuffer
-class ImageBuffer {
- private:
-    uiImageBuffer *m_image_buffer;
-    int m_width;
-    int m_height;
-    int m_has_alpha;
-
- public:
-    ImageBuffer() : m_image_buffer(NULL) {}
-
-    ~ImageBuffer() {
-        if (m_image_buffer)
-            uiFreeImageBuffer(m_image_buffer);
-    }
-
-    int CreateFromPng(uiDrawContext *c, const char* file_name)
-    {
-        PngReader reader;
-        int ret = reader.ReadFromFile(file_name);
-        if (ret) return 1;
-        reader.GetSize(&m_width, &m_height);
-        m_has_alpha = reader.HasAlpha();
-        m_image_buffer = uiNewImageBuffer(c, m_width, m_height, m_has_alpha);
-        uiImageBufferUpdate(m_image_buffer, reader.GetData());
-        return 0;
-    }
+class Sprite {
+ protected:
+    ImageBuffer *m_buffer;
+    uiRect m_src_rect;  // sprite area in the image buffer
+    double m_cx, m_cy;  // conter point of the sprite
+    double m_x, m_y;  // coordinates of the center point in uiArea
+    double m_sx, m_sy;  // scale
+    double m_rad;  // rotation angle
+    double m_prev_x, m_prev_y, m_prev_rad;  // state of the previous simulation step
+    RotationCache *m_rotation_cache;  // optional
 
-    void Create(uiDrawContext *c, int width, int height, int has_alpha)
+    // Finds the cached image for the current angle.
+    // Returns NULL when the sprite should be rotated on the fly.
+    const RotationCache::Variant *GetCachedVariant(uiDrawContext *c, int fast, uiRect *dstrect)
     {
-        m_width = width;
-        m_height = height;
-        m_has_alpha = has_alpha;
-        m_image_buffer = uiNewImageBuffer(c, m_width, m_height, m_has_alpha);
+        if (!m_rotation_cache || m_rad == 0.0) return NULL;
+        *dstrect = GetDstRect();
+        const RotationCache::Variant *variant =
+            m_rotation_cache->Get(c, *m_buffer, m_src_rect, dstrect->Width, dstrect->Height,
+                                  m_x - dstrect->X, m_y - dstrect->Y, m_rad, fast);
+        if (!variant) return NULL;
+        dstrect->X += variant->offset_x;
+        dstrect->Y += variant->offset_y;
+        dstrect->Width = variant->width;
+        dstrect->Height = variant->height;
+        return variant;
     }
 
-    void Update(const void* data)
+    // Picks the pre-scaled level closest to the scale of the sprite.
+    // src gets the src rect in the level.
+    ImageBuffer *GetScaledSource(uiRect *src)
     {
-        uiImageBufferUpdate(m_image_buffer, data);
+        *src = m_src_rect;
+        if (!m_buffer->HasScaledLevels()) return m_buffer;
+        double level_scale;
+        ImageBuffer *level = m_buffer->GetScaledLevel(std::min(std::fabs(m_sx), std::fabs(m_sy)),
+                                                      &level_scale);
+        if (level_scale != 1.0) {
+            src->X = (int)std::floor(m_src_rect.X * level_scale + 0.5);
+            src->Y = (int)std::floor(m_src_rect.Y * level_scale + 0.5);
+            src->Width = std::max((int)std::floor(m_src_rect.Width * level_scale + 0.5), 1);
+            src->Height = std::max((int)std::floor(m_src_rect.Height * level_scale + 0.5), 1);
+        }
+        return level;
     }
 
-    void GetSize(int *width, int *height)
+    // Draws src of the buffer into dst piece by piece when the buffer is tiled
+    static void DrawBuffer(uiDrawContext *c, ImageBuffer *buffer, const uiRect &src, const uiRect &dst, int fast)
     {
-        *width = m_width;
-        *height = m_height;
-    }
-
-    uiRect GetRect() {
-        return { 0, 0, m_width, m_height };
+        buffer->ForEachTile(src, dst, [c, fast](ImageBuffer *tile, uiRect tile_src, uiRect tile_dst) {
+            if (!tile->GetLibuiBuffer()) return;  // not resident (see TileResidency)
+            if (fast)
+                uiImageBufferDrawFast(c, tile->GetLibuiBuffer(), &tile_src, &tile_dst);
+            else
+                uiImageBufferDraw(c, tile->GetLibuiBuffer(), &tile_src, &tile_dst);
+        });
     }
 
-    int HasAlpha() { return m_has_alpha; }
-
-    uiImageBuffer *GetLibuiBuffer() { return m_image_buffer; }
-};
-
-class Sprite {
- protected:
-    uiImageBuffer *m_image_buffer;
-    uiRect m_src_rect;  // sprite area in the image buffer
-    double m_cx, m_cy;  // conter point of the sprite
-    double m_x, m_y;  // coordinates of the center point in uiArea
-    double m_sx, m_sy;  // scale
-    double m_rad;  // rotation angle
-
  public:
-    Sprite() : m_image_buffer(NULL),
+    Sprite() : m_buffer(NULL),
                m_src_rect({ 0, 0, 0, 0 }),
                m_cx(0.0), m_cy(0.0),
                m_x(0.0), m_y(0.0),
                m_sx(1.0), m_sy(1.0),
-               m_rad(0.0) {}
+               m_rad(0.0),
+               m_prev_x(0.0), m_prev_y(0.0), m_prev_rad(0.0),
+               m_rotation_cache(NULL) {}
+
+    // The sprite keeps a pointer to buf, so buf must not move while the sprite uses it.
+    // e.g. don't grow a std::vector<ImageBuffer> after binding its buffers to sprites.
+    void SetBuffer(ImageBuffer &buf) { m_buffer = &buf; }
 
-    void SetBuffer(ImageBuffer &buf) { m_image_buffer = buf.GetLibuiBuffer(); }
     void SetSrcRect(uiRect rect) { m_src_rect = rect; }
-    void SetPosition(double x, double y) { m_x = x; m_y = y; }
+    // SetPosition() and SetAngle() don't interpolate from the previous state.
+    void SetPosition(double x, double y) { m_x = m_prev_x = x; m_y = m_prev_y = y; }
     void SetCenter(double cx, double cy) { m_cx = cx; m_cy = cy; }
     void SetScale(double sx, double sy) { m_sx = sx; m_sy = sy; }
-    void SetAngle(double rad) { m_rad = rad; }
+    void SetAngle(double rad) { m_rad = m_prev_rad = rad; }
+
+    // Rotated draws use images in the cache when it's not NULL.
+    // The angle snaps to the quantization of the cache.
+    void SetRotationCache(RotationCache *cache) { m_rotation_cache = cache; }
+
+    // Rasterizes all angles of the sprite into the cache in advance
+    void PrepareRotations(uiDrawContext *c, int fast)
+    {
+        if (!m_rotation_cache || !m_buffer) return;
+        uiRect dstrect = GetDstRect();
+        m_rotation_cache->Prepare(c, *m_buffer, m_src_rect, dstrect.Width, dstrect.Height,
+                                  m_x - dstrect.X, m_y - dstrect.Y, fast);
+    }
+
+    // sprites without buffers are placeholders (e.g. while loading)
+    int IsReady() { return m_buffer != NULL; }
 
-    uiImageBuffer *GetLibuiBuffer() { return m_image_buffer; }
+    ImageBuffer *GetBuffer() { return m_buffer; }
+    uiImageBuffer *GetLibuiBuffer() { return m_buffer ? m_buffer->GetLibuiBuffer() : NULL; }
     uiRect GetSrcRect() { return m_src_rect; }
     void GetPosition(double *x, double *y) { *x = m_x; *y = m_y; }
     void GetCenter(double *cx, double *cy) { *cx = m_cx; *cy = m_cy; }
     void GetScale(double *sx, double *sy) { *sx = m_sx; *sy = m_sy; }
     double GetAngle() { return m_rad; }
 
-    void Draw(uiDrawContext *c)
+    // sprite area in uiArea before rotation
+    uiRect GetDstRect()
     {
-        uiDrawSave(c);
-
-        uiDrawMatrix rm;
-        uiDrawMatrixSetIdentity(&rm);
-        uiDrawMatrixRotate(&rm, m_x, m_y, m_rad);
-        uiDrawTransform(c, &rm);
-
         uiRect dstrect = {
             (int)(m_x - m_cx * m_sx),
             (int)(m_y - m_cy * m_sy),
             (int)(m_src_rect.Width * m_sx),
             (int)(m_src_rect.Height * m_sy)
         };
-        uiImageBufferDraw(c, m_image_buffer, &m_src_rect, &dstrect);
+        return dstrect;
+    }
 
-        uiDrawRestore(c);  // reset matrix for other sprites
+    int IsRotated() { return m_rad != 0.0; }
+
+    // Fills an instance for DrawImageInstances() and returns the buffer to draw it from.
+    // Returns NULL when the sprite can't be batched (not ready, or drawn from the rotation cache).
+    ImageBuffer *GetInstance(SpriteInstance *instance)
+    {
+        if (!m_buffer || (m_rotation_cache && m_rad != 0.0)) return NULL;
+        ImageBuffer *source = GetScaledSource(&instance->src);
+        instance->dst = GetDstRect();
+        instance->x = m_x;
+        instance->y = m_y;
+        instance->rad = m_rad;
+        return source;
     }
 
-    void DrawFast(uiDrawContext *c)
+    // Part of the src rect that is drawn in view.
+    // It's the whole src rect for rotated sprites.
+    uiRect GetVisibleSrcRect(const uiRect &view)
+    {
+        uiRect dstrect = GetDstRect();
+        if (IsRotated() || dstrect.Width <= 0 || dstrect.Height <= 0) return m_src_rect;
+        uiRect visible = IntersectRect(dstrect, view);
+        if (IsRectEmpty(visible)) return { m_src_rect.X, m_src_rect.Y, 0, 0 };
+        int x0 = (int)std::floor((double)(visible.X - dstrect.X) * m_src_rect.Width / dstrect.Width);
+        int y0 = (int)std::floor((double)(visible.Y - dstrect.Y) * m_src_rect.Height / dstrect.Height);
+        int x1 = (int)std::ceil((double)(visible.X + visible.Width - dstrect.X) * m_src_rect.Width / dstrect.Width);
+        int y1 = (int)std::ceil((double)(visible.Y + visible.Height - dstrect.Y) * m_src_rect.Height / dstrect.Height);
+        return { m_src_rect.X + x0, m_src_rect.Y + y0, x1 - x0, y1 - y0 };
+    }
+
+    // Call it before moving the sprite in a simulation step
+    void SavePrevState()
+    {
+        m_prev_x = m_x;
+        m_prev_y = m_y;
+        m_prev_rad = m_rad;
+    }
+
+    // Copy of the sprite between the previous and current steps.
+    // alpha is 0 for the previous state and 1 for the current one.
+    Sprite Interpolated(double alpha)
+    {
+        Sprite sprite = *this;
+        sprite.m_x = m_prev_x + (m_x - m_prev_x) * alpha;
+        sprite.m_y = m_prev_y + (m_y - m_prev_y) * alpha;
+        // take the shorter way around the circle
+        sprite.m_rad = m_prev_rad + std::remainder(m_rad - m_prev_rad, 2 * uiPi) * alpha;
+        return sprite;
+    }
+
+    // sprite area in uiArea after rotation.
+    // It has a 1px margin for antialiased edges.
+    uiRect GetBounds()
+    {
+        uiRect bounds = RotatedBounds(GetDstRect(), m_x, m_y, m_rad);
+        bounds.X -= 1;
+        bounds.Y -= 1;
+        bounds.Width += 2;
+        bounds.Height += 2;
+        return bounds;
+    }
+
+    // Draws the sprite with rotation. It uses the matrix stack of the context
+    // unless the rotation cache has the image.
+    void DrawRotated(uiDrawContext *c, int fast)
     {
+        uiRect cached_rect;
+        const RotationCache::Variant *variant = GetCachedVariant(c, fast, &cached_rect);
+        if (variant) {
+            // 1:1 blit
+            uiRect src = variant->buffer->GetRect();
+            uiImageBufferDrawFast(c, variant->buffer->GetLibuiBuffer(), &src, &cached_rect);
+            return;
+        }
+
         uiDrawSave(c);
 
         uiDrawMatrix rm;
@@ -118,14 +206,134 @@ class Sprite {
         uiDrawMatrixRotate(&rm, m_x, m_y, m_rad);
         uiDrawTransform(c, &rm);
 
-        uiRect dstrect = {
-            (int)(m_x - m_cx * m_sx),
-            (int)(m_y - m_cy * m_sy),
-            (int)(m_src_rect.Width * m_sx),
-            (int)(m_src_rect.Height * m_sy)
-        };
-        uiImageBufferDrawFast(c, m_image_buffer, &m_src_rect, &dstrect);
+        uiRect dstrect = GetDstRect();
+        uiRect srcrect;
+        ImageBuffer *source = GetScaledSource(&srcrect);
+        DrawBuffer(c, source, srcrect, dstrect, fast);
 
         uiDrawRestore(c);  // reset matrix for other sprites
     }
+
+    // Draws the sprite without touching the matrix stack. Rotation is ignored.
+    // Translation and scale are already in the dst rect.
+    void DrawAxisAligned(uiDrawContext *c, int fast)
+    {
+        uiRect dstrect = GetDstRect();
+        uiRect srcrect;
+        ImageBuffer *source = GetScaledSource(&srcrect);
+        DrawBuffer(c, source, srcrect, dstrect, fast);
+    }
+
+    void Draw(uiDrawContext *c)
+    {
+        if (IsRotated())
+            DrawRotated(c, 0);
+        else
+            DrawAxisAligned(c, 0);
+    }
+
+    void DrawFast(uiDrawContext *c)
+    {
+        if (IsRotated())
+            DrawRotated(c, 1);
+        else
+            DrawAxisAligned(c, 1);
+    }
+
+    // Draws the sprite with the software renderer.
+    // The buffer should be created in headless mode.
+    void DrawRotated(SoftRenderer &r, int fast)
+    {
+        uiRect cached_rect;
+        const RotationCache::Variant *variant = GetCachedVariant(NULL, fast, &cached_rect);
+        if (variant) {
+            r.DrawImageAxisAligned(variant->buffer->GetPixels(), variant->width, variant->height,
+                                   variant->buffer->GetRect(), cached_rect, 1);
+            return;
+        }
+
+        uiRect srcrect;
+        ImageBuffer *source = GetScaledSource(&srcrect);
+        double x = m_x, y = m_y, rad = m_rad;
+        source->ForEachTile(srcrect, GetDstRect(), [&r, x, y, rad, fast](ImageBuffer *tile, const uiRect &src, const uiRect &dst) {
+            int width, height;
+            tile->GetSize(&width, &height);
+            r.DrawImage(tile->GetPixels(), width, height, src, dst, x, y, rad, fast);
+        });
+    }
+
+    void DrawAxisAligned(SoftRenderer &r, int fast)
+    {
+        uiRect srcrect;
+        ImageBuffer *source = GetScaledSource(&srcrect);
+        source->ForEachTile(srcrect, GetDstRect(), [&r, fast](ImageBuffer *tile, const uiRect &src, const uiRect &dst) {
+            int width, height;
+            tile->GetSize(&width, &height);
+            r.DrawImageAxisAligned(tile->GetPixels(), width, height, src, dst, fast);
+        });
+    }
+
+    void Draw(SoftRenderer &r)
+    {
+        if (IsRotated())
+            DrawRotated(r, 0);
+        else
+            DrawAxisAligned(r, 0);
+    }
+
+    void DrawFast(SoftRenderer &r)
+    {
+        if (IsRotated())
+            DrawRotated(r, 1);
+        else
+            DrawAxisAligned(r, 1);
+    }
 };
+
+// Draws sprites in [begin, end).
+// Only rotated sprites go through the matrix stack.
+// Target can be uiDrawContext * or SoftRenderer &.
+template <class Target, class Iterator>
+void DrawSpriteRange(Target &&target, Iterator begin, Iterator end, int fast)
+{
+    for (Iterator it = begin; it != end; ++it) {
+        if (it->IsRotated())
+            it->DrawRotated(target, fast);
+        else
+            it->DrawAxisAligned(target, fast);
+    }
+}
+
+// Draws sprites in [begin, end) in batches of the same image buffer (see DrawImageInstances).
+// A batch ends when the image buffer changes, and sprites that can't be batched
+// are drawn by themselves between batches. instances is a scratch array.
+// Returns the number of batches.
+template <class Target, class Iterator>
+int DrawSpriteInstances(Target &&target, Iterator begin, Iterator end, int fast,
+                        std::vector<SpriteInstance> &instances)
+{
+    int batches = 0;
+    ImageBuffer *batch = NULL;
+    instances.clear();
+    for (Iterator it = begin; it != end; ++it) {
+        SpriteInstance instance;
+        ImageBuffer *source = it->GetInstance(&instance);
+        if (source != batch || !source) {
+            if (!instances.empty()) {
+                DrawImageInstances(target, *batch, instances.data(), (int)instances.size(), fast);
+                batches++;
+            }
+            instances.clear();
+            batch = source;
+        }
+        if (source)
+            instances.push_back(instance);
+        else if (it->IsReady())
+            it->DrawRotated(target, fast);
+    }
+    if (!instances.empty()) {
+        DrawImageInstances(target, *batch, instances.data(), (int)instances.size(), fast);
+        batches++;
+    }
+    return batches;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <vector>
+#include "ui.h"
+#include "sprite.hpp"
+#include "soft_renderer.hpp"
+
+// Sprites stored as a structure of arrays.
+// Each attribute has its own contiguous array, so batch updates are
+// plain loops over floats that compilers can vectorize.
+// Use it for many sprites that share an image buffer, e.g. particles.
+class SpriteArray {
+ private:
+    ImageBuffer *m_buffer;  // shared by all sprites
+    std::vector<float> m_x, m_y;  // coordinates of the center points
+    std::vector<float> m_cx, m_cy;  // center points in the sprites
+    std::vector<float> m_sx, m_sy;  // scales
+    std::vector<float> m_rad;  // rotation angles
+    std::vector<int> m_src_x, m_src_y, m_src_w, m_src_h;  // src rects
+    std::vector<int> m_dst_x, m_dst_y, m_dst_w, m_dst_h;  // dst rects (see UpdateDstRects)
+
+ public:
+    SpriteArray() : m_buffer(NULL), m_x(), m_y(), m_cx(), m_cy(), m_sx(), m_sy(), m_rad(),
+                    m_src_x(), m_src_y(), m_src_w(), m_src_h(),
+                    m_dst_x(), m_dst_y(), m_dst_w(), m_dst_h() {}
+
+    void SetBuffer(ImageBuffer &buf) { m_buffer = &buf; }
+    ImageBuffer *GetBuffer() { return m_buffer; }
+
+    // New sprites are at (0, 0) and use the whole image buffer.
+    void Resize(int count);
+    int GetSize() { return (int)m_x.size(); }
+
+    void SetSrcRect(int i, const uiRect &rect)
+    {
+        m_src_x[i] = rect.X;
+        m_src_y[i] = rect.Y;
+        m_src_w[i] = rect.Width;
+        m_src_h[i] = rect.Height;
+    }
+    void SetPosition(int i, float x, float y) { m_x[i] = x; m_y[i] = y; }
+    void SetCenter(int i, float cx, float cy) { m_cx[i] = cx; m_cy[i] = cy; }
+    void SetScale(int i, float sx, float sy) { m_sx[i] = sx; m_sy[i] = sy; }
+    void SetAngle(int i, float rad) { m_rad[i] = rad; }
+
+    // Raw arrays for custom batch updates
+    float *GetXs() { return m_x.data(); }
+    float *GetYs() { return m_y.data(); }
+    float *GetAngles() { return m_rad.data(); }
+
+    uiRect GetSrcRect(int i) { return { m_src_x[i], m_src_y[i], m_src_w[i], m_src_h[i] }; }
+    uiRect GetDstRect(int i) { return { m_dst_x[i], m_dst_y[i], m_dst_w[i], m_dst_h[i] }; }
+
+    // Batch updates for sprites in [begin, end)
+    void SetScales(int begin, int end, float sx, float sy);
+
+    // Computes dst rects like Sprite::GetDstRect(). Call it after updates.
+    void UpdateDstRects(int begin, int end);
+
+    // Draws sprites in [begin, end) with the dst rects.
+    // Unrotated sprites skip the matrix stack when axis_aligned is true.
+    void Draw(uiDrawContext *c, int begin, int end, int fast, int axis_aligned = 1);
+    void Draw(SoftRenderer &r, int begin, int end, int fast, int axis_aligned = 1);
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <stddef.h>
+#include <vector>
+#include "ui.h"
+#include "sprite.hpp"
+#include "image_buffer.hpp"
+#include "soft_renderer.hpp"
+
+// Sprites that are rendered once into an offscreen image buffer and drawn as one blit,
+// e.g. static scenery or HUD panels.
+// The buffer covers the bounds of the members, and it's rendered again only after MarkDirty().
+// Members are rasterized with SoftRenderer, so their buffers need CPU pixels
+// (headless buffers or ones with a CPU copy).
+class SpriteGroup {
+ private:
+    std::vector<Sprite *> m_members;  // in draw order
+    ImageBuffer m_buffer;
+    SoftRenderer m_canvas;
+    uiRect m_bounds;  // area of the buffer in uiArea
+    int m_dirty;
+    int m_fast;  // sampling of the last render
+    long long m_renders;
+    double m_render_ms;  // time of the last render
+
+ public:
+    SpriteGroup() : m_members(), m_buffer(), m_canvas(), m_bounds({ 0, 0, 0, 0 }),
+                    m_dirty(1), m_fast(0), m_renders(0), m_render_ms(0) {}
+
+    // Members are not copied. They should stay alive until Clear().
+    void Add(Sprite &sprite)
+    {
+        m_members.push_back(&sprite);
+        m_dirty = 1;
+    }
+
+    void Clear();
+
+    int GetSize() { return (int)m_members.size(); }
+
+    // Call it after changing members
+    void MarkDirty() { m_dirty = 1; }
+    int IsDirty() { return m_dirty; }
+
+    // Renders the members into the buffer when the group is dirty or the sampling changed.
+    // c can be NULL for headless buffers.
+    void Update(uiDrawContext *c, int fast);
+
+    // Draws the buffer as a 1:1 blit
+    void Draw(uiDrawContext *c);
+    void Draw(SoftRenderer &r);
+
+    uiRect GetBounds() { return m_bounds; }
+    size_t GetBytes() { return (size_t)m_bounds.Width * m_bounds.Height * 4; }
+    long long GetRenders() { return m_renders; }
+    double GetRenderTime() { return m_render_ms; }
+};
@@ -0,0 +1,29 @@
+#pragma once
+#include "ui.h"
+#include "image_buffer.hpp"
+#include "soft_renderer.hpp"
+
+// A sprite in a batch of draws from one image buffer.
+// Scale is in the dst rect, and the rect rotates by rad around (x, y).
+#ifdef UI_IMAGE_BUFFER_EXT
+// The same struct as libui takes, so batches are passed as is.
+typedef uiImageBufferInstance SpriteInstance;
+#else
+struct SpriteInstance {
+    uiRect src;
+    uiRect dst;
+    double x, y;
+    double rad;
+};
+#endif
+
+// Draws count instances of buf in order.
+// With image_buffer_ext, untiled buffers are drawn with a single uiImageBufferDrawInstances call,
+// which sets up the source of the buffer once for the batch.
+// Otherwise (and for tiled buffers), each instance and each tile is still one uiImageBufferDraw
+// or uiImageBufferDrawFast call. Only the matrix stack work is reduced: one uiDrawSave and uiDrawRestore
+// wrap the batch, and a rotation change is a single uiDrawTransform that undoes the previous rotation.
+void DrawImageInstances(uiDrawContext *c, ImageBuffer &buf, const SpriteInstance *list, int count, int fast);
+
+// Software version for headless buffers. The result is the same as drawing the sprites one by one.
+void DrawImageInstances(SoftRenderer &r, ImageBuffer &buf, const SpriteInstance *list, int count, int fast);
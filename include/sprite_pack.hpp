@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+#include "atlas_packer.hpp"
+
+// Binary pack of pre-decoded atlas pages.
+// Pixels are premultiplied RGBA, so they can be uploaded without decoding.
+//
+// Layout (little-endian)
+//   SpritePackHeader
+//   SpritePackPage[page_count]
+//   SpritePackImage[image_count]
+//   pixels of each page at its offset (aligned to SPRITE_PACK_ALIGNMENT)
+// Rows are stride bytes apart. Packs made by atlas_tool use width * 4,
+// so a page is a single block that uiImageBufferUpdate can take as it is.
+
+const char SPRITE_PACK_MAGIC[4] = { 'S', 'P', 'K', '1' };
+const uint32_t SPRITE_PACK_VERSION = 1;
+const uint64_t SPRITE_PACK_ALIGNMENT = 4096;  // a page of virtual memory
+
+struct SpritePackHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t page_count;
+    uint32_t image_count;
+};
+
+struct SpritePackPage {
+    uint32_t width;
+    uint32_t height;
+    uint32_t stride;  // bytes per row
+    uint32_t reserved;
+    uint64_t offset;  // from the start of the file
+};
+
+struct SpritePackImage {
+    char name[64];  // null-terminated file name of the source image
+    int32_t page;
+    int32_t x, y;
+    int32_t width, height;
+    int32_t reserved;
+};
+
+// Writes pages (premultiplied RGBA, width * 4 bytes per row) and a rect table.
+// The page file names of the table are not used.
+int SaveSpritePack(const char *file_name, const AtlasTable &table,
+                   const std::vector<const unsigned char *> &pages);
+
+// Read-only view of a sprite pack mapped into memory.
+// Pixels stay in the mapped pages, so there is no heap copy.
+class SpritePack {
+ private:
+    const unsigned char *m_data;
+    size_t m_size;
+#ifdef _WIN32
+    void *m_file;
+    void *m_mapping;
+#endif
+    const SpritePackHeader *m_header;
+    const SpritePackPage *m_pages;
+    const SpritePackImage *m_images;
+
+ public:
+    SpritePack() : m_data(NULL), m_size(0),
+#ifdef _WIN32
+                   m_file(NULL), m_mapping(NULL),
+#endif
+                   m_header(NULL), m_pages(NULL), m_images(NULL) {}
+    ~SpritePack() { Close(); }
+
+    // Maps the file and validates the index. Returns 1 on failure.
+    int Open(const char *file_name);
+    void Close();
+
+    int GetPageCount() { return m_header ? (int)m_header->page_count : 0; }
+
+    // Returns the mapped pixels of a page
+    const unsigned char *GetPagePixels(int page, int *width, int *height, int *stride);
+
+    // Looks up an image by its file name. Returns 1 when not found.
+    int FindImage(const std::string &name, AtlasRect *rect);
+
+    // size of the mapped file
+    size_t GetSize() { return m_size; }
+};
@@ -0,0 +1,210 @@
+#pragma once
+#include <string.h>
+#include <string>
+#include <vector>
+#include "ui.h"
+#include "sprite.hpp"
+#include "png_reader.hpp"
+#include "atlas_packer.hpp"
+#include "decode_pool.hpp"
+#include "sprite_pack.hpp"
+#include "env_utils.hpp"  // GetDirectory(), GetFileName()
+
+// Sprite images packed into a few large image buffers.
+// Sprites share the buffers and draw sub-rects of them.
+class TextureAtlas {
+ private:
+    std::vector<ImageBuffer> m_pages;
+    std::vector<AtlasRect> m_rects;
+    SpritePack m_pack;  // stays mapped after LoadFromPack() for GetPixels()
+    std::string m_error_msg;
+
+    int Fail(const std::string &msg)
+    {
+        m_error_msg = msg;
+        Clear();
+        return 1;
+    }
+
+ public:
+    TextureAtlas() : m_pages(), m_rects(), m_pack(), m_error_msg() {}
+
+    void Clear()
+    {
+        m_pages.clear();
+        m_rects.clear();
+        m_pack.Close();
+    }
+
+    int GetPageCount() { return (int)m_pages.size(); }
+
+    ImageBuffer &GetPage(int page) { return m_pages[page]; }
+
+    uiRect GetRect(int image_id)
+    {
+        AtlasRect &r = m_rects[image_id];
+        return { r.x, r.y, r.width, r.height };
+    }
+
+    ImageBuffer &GetBuffer(int image_id) { return m_pages[m_rects[image_id].page]; }
+
+    const char *GetErrorMsg() { return m_error_msg.c_str(); }
+
+    // Returns the pixels of an image in the mapped sprite pack or in the CPU copy of its page.
+    // stride gets bytes per row. Returns NULL after FreeCpuCopies() unless the atlas is from a pack.
+    const unsigned char *GetPixels(int image_id, int *stride)
+    {
+        AtlasRect &r = m_rects[image_id];
+        const unsigned char *pixels;
+        if (m_pack.GetPageCount() > 0) {
+            int width, height;
+            pixels = m_pack.GetPagePixels(r.page, &width, &height, stride);
+        } else {
+            int width, height;
+            m_pages[r.page].GetSize(&width, &height);
+            pixels = m_pages[r.page].GetPixels();
+            *stride = width * 4;
+        }
+        if (!pixels) return NULL;
+        return pixels + (size_t)r.y * *stride + (size_t)r.x * 4;
+    }
+
+    // Frees the CPU copies of pages once GetPixels() is no longer needed.
+    void FreeCpuCopies()
+    {
+        for (ImageBuffer &page : m_pages)
+            page.FreeCpuCopy();
+    }
+
+    // Binds an image in the atlas to a sprite
+    void Assign(Sprite &sprite, int image_id)
+    {
+        sprite.SetBuffer(GetBuffer(image_id));
+        sprite.SetSrcRect(GetRect(image_id));
+    }
+
+    // Loads PNG files and packs them at runtime.
+    // Image ids are the indices of the files.
+    // Files are decoded in parallel, and only uploads run on the calling thread.
+    // Pages keep their CPU copies until FreeCpuCopies().
+    int Build(uiDrawContext *c, const char *const *files, int count, int page_size)
+    {
+        Clear();
+
+        // decode images on worker threads
+        std::vector<PngReader> readers;
+        int failed_index;
+        DecodePool pool;
+        if (pool.DecodeAll(files, count, &readers, &failed_index))
+            return Fail(std::string("File not found. (") + files[failed_index] + ")");
+
+        std::vector<int> widths(count);
+        std::vector<int> heights(count);
+        for (int i = 0; i < count; i++)
+            readers[i].GetSize(&widths[i], &heights[i]);
+
+        std::vector<int> page_widths, page_heights;
+        if (PackAtlas(widths, heights, page_size, 1, &m_rects, &page_widths, &page_heights))
+            return Fail("Failed to pack images into the atlas.");
+
+        // blit images into the CPU copies of the pages (kept for ComposeLayers())
+        m_pages.resize(page_widths.size());
+        for (size_t p = 0; p < m_pages.size(); p++) {
+            int stride;
+            m_pages[p].Create(c, page_widths[p], page_heights[p], 1, 1);
+            unsigned char *pixels = m_pages[p].Lock(&stride);
+            memset(pixels, 0, (size_t)stride * page_heights[p]);
+        }
+        for (int i = 0; i < count; i++) {
+            AtlasRect &r = m_rects[i];
+            int stride;
+            BlitToPage(m_pages[r.page].Lock(&stride), page_widths[r.page], readers[i].GetData(), r);
+        }
+        for (ImageBuffer &page : m_pages)
+            page.Unlock();
+        return 0;
+    }
+
+    // Loads a sprite pack made by atlas_tool -p.
+    // Pages are uploaded straight from the mapped file. There is no decoding or heap copy.
+    // The file stays mapped until Clear(), so GetPixels() reads the mapped pages.
+    // Images are looked up by the file names of files.
+    int LoadFromPack(uiDrawContext *c, const char *pack_file, const char *const *files, int count)
+    {
+        Clear();
+        if (m_pack.Open(pack_file))
+            return Fail(std::string("Failed to open sprite pack. (") + pack_file + ")");
+
+        m_rects.resize(count);
+        for (int i = 0; i < count; i++) {
+            std::string name = GetFileName(files[i]);
+            if (m_pack.FindImage(name, &m_rects[i]))
+                return Fail("Image not found in the sprite pack. (" + name + ")");
+        }
+
+        m_pages.resize(m_pack.GetPageCount());
+        for (size_t p = 0; p < m_pages.size(); p++) {
+            int width, height, stride;
+            const unsigned char *pixels = m_pack.GetPagePixels((int)p, &width, &height, &stride);
+            m_pages[p].Create(c, width, height, 1);
+            if (stride == width * 4) {
+                m_pages[p].Update(pixels);
+                continue;
+            }
+            // padded rows need a copy as uiImageBufferUpdate takes packed rows
+            int dst_stride;
+            unsigned char *dst = m_pages[p].Lock(&dst_stride);
+            for (int y = 0; y < height; y++)
+                memcpy(dst + (size_t)y * dst_stride, pixels + (size_t)y * stride, (size_t)width * 4);
+            m_pages[p].Unlock();
+            m_pages[p].FreeCpuCopy();
+        }
+        return 0;
+    }
+
+    // Loads an atlas made by atlas_tool.
+    // Images are looked up by the file names of files.
+    // Pages keep their CPU copies until FreeCpuCopies().
+    int LoadFromTable(uiDrawContext *c, const char *table_file, const char *const *files, int count)
+    {
+        Clear();
+        AtlasTable table;
+        if (LoadAtlasTable(table_file, &table))
+            return Fail(std::string("Failed to read atlas table. (") + table_file + ")");
+
+        m_rects.resize(count);
+        for (int i = 0; i < count; i++) {
+            std::string name = GetFileName(files[i]);
+            size_t j = 0;
+            while (j < table.names.size() && table.names[j] != name) j++;
+            if (j == table.names.size())
+                return Fail("Image not found in the atlas. (" + name + ")");
+            m_rects[i] = table.rects[j];
+        }
+
+        std::string dir = GetDirectory(table_file);
+        std::vector<std::string> paths;
+        for (const std::string &page_file : table.page_files)
+            paths.push_back(dir.empty() ? page_file : dir + "/" + page_file);
+        std::vector<const char *> path_ptrs;
+        for (const std::string &path : paths)
+            path_ptrs.push_back(path.c_str());
+
+        std::vector<PngReader> readers;
+        int failed_index;
+        DecodePool pool;
+        if (pool.DecodeAll(path_ptrs.data(), (int)path_ptrs.size(), &readers, &failed_index))
+            return Fail("File not found. (" + paths[failed_index] + ")");
+
+        m_pages.resize(readers.size());
+        for (size_t p = 0; p < m_pages.size(); p++) {
+            int width, height;
+            readers[p].GetSize(&width, &height);
+            if (width != table.page_widths[p] || height != table.page_heights[p])
+                return Fail("Atlas page size mismatch. (" + paths[p] + ")");
+            m_pages[p].Create(c, width, height, 1, 1);  // kept for ComposeLayers()
+            m_pages[p].Update(readers[p].GetData());
+        }
+        return 0;
+    }
+};
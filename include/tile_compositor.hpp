@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include "ui.h"
+#include "sprite.hpp"
+#include "soft_renderer.hpp"
+#include "image_buffer.hpp"
+#include "work_stealing_pool.hpp"
+
+// Rasterizes sprites on worker threads and presents the frame as a single image buffer.
+// The area is split into square screen tiles, and each sprite is binned into the tiles its bounds overlap.
+// A tile is rendered by one worker with SoftRenderer clipped to the tile, in the order of Add(),
+// so the frame is the same as drawing all sprites in order on one thread.
+// Sprites should use headless buffers (created without a draw context).
+class TileCompositor {
+ private:
+    struct Tile {
+        uiRect rect;
+        std::vector<int> sprites;  // indices in m_sprites, in draw order
+    };
+
+    std::vector<Sprite> m_sprites;  // copies for the current frame
+    std::vector<Tile> m_tiles;  // row-major
+    std::vector<int> m_active;  // tiles under the clip rect
+    std::vector<std::unique_ptr<SoftRenderer>> m_renderers;  // one for each worker
+    WorkStealingPool m_pool;
+    SoftRenderer *m_target;
+    ImageBuffer m_output;
+    int m_tile_size;
+    int m_cols;
+    int m_rows;
+    int m_width;
+    int m_height;
+    uiRect m_clip;
+    uint32_t m_background;
+    long long m_bin_entries;  // sprite-tile pairs in the current frame
+
+ public:
+    // 0 means the number of hardware threads
+    explicit TileCompositor(int thread_num = 0, int tile_size = 128);
+
+    void SetThreadNum(int thread_num) { m_pool.SetThreadNum(thread_num); }
+    int GetThreadNum() { return m_pool.GetThreadNum(); }
+
+    // Smaller tiles balance the workers better, but sprites are binned into more tiles.
+    void SetTileSize(int tile_size);
+    int GetTileSize() { return m_tile_size; }
+
+    // Starts a frame on the target. Only tiles under clip are rendered,
+    // and they are filled with the background color (0xRRGGBB) first.
+    void Begin(SoftRenderer &target, const uiRect &clip, uint32_t background);
+
+    // Copies the sprite and bins it. Sprites are drawn in the order of Add().
+    // The copy doesn't use the rotation cache, which is not thread-safe.
+    void Add(const Sprite &sprite);
+
+    // Renders the tiles into the target. Call it after adding all sprites.
+    void Render(int fast);
+
+    // Draws the clip rect of the target with one uiImageBufferUpdate and one uiImageBufferDraw call
+    void Present(uiDrawContext *c);
+
+    int GetSpriteCount() { return (int)m_sprites.size(); }
+    int GetTileCount() { return (int)m_active.size(); }
+    long long GetBinEntries() { return m_bin_entries; }
+    long long GetSteals() { return m_pool.GetSteals(); }
+};
@@ -0,0 +1,108 @@
+#pragma once
+#include <stddef.h>
+#include <list>
+#include <vector>
+#include <memory>
+#include <chrono>
+#include "ui.h"
+#include "image_buffer.hpp"
+#include "compact_image.hpp"
+
+// Keeps only tiles of large images near the view uploaded.
+// Images are split into tiled ImageBuffers, and their pixels stay in CPU memory
+// in a compact layout (CompactImage) that is expanded to RGBA for each upload.
+// A tile is uploaded when a draw needs it (a miss) or when it's prefetched,
+// and least recently used tiles are freed when resident tiles exceed the byte budget.
+// Call Request() and Prefetch() for each frame, then Update() before drawing.
+class TileResidency {
+ private:
+    struct Tile {
+        int image;
+        int col, row;
+        int resident;
+        long long last_used;  // frame of the last Request() or Prefetch()
+        long long last_drawn;  // frame of the last Request()
+        std::list<Tile *>::iterator lru;  // position in m_lru when resident
+    };
+
+    struct Image {
+        CompactImage pixels;  // CPU copy of the whole image
+        int width, height;
+        ImageBuffer buffer;  // tiled
+        std::vector<Tile> tiles;
+    };
+
+    std::vector<std::unique_ptr<Image>> m_images;
+    std::list<Tile *> m_lru;  // resident tiles, most recently used first
+    std::vector<Tile *> m_requested;  // tiles requested in the current frame
+    std::vector<Tile *> m_prefetch;  // tiles prefetched in the current frame
+    std::vector<unsigned char> m_staging;  // packed rows of a tile for uploads
+    int m_tile_size;
+    size_t m_budget;
+    int m_max_prefetch;  // uploads by Prefetch() per frame
+    long long m_frame;
+
+    size_t m_resident_bytes;
+    long long m_uploads;
+    long long m_misses;
+    long long m_prefetches;
+    long long m_evictions;
+    std::chrono::steady_clock::time_point m_rate_start;
+    long long m_rate_uploads;  // uploads at m_rate_start
+    double m_upload_rate;
+
+    size_t GetTileBytes(Tile *tile);
+    void Touch(Tile *tile);
+    void Upload(uiDrawContext *c, Tile *tile);
+    void Evict(Tile *tile);
+
+    // Marks tiles under src with f(tile)
+    template <class Func>
+    void ForEachTileIn(int image, const uiRect &src, Func func);
+
+ public:
+    explicit TileResidency(int tile_size = 128, size_t budget = 16 * 1024 * 1024);
+
+    // Call it before AddImage()
+    void SetTileSize(int tile_size) { m_tile_size = tile_size; }
+    int GetTileSize() { return m_tile_size; }
+
+    void SetBudget(size_t budget) { m_budget = budget; }
+    size_t GetBudget() { return m_budget; }
+
+    void SetMaxPrefetch(int max_prefetch) { m_max_prefetch = max_prefetch; }
+
+    // Copies pixels (stride bytes per row) and returns the image id. No tiles are uploaded yet.
+    int AddImage(const unsigned char *pixels, int width, int height, int stride, int has_alpha);
+
+    // Takes over pixels, e.g. from CompactImage::LoadFromPng(), and returns the image id.
+    int AddImage(CompactImage &&pixels);
+
+    // Frees all images and tiles
+    void Clear();
+
+    // Tiled buffer for sprites. Draws skip tiles that are not resident.
+    ImageBuffer &GetBuffer(int image) { return m_images[image]->buffer; }
+
+    // Tiles under src will be drawn in the current frame.
+    void Request(int image, const uiRect &src);
+
+    // Tiles under src will be drawn soon. They are uploaded only when they fit in the budget.
+    void Prefetch(int image, const uiRect &src);
+
+    // Uploads missing tiles and prefetched tiles, then evicts least recently used tiles
+    // until the budget is met. Tiles requested in this frame are never evicted.
+    // c can be NULL for headless buffers.
+    void Update(uiDrawContext *c);
+
+    size_t GetResidentBytes() { return m_resident_bytes; }
+    size_t GetCpuBytes();  // pixels of all images in CPU memory
+    int GetResidentTiles() { return (int)m_lru.size(); }
+    long long GetUploads() { return m_uploads; }
+    long long GetMisses() { return m_misses; }
+    long long GetPrefetches() { return m_prefetches; }
+    long long GetEvictions() { return m_evictions; }
+
+    // uploads per second over the last second or so
+    double GetUploadRate() { return m_upload_rate; }
+};
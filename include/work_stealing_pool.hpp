@@ -0,0 +1,63 @@
+#pragma once
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <functional>
+#include <condition_variable>
+
+// Persistent worker threads that run indexed tasks.
+// Tasks are dealt to workers in contiguous blocks. Each worker takes tasks from the front of its own queue
+// and steals from the back of other queues when its queue runs dry, so uneven tasks still keep all workers busy.
+// The calling thread works as worker 0.
+class WorkStealingPool {
+ private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+
+    std::vector<std::thread> m_threads;
+    std::vector<std::unique_ptr<Queue>> m_queues;  // one for each worker
+    std::function<void(int, int)> m_func;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    unsigned int m_generation;  // incremented for each Run()
+    int m_busy;  // threads that have not finished the current Run()
+    int m_quit;
+    int m_thread_num;
+    std::atomic<long long> m_steals;
+
+    void StartThreads();
+    void StopThreads();
+    // generation is m_generation when the thread starts. The worker waits for the next Run().
+    void WorkerMain(int worker, unsigned int generation);
+
+    // Runs tasks until all queues are empty
+    void Work(int worker);
+
+    // Takes a task from the own queue or steals one. Returns 0 when no tasks are left.
+    int Pop(int worker, int *task);
+
+ public:
+    // 0 means the number of hardware threads
+    explicit WorkStealingPool(int thread_num = 0);
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool &) = delete;
+    WorkStealingPool &operator=(const WorkStealingPool &) = delete;
+
+    // Restarts the threads. 0 means the number of hardware threads.
+    void SetThreadNum(int thread_num);
+    int GetThreadNum() { return m_thread_num; }
+
+    // Calls func(task, worker) for each task in [0, count) and waits for all of them.
+    // worker is in [0, GetThreadNum()), and a worker runs one task at a time.
+    void Run(int count, const std::function<void(int task, int worker)> &func);
+
+    // tasks taken from queues of other workers
+    long long GetSteals() { return m_steals; }
+};
@@ -0,0 +1,86 @@
+#include <chrono>
+#include <algorithm>
+#include "async_loader.hpp"
+
+void AsyncLoader::Work()
+{
+    int count = (int)m_files.size();
+    for (int i = m_next++; i < count && !m_cancel; i = m_next++) {
+        Decoded decoded;
+        decoded.id = i;
+        decoded.ret = m_decoder.Decode(m_files[i].c_str(), &decoded.png);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(std::move(decoded));
+        }
+        m_decoded_num++;
+    }
+}
+
+void AsyncLoader::Start(const char *const *files, int count, int thread_num)
+{
+    Stop();
+    m_files.assign(files, files + count);
+    m_queue.clear();
+    m_next = 0;
+    m_decoded_num = 0;
+    m_cancel = false;
+    m_uploaded_num = 0;
+    m_error_msg.clear();
+
+    if (thread_num <= 0)
+        thread_num = std::max((int)std::thread::hardware_concurrency(), 1);
+    thread_num = std::min(thread_num, count);
+    for (int i = 0; i < thread_num; i++)
+        m_threads.push_back(std::thread(&AsyncLoader::Work, this));
+}
+
+void AsyncLoader::Stop()
+{
+    m_cancel = true;
+    for (std::thread &t : m_threads)
+        t.join();
+    m_threads.clear();
+}
+
+int AsyncLoader::Upload(uiDrawContext *c, std::vector<ImageBuffer> &buffers,
+                        double budget_ms, std::vector<int> *uploaded_ids)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double elapsed_ms = 0;
+    int ret = 0;
+    do {
+        Decoded decoded;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_queue.empty()) break;
+            decoded = std::move(m_queue.front());
+            m_queue.pop_front();
+        }
+
+        if (decoded.ret) {
+            m_error_msg = "File not found. (" + m_files[decoded.id] + ")";
+            ret = 1;
+            break;
+        }
+
+        // libui buffers give the pixels back to the decoder right after the upload
+        DecodedPng &png = decoded.png;
+        buffers[decoded.id].Adopt(c, png.width, png.height, png.has_alpha, std::move(png.pixels));
+        uploaded_ids->push_back(decoded.id);
+        m_uploaded_num++;
+
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        elapsed_ms = elapsed.count();
+    } while (elapsed_ms < budget_ms);
+
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    m_last_upload_ms = elapsed.count();
+    return ret;
+}
+
+int AsyncLoader::GetQueueDepth()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (int)m_queue.size();
+}
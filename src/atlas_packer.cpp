@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "atlas_packer.hpp"
+
+void SkylinePacker::Reset(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    m_used_height = 0;
+    m_skyline.clear();
+    m_skyline.push_back({ 0, 0, width });
+}
+
+// Returns the lowest y to put the rect at the node, or -1 if it doesn't fit.
+int SkylinePacker::Fit(size_t index, int width, int height)
+{
+    int x = m_skyline[index].x;
+    if (x + width > m_width) return -1;
+
+    int y = m_skyline[index].y;
+    int width_left = width;
+    while (width_left > 0) {
+        y = std::max(y, m_skyline[index].y);
+        if (y + height > m_height) return -1;
+        width_left -= m_skyline[index].width;
+        index++;
+    }
+    return y;
+}
+
+void SkylinePacker::AddNode(size_t index, int x, int y, int width)
+{
+    m_skyline.insert(m_skyline.begin() + index, { x, y, width });
+
+    // shrink or remove nodes under the new one
+    for (size_t i = index + 1; i < m_skyline.size(); i++) {
+        Node &prev = m_skyline[i - 1];
+        Node &node = m_skyline[i];
+        if (node.x >= prev.x + prev.width) break;
+        int shrink = prev.x + prev.width - node.x;
+        node.x += shrink;
+        node.width -= shrink;
+        if (node.width > 0) break;
+        m_skyline.erase(m_skyline.begin() + i);
+        i--;
+    }
+
+    // merge nodes at the same level
+    for (size_t i = 0; i + 1 < m_skyline.size(); i++) {
+        if (m_skyline[i].y == m_skyline[i + 1].y) {
+            m_skyline[i].width += m_skyline[i + 1].width;
+            m_skyline.erase(m_skyline.begin() + i + 1);
+            i--;
+        }
+    }
+}
+
+int SkylinePacker::Insert(int width, int height, int *x, int *y)
+{
+    int best_bottom = m_height + 1;
+    int best_width = m_width + 1;
+    size_t best_index = 0;
+    int best_y = -1;
+
+    for (size_t i = 0; i < m_skyline.size(); i++) {
+        int fit_y = Fit(i, width, height);
+        if (fit_y < 0) continue;
+        int bottom = fit_y + height;
+        if (bottom < best_bottom ||
+            (bottom == best_bottom && m_skyline[i].width < best_width)) {
+            best_bottom = bottom;
+            best_width = m_skyline[i].width;
+            best_index = i;
+            best_y = fit_y;
+        }
+    }
+    if (best_y < 0) return 1;
+
+    *x = m_skyline[best_index].x;
+    *y = best_y;
+    AddNode(best_index, *x, best_y + height, width);
+    m_used_height = std::max(m_used_height, best_y + height);
+    return 0;
+}
+
+int PackAtlas(const std::vector<int> &widths, const std::vector<int> &heights,
+              int page_size, int padding,
+              std::vector<AtlasRect> *rects,
+              std::vector<int> *page_widths, std::vector<int> *page_heights)
+{
+    size_t count = widths.size();
+    rects->assign(count, { 0, 0, 0, 0, 0 });
+    page_widths->clear();
+    page_heights->clear();
+
+    // tall images first
+    std::vector<size_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = i;
+        if (widths[i] + padding * 2 > page_size || heights[i] + padding * 2 > page_size)
+            return 1;
+    }
+    std::stable_sort(order.begin(), order.end(), [&heights](size_t a, size_t b) {
+        return heights[a] > heights[b];
+    });
+
+    std::vector<SkylinePacker> packers;
+    std::vector<int> used_widths;
+    for (size_t id : order) {
+        int w = widths[id] + padding * 2;
+        int h = heights[id] + padding * 2;
+        int x = 0, y = 0;
+        size_t page = 0;
+        for (; page < packers.size(); page++) {
+            if (!packers[page].Insert(w, h, &x, &y)) break;
+        }
+        if (page == packers.size()) {
+            packers.push_back(SkylinePacker());
+            packers.back().Reset(page_size, page_size);
+            used_widths.push_back(0);
+            packers.back().Insert(w, h, &x, &y);
+        }
+        used_widths[page] = std::max(used_widths[page], x + w);
+        (*rects)[id] = { (int)page, x + padding, y + padding, widths[id], heights[id] };
+    }
+
+    for (size_t i = 0; i < packers.size(); i++) {
+        page_widths->push_back(used_widths[i]);
+        page_heights->push_back(packers[i].GetUsedHeight());
+    }
+    return 0;
+}
+
+void BlitToPage(unsigned char *page, int page_width,
+                const unsigned char *image, const AtlasRect &rect)
+{
+    size_t row_size = (size_t)rect.width * 4;
+    for (int y = 0; y < rect.height; y++) {
+        memcpy(page + ((size_t)(rect.y + y) * page_width + rect.x) * 4,
+               image + y * row_size, row_size);
+    }
+}
+
+int SaveAtlasTable(const char *file_name, const AtlasTable &table)
+{
+    FILE *file = fopen(file_name, "w");
+    if (!file) return 1;
+
+    for (size_t i = 0; i < table.page_files.size(); i++) {
+        fprintf(file, "page %s %d %d\n", table.page_files[i].c_str(),
+                table.page_widths[i], table.page_heights[i]);
+    }
+    for (size_t i = 0; i < table.names.size(); i++) {
+        const AtlasRect &r = table.rects[i];
+        fprintf(file, "rect %s %d %d %d %d %d\n", table.names[i].c_str(),
+                r.page, r.x, r.y, r.width, r.height);
+    }
+
+    fclose(file);
+    return 0;
+}
+
+int LoadAtlasTable(const char *file_name, AtlasTable *table)
+{
+    FILE *file = fopen(file_name, "r");
+    if (!file) return 1;
+
+    *table = AtlasTable();
+    char type[16];
+    char name[512];
+    int ret = 0;
+    while (fscanf(file, "%15s %511s", type, name) == 2) {
+        if (strcmp(type, "page") == 0) {
+            int width, height;
+            if (fscanf(file, "%d %d", &width, &height) != 2) {
+                ret = 1;
+                break;
+            }
+            table->page_files.push_back(name);
+            table->page_widths.push_back(width);
+            table->page_heights.push_back(height);
+        } else if (strcmp(type, "rect") == 0) {
+            AtlasRect r;
+            if (fscanf(file, "%d %d %d %d %d", &r.page, &r.x, &r.y, &r.width, &r.height) != 5) {
+                ret = 1;
+                break;
+            }
+            table->names.push_back(name);
+            table->rects.push_back(r);
+        } else {
+            ret = 1;
+            break;
+        }
+    }
+
+    fclose(file);
+
+    // check page indices
+    for (const AtlasRect &r : table->rects) {
+        if (r.page < 0 || r.page >= (int)table->page_files.size()) ret = 1;
+    }
+    return ret;
+}
@@ -0,0 +1,138 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "spng.h"
+#include "png_reader.hpp"
+#include "atlas_packer.hpp"
+#include "sprite_pack.hpp"
+#include "pixel_convert.hpp"
+#include "env_utils.hpp"  // GetFileName()
+
+// Packs PNG files into a single atlas page and writes a rect table for it.
+// -p writes the page as a sprite pack of premultiplied pixels instead. (see sprite_pack.hpp)
+// usage: atlas_tool [-o <atlas.png> -t <atlas.txt>] [-p <sprites.spk>] [-s <page size>] <png files...>
+
+static int WritePng(const char *file_name, const unsigned char *rgba, int width, int height)
+{
+    spng_ctx *ctx = spng_ctx_new(SPNG_CTX_ENCODER);
+    if (!ctx) return 1;
+
+    spng_set_option(ctx, SPNG_ENCODE_TO_BUFFER, 1);
+
+    struct spng_ihdr ihdr;
+    memset(&ihdr, 0, sizeof(ihdr));
+    ihdr.width = width;
+    ihdr.height = height;
+    ihdr.bit_depth = 8;
+    ihdr.color_type = SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+    spng_set_ihdr(ctx, &ihdr);
+
+    size_t size = (size_t)width * height * 4;
+    int ret = spng_encode_image(ctx, rgba, size, SPNG_FMT_PNG, SPNG_ENCODE_FINALIZE);
+    if (ret) {
+        printf("spng_encode_image() error: %s\n", spng_strerror(ret));
+        spng_ctx_free(ctx);
+        return 1;
+    }
+
+    size_t png_size;
+    void *png_buf = spng_get_png_buffer(ctx, &png_size, &ret);
+    spng_ctx_free(ctx);
+    if (!png_buf) return 1;
+
+    FILE *file = fopen(file_name, "wb");
+    if (!file) {
+        free(png_buf);
+        return 1;
+    }
+    size_t written = fwrite(png_buf, 1, png_size, file);
+    fclose(file);
+    free(png_buf);
+    return written != png_size;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *out_png = NULL;
+    const char *out_table = NULL;
+    const char *out_pack = NULL;
+    int page_size = 2048;
+    std::vector<const char *> inputs;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            out_png = argv[++i];
+        else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+            out_table = argv[++i];
+        else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+            out_pack = argv[++i];
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+            page_size = atoi(argv[++i]);
+        else
+            inputs.push_back(argv[i]);
+    }
+    // -o and -t go together
+    int has_atlas = out_png && out_table;
+    if ((!has_atlas && !out_pack) || (!out_png != !out_table) || inputs.empty()) {
+        fprintf(stderr, "usage: atlas_tool [-o <atlas.png> -t <atlas.txt>] [-p <sprites.spk>] "
+                        "[-s <page size>] <png files...>\n");
+        return 1;
+    }
+
+    // keep straight alpha as PngReader premultiplies pages when loading them
+    size_t count = inputs.size();
+    std::vector<PngReader> readers(count);
+    std::vector<int> widths(count);
+    std::vector<int> heights(count);
+    for (size_t i = 0; i < count; i++) {
+        if (readers[i].ReadFromFile(inputs[i], 0)) {
+            fprintf(stderr, "Failed to read %s\n", inputs[i]);
+            return 1;
+        }
+        readers[i].GetSize(&widths[i], &heights[i]);
+    }
+
+    AtlasTable table;
+    if (PackAtlas(widths, heights, page_size, 1, &table.rects,
+                  &table.page_widths, &table.page_heights)) {
+        fprintf(stderr, "An image is larger than the page size (%d).\n", page_size);
+        return 1;
+    }
+    if (table.page_widths.size() != 1) {
+        fprintf(stderr, "Images don't fit in a %dx%d page.\n", page_size, page_size);
+        return 1;
+    }
+
+    int width = table.page_widths[0];
+    int height = table.page_heights[0];
+    std::vector<unsigned char> page((size_t)width * height * 4, 0);
+    for (size_t i = 0; i < count; i++) {
+        BlitToPage(page.data(), width, readers[i].GetData(), table.rects[i]);
+        table.names.push_back(GetFileName(inputs[i]));
+    }
+
+    if (out_png) {
+        table.page_files.push_back(GetFileName(out_png));
+        if (WritePng(out_png, page.data(), width, height)) {
+            fprintf(stderr, "Failed to write %s\n", out_png);
+            return 1;
+        }
+        if (SaveAtlasTable(out_table, table)) {
+            fprintf(stderr, "Failed to write %s\n", out_table);
+            return 1;
+        }
+    }
+    if (out_pack) {
+        // the same conversion as PngReader, so pixels match the PNG path
+        PremultiplyAlpha(page.data(), (size_t)width * height);
+        std::vector<const unsigned char *> pages = { page.data() };
+        if (SaveSpritePack(out_pack, table, pages)) {
+            fprintf(stderr, "Failed to write %s\n", out_pack);
+            return 1;
+        }
+    }
+    printf("packed %d images into %dx%d\n", (int)count, width, height);
+    return 0;
+}
@@ -1,32 +1,589 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <cmath>
 #include <vector>
-#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <utility>
 #include "ui.h"
 #include "sprite.hpp"
+#include "sprite_array.hpp"
+#include "rotation_cache.hpp"
+#include "soft_renderer.hpp"
+#include "damage_tracker.hpp"
+#include "spatial_grid.hpp"
+#include "tile_compositor.hpp"
+#include "sprite_group.hpp"
+#include "render_queue.hpp"
+#include "frame_profiler.hpp"
 #include "env_utils.hpp"  // GetExecutablePath(), SetCwd(), GetDirectory()
 
 // TODO clean up the dirty code
 
+const int MAX_SPRITES = 1048576;
+const int GRID_SPRITES = 14400;  // sprites on a 120x120 grid. more sprites are stacked on it.
+
 class SpriteHandler {
  private:
     std::vector<ImageBuffer> m_image_buffers;
     std::vector<Sprite> m_sprites;
+    SpriteArray m_sprite_array;  // the same sprites in SoA layout
+    int m_use_sprite_array;
+    RotationCache m_rotation_cache;
+    int m_use_rotation_cache;
+    int m_use_scaled_levels;
+    double m_level_build_ms;  // load-time cost of the scaled levels
+    int m_tile_size;  // streams the image into tiles when it's not 0
     std::string m_error_msg;
     PngReader m_png;
     int m_step;
-    clock_t m_start;
-    int m_start_step;
+    FrameProfiler m_profiler;
+    std::chrono::steady_clock::time_point m_start;  // for FPS
+    int m_frames;  // frames since m_start
+    int m_upload_num;  // how many times to update the image buffer per frame
+    int m_partial_rows;  // rows per upload with UpdateRect(). 0 means full updates.
+    int m_partial_y;  // the first row of the next partial update
+    long long m_upload_bytes;  // for the upload rate
+    double m_upload_sec;
+    int m_sprite_num;  // how many sprites to draw per frame
+    int m_fast;  // use DrawFast() or not
+    int m_rotated_percent;  // ratio of rotated sprites
+    int m_axis_aligned_path;  // skip the matrix stack for unrotated sprites
+    double m_scale;  // scale of sprites
+    int m_damage_tracking;  // redraw only dirty rects (SoftRenderer only)
+    DamageTracker m_damage;
+    std::vector<uiRect> m_bounds;  // sprite bounds of the current frame
+    long long m_dirty_area;  // sum of dirty pixels
+    long long m_dirty_rects;  // sum of dirty rects
+    int m_damage_frames;
+
+    // view culling (std::vector<Sprite> only)
+    int m_culling;
+    SpatialGrid m_grid;
+    std::vector<int> m_visible;  // ids of the last query
+    int m_view_width;
+    int m_view_height;
+    long long m_submitted;
+    long long m_culled;
+    int m_cull_frames;
+
+    // multi-threaded tile rendering (SoftRenderer only)
+    int m_use_compositor;
+    TileCompositor m_compositor;
+
+    // sprites rendered into an offscreen buffer (std::vector<Sprite> only)
+    int m_use_group;
+    SpriteGroup m_group;
+
+    // sprites that share an image buffer are drawn between one save and restore (std::vector<Sprite> only)
+    int m_use_instances;
+    std::vector<SpriteInstance> m_instances;
+    long long m_instance_batches;
+    int m_instance_frames;
+
+    // sprites drawn through RenderQueue (std::vector<Sprite> only)
+    int m_use_queue;
+    RenderQueue m_queue;
+    double m_sort_ms;  // sum of sort times
+    int m_queue_frames;
     uiSpinbox *m_spinbox_buffer;
+    uiSpinbox *m_spinbox_partial;
     uiSpinbox *m_spinbox_sprite;
     uiCheckbox *m_checkbox_fast;
+    uiSpinbox *m_spinbox_rotated;
+    uiCheckbox *m_checkbox_axis_aligned;
+    uiCheckbox *m_checkbox_sprite_array;
+    uiCheckbox *m_checkbox_rotation_cache;
+    uiCheckbox *m_checkbox_scaled_levels;
+    uiCheckbox *m_checkbox_culling;
+    uiCheckbox *m_checkbox_instances;
     uiLabel *m_label_fps;
 
+    static void OnBufferChanged(uiSpinbox *s, void *data)
+    {
+        ((SpriteHandler *)data)->m_upload_num = uiSpinboxValue(s);
+    }
+
+    static void OnPartialChanged(uiSpinbox *s, void *data)
+    {
+        ((SpriteHandler *)data)->m_partial_rows = uiSpinboxValue(s);
+    }
+
+    static void OnSpriteChanged(uiSpinbox *s, void *data)
+    {
+        ((SpriteHandler *)data)->m_sprite_num = uiSpinboxValue(s);
+    }
+
+    static void OnFastToggled(uiCheckbox *c, void *data)
+    {
+        ((SpriteHandler *)data)->m_fast = uiCheckboxChecked(c);
+    }
+
+    static void OnRotatedChanged(uiSpinbox *s, void *data)
+    {
+        ((SpriteHandler *)data)->m_rotated_percent = uiSpinboxValue(s);
+    }
+
+    static void OnAxisAlignedToggled(uiCheckbox *c, void *data)
+    {
+        ((SpriteHandler *)data)->m_axis_aligned_path = uiCheckboxChecked(c);
+    }
+
+    static void OnSpriteArrayToggled(uiCheckbox *c, void *data)
+    {
+        ((SpriteHandler *)data)->m_use_sprite_array = uiCheckboxChecked(c);
+    }
+
+    static void OnRotationCacheToggled(uiCheckbox *c, void *data)
+    {
+        ((SpriteHandler *)data)->SetUseRotationCache(uiCheckboxChecked(c));
+    }
+
+    static void OnCullingToggled(uiCheckbox *c, void *data)
+    {
+        ((SpriteHandler *)data)->SetCulling(uiCheckboxChecked(c));
+    }
+
+    static void OnInstancesToggled(uiCheckbox *c, void *data)
+    {
+        ((SpriteHandler *)data)->m_use_instances = uiCheckboxChecked(c);
+    }
+
+    static void OnScaledLevelsToggled(uiCheckbox *c, void *data)
+    {
+        // levels are built in the next HandlerDraw that has a draw context
+        ((SpriteHandler *)data)->m_use_scaled_levels = uiCheckboxChecked(c);
+    }
+
+    // UpdateRect(), RotationCache, and scaled levels need pixels in CPU memory
+    void KeepCpuCopy()
+    {
+        ImageBuffer& buf = m_image_buffers[0];
+        if (buf.GetPixels()) return;
+        buf.SetCpuCopy(m_png.GetData());
+    }
+
+    // The old loops draw (sprite num + 1) sprites
+    int GetDrawNum()
+    {
+        return std::min(m_sprite_num + 1, MAX_SPRITES);
+    }
+
+    // Creates sprites up to num in the current layout
+    void PrepareSprites(int num)
+    {
+        if (!HasImage()) return;
+        ImageBuffer& buf = m_image_buffers[0];
+        int width, height;
+        buf.GetSize(&width, &height);
+
+        if (m_use_sprite_array) {
+            int old_size = m_sprite_array.GetSize();
+            if (num <= old_size) return;
+            m_sprite_array.Resize(num);
+            for (int i = old_size; i < num; i++) {
+                int cell = i % GRID_SPRITES;
+                m_sprite_array.SetPosition(i, (float)(5 * (cell / 120)), (float)(5 * (cell % 120)));
+                m_sprite_array.SetCenter(i, (float)(width / 2), (float)(height / 2));
+            }
+            m_sprite_array.SetScales(old_size, num, (float)m_scale, (float)m_scale);
+            return;
+        }
+
+        int old_size = (int)m_sprites.size();
+        if (num <= old_size) return;
+        m_sprites.resize(num);
+        for (int i = old_size; i < num; i++) {
+            Sprite &sprite = m_sprites[i];
+            int cell = i % GRID_SPRITES;
+            sprite.SetBuffer(buf);
+            uiRect rect = buf.GetRect();
+            sprite.SetSrcRect(rect);
+            sprite.SetPosition(5 * (cell / 120), 5 * (cell % 120));
+            sprite.SetCenter(width / 2, height / 2);
+            sprite.SetScale(m_scale, m_scale);
+            sprite.SetRotationCache(m_use_rotation_cache ? &m_rotation_cache : NULL);
+        }
+    }
+
+    // Sets angles of sprites in [0, num)
+    // Rotated sprites are runs of m_rotated_percent in each block of 100.
+    // Both layouts fill angles run by run, so CompareLayouts measures only the layout.
+    void StepSprites(int num, double rad)
+    {
+        int rotated = std::min(std::max(m_rotated_percent, 0), 100);
+        float *angles = m_sprite_array.GetAngles();
+        for (int block = 0; block < num; block += 100) {
+            int mid = std::min(block + rotated, num);
+            int end = std::min(block + 100, num);
+            if (m_use_sprite_array) {
+                std::fill(angles + block, angles + mid, (float)rad);
+                std::fill(angles + mid, angles + end, 0.0f);
+                continue;
+            }
+            for (int i = block; i < mid; i++)
+                m_sprites[i].SetAngle(rad);
+            for (int i = mid; i < end; i++)
+                m_sprites[i].SetAngle(0.0);
+        }
+        if (m_use_sprite_array)
+            m_sprite_array.UpdateDstRects(0, num);
+    }
+
+    // Renders the sprites into the group again when they changed.
+    // c can be NULL for headless buffers.
+    void UpdateGroup(uiDrawContext *c)
+    {
+        int num = GetDrawNum();
+        if (m_group.GetSize() != num) {
+            m_group.Clear();
+            for (int i = 0; i < num; i++)
+                m_group.Add(m_sprites[i]);
+        }
+        m_group.Update(c, m_fast);
+    }
+
+    void DrawGroup(uiDrawContext *c)
+    {
+        UpdateGroup(c);
+        m_group.Draw(c);
+    }
+
+    void DrawGroup(SoftRenderer &r)
+    {
+        UpdateGroup(NULL);
+        m_group.Draw(r);
+    }
+
+    template <class Target>
+    void DrawSpritesTo(Target &&target)
+    {
+        if (HasError()) return;
+        if (m_use_sprite_array) {
+            m_sprite_array.Draw(target, 0, GetDrawNum(), m_fast, m_axis_aligned_path);
+            return;
+        }
+        if (m_use_group) {
+            DrawGroup(target);
+            return;
+        }
+        if (m_culling) {
+            DrawVisibleSprites(target);
+            return;
+        }
+        if (m_use_queue) {
+            DrawQueued(target);
+            return;
+        }
+        if (m_use_instances) {
+            m_instance_batches += DrawSpriteInstances(target, m_sprites.begin(), m_sprites.begin() + GetDrawNum(),
+                                                      m_fast, m_instances);
+            m_instance_frames++;
+            return;
+        }
+        std::vector<Sprite>::iterator end = m_sprites.begin() + GetDrawNum();
+        if (m_axis_aligned_path) {
+            DrawSpriteRange(target, m_sprites.begin(), end, m_fast);
+        } else {
+            for (std::vector<Sprite>::iterator it = m_sprites.begin(); it != end; ++it)
+                it->DrawRotated(target, m_fast);
+        }
+    }
+
+    // Submits the sprites to the queue in their order, so the frame is the same as direct draws.
+    // Keys are already sorted then, and Sort() only checks it. (--compare-sort sorts random keys)
+    template <class Target>
+    void DrawQueued(Target &&target)
+    {
+        int num = GetDrawNum();
+        m_queue.Clear();
+        for (int i = 0; i < num; i++)
+            m_queue.Submit(&m_sprites[i], 0, (unsigned)i);
+        m_queue.Sort();
+        m_sort_ms += m_queue.GetSortTime();
+        m_queue_frames++;
+        m_queue.Draw(target, m_fast);
+    }
+
+    template <class Target>
+    void DrawSprite(Target &&target, Sprite &sprite)
+    {
+        if (m_axis_aligned_path && !sprite.IsRotated())
+            sprite.DrawAxisAligned(target, m_fast);
+        else
+            sprite.DrawRotated(target, m_fast);
+    }
+
+    // Gets ids of sprites in rect. Ids are sorted, so sprites beyond the draw num are cut off.
+    int QueryGrid(const uiRect &rect)
+    {
+        m_grid.Query(rect, &m_visible);
+        return (int)(std::lower_bound(m_visible.begin(), m_visible.end(), GetDrawNum()) - m_visible.begin());
+    }
+
+    // Submits only sprites that intersect the view
+    template <class Target>
+    void DrawVisibleSprites(Target &&target)
+    {
+        uiRect view = { 0, 0, m_view_width, m_view_height };
+        int visible = QueryGrid(view);
+        for (int i = 0; i < visible; i++)
+            DrawSprite(target, m_sprites[m_visible[i]]);
+        m_submitted += visible;
+        m_culled += GetDrawNum() - visible;
+        m_cull_frames++;
+    }
+
+    // Bins sprites into screen tiles and renders the tiles on worker threads.
+    // It also clears the framebuffer.
+    void DrawComposited(SoftRenderer &r)
+    {
+        if (HasError()) return;
+        int width, height;
+        r.GetSize(&width, &height);
+        uiRect view = { 0, 0, width, height };
+        m_compositor.Begin(r, view, 0xEEEEEE);
+        if (m_culling) {
+            int visible = QueryGrid(view);
+            for (int i = 0; i < visible; i++)
+                m_compositor.Add(m_sprites[m_visible[i]]);
+            m_submitted += visible;
+            m_culled += GetDrawNum() - visible;
+            m_cull_frames++;
+        } else {
+            int num = GetDrawNum();
+            for (int i = 0; i < num; i++)
+                m_compositor.Add(m_sprites[i]);
+        }
+        m_compositor.Render(m_fast);
+    }
+
+    // Redraws dirty rects only. The framebuffer must have the last frame.
+    void DrawDamagedSprites(SoftRenderer &r)
+    {
+        if (HasError()) return;
+        int num = GetDrawNum();
+        m_bounds.resize(num);
+        for (int i = 0; i < num; i++) {
+            m_bounds[i] = m_sprites[i].GetBounds();
+            m_damage.Track(i, m_bounds[i]);
+        }
+        m_damage.Finish();
+
+        for (const uiRect &rect : m_damage.GetRects()) {
+            r.SetClip(rect);
+            r.FillRect(rect, 0xEEEEEE);
+            if (m_culling) {
+                // the grid finds sprites in the rect without scanning all of them
+                int visible = QueryGrid(rect);
+                for (int i = 0; i < visible; i++)
+                    DrawSprite(r, m_sprites[m_visible[i]]);
+                m_submitted += visible;
+                m_culled += num - visible;
+                continue;
+            }
+            for (int i = 0; i < num; i++) {
+                if (RectsIntersect(m_bounds[i], rect))
+                    DrawSprite(r, m_sprites[i]);
+            }
+        }
+        r.ResetClip();
+        if (m_culling) m_cull_frames++;
+
+        m_dirty_area += m_damage.GetDirtyArea();
+        m_dirty_rects += m_damage.GetRects().size();
+        m_damage_frames++;
+    }
+
  public:
     SpriteHandler() : m_image_buffers(), m_sprites(),
-                      m_png(), m_error_msg(), m_step(0),
-                      m_start(clock()), m_start_step(0) {}
+                      m_sprite_array(), m_use_sprite_array(0),
+                      m_rotation_cache(), m_use_rotation_cache(0),
+                      m_use_scaled_levels(0), m_level_build_ms(0), m_tile_size(0), m_error_msg(), m_png(), m_step(0), m_profiler(),
+                      m_start(std::chrono::steady_clock::now()), m_frames(0),
+                      m_upload_num(0), m_partial_rows(0), m_partial_y(0),
+                      m_upload_bytes(0), m_upload_sec(0),
+                      m_sprite_num(1), m_fast(0),
+                      m_rotated_percent(100), m_axis_aligned_path(1), m_scale(2.0),
+                      m_damage_tracking(0), m_damage(), m_bounds(),
+                      m_dirty_area(0), m_dirty_rects(0), m_damage_frames(0),
+                      m_culling(0), m_grid(), m_visible(), m_view_width(0), m_view_height(0),
+                      m_submitted(0), m_culled(0), m_cull_frames(0),
+                      m_use_compositor(0), m_compositor(),
+                      m_use_group(0), m_group(),
+                      m_use_instances(0), m_instances(), m_instance_batches(0), m_instance_frames(0),
+                      m_use_queue(0), m_queue(), m_sort_ms(0), m_queue_frames(0) {}
+
+    void SetUploadNum(int num) { m_upload_num = num; }
+    void SetPartialRows(int rows) { m_partial_rows = rows; }
+
+    // Restarts the rotation animation
+    void ResetStep() { m_step = 0; }
+
+    void ResetUploadStats()
+    {
+        m_upload_bytes = 0;
+        m_upload_sec = 0;
+    }
+
+    // bytes copied into the image buffer per second
+    double GetUploadRate() { return m_upload_sec > 0 ? m_upload_bytes / m_upload_sec : 0.0; }
+    void SetSpriteNum(int num) { m_sprite_num = num; }
+    void SetFast(int fast) { m_fast = fast; }
+    void SetRotatedPercent(int percent) { m_rotated_percent = percent; }
+    void SetAxisAlignedPath(int enabled) { m_axis_aligned_path = enabled; }
+    int IsAxisAlignedPath() { return m_axis_aligned_path; }
+
+    // Stores sprites in SpriteArray instead of std::vector<Sprite>
+    void SetUseSpriteArray(int enabled) { m_use_sprite_array = enabled; }
+    int IsUsingSpriteArray() { return m_use_sprite_array; }
+
+    // Draws rotated sprites with pre-rotated images. (std::vector<Sprite> only)
+    // The image never changes, so the cache is valid across uploads.
+    void SetUseRotationCache(int enabled)
+    {
+        m_use_rotation_cache = enabled;
+        if (enabled && HasImage())
+            KeepCpuCopy();
+        for (Sprite &sprite : m_sprites)
+            sprite.SetRotationCache(enabled ? &m_rotation_cache : NULL);
+    }
+
+    int IsUsingRotationCache() { return m_use_rotation_cache; }
+
+    // Sprites draw pre-scaled levels of the image (std::vector<Sprite> only)
+    void SetUseScaledLevels(int enabled) { m_use_scaled_levels = enabled; }
+    int IsUsingScaledLevels() { return m_use_scaled_levels; }
+
+    // Loads the image with ImageBuffer::CreateTiledFromPng() (headless mode only)
+    // Tiled images have no CPU copy, so uploads, RotationCache, and scaled levels don't work with them.
+    void SetTileSize(int tile_size) { m_tile_size = tile_size; }
+    int GetTileSize() { return m_tile_size; }
+
+    // Builds or frees the scaled levels to match the setting.
+    // c can be NULL for headless buffers.
+    void ApplyScaledLevels(uiDrawContext *c)
+    {
+        if (!HasImage()) return;
+        ImageBuffer& buf = m_image_buffers[0];
+        if (m_use_scaled_levels == buf.HasScaledLevels()) return;
+        if (!m_use_scaled_levels) {
+            buf.FreeScaledLevels();
+            return;
+        }
+        KeepCpuCopy();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        buf.BuildScaledLevels(c, 3, 4);  // 1/2, 1/4, 1/8, 2x, 3x, and 4x
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        m_level_build_ms = elapsed.count();
+    }
+
+    // Sprites outside of the view are not submitted (std::vector<Sprite> only)
+    void SetCulling(int enabled)
+    {
+        m_culling = enabled;
+        m_grid.Clear();
+        ResetCullStats();
+    }
+
+    int IsCulling() { return m_culling && !m_use_sprite_array; }
+
+    // Call it when drawing. The grid covers the view.
+    void SetViewSize(int width, int height)
+    {
+        if (width == m_view_width && height == m_view_height) return;
+        m_view_width = width;
+        m_view_height = height;
+        m_grid.Resize(width, height);
+    }
+
+    void ResetCullStats()
+    {
+        m_submitted = 0;
+        m_culled = 0;
+        m_cull_frames = 0;
+    }
+
+    // average sprites per frame. All sprites are submitted without culling.
+    // With damage tracking, they are summed over the dirty rects.
+    void GetCullStats(double *submitted, double *culled)
+    {
+        if (!IsCulling()) {
+            *submitted = GetDrawNum();
+            *culled = 0;
+            return;
+        }
+        int frames = std::max(m_cull_frames, 1);
+        *submitted = (double)m_submitted / frames;
+        *culled = (double)m_culled / frames;
+    }
+
+    double GetLevelBuildTime() { return m_level_build_ms; }
+    size_t GetLevelBytes() { return HasImage() ? m_image_buffers[0].GetScaledLevelBytes() : 0; }
+    RotationCache &GetRotationCache() { return m_rotation_cache; }
+
+    // Rasterizes all angles in advance. All sprites share the same image and scale.
+    void PrepareRotationCache(uiDrawContext *c)
+    {
+        if (!m_use_rotation_cache || m_sprites.empty()) return;
+        m_sprites[0].PrepareRotations(c, m_fast);
+    }
+
+    void SetScale(double scale)
+    {
+        m_scale = scale;
+        m_group.MarkDirty();
+        for (Sprite &sprite : m_sprites)
+            sprite.SetScale(scale, scale);
+        m_sprite_array.SetScales(0, m_sprite_array.GetSize(), (float)scale, (float)scale);
+    }
+
+    // Measures Step() and dst rect computation for num sprites in ms per frame.
+    // The AoS path computes dst rects one by one as DrawSprites() does.
+    double MeasureUpdate(int use_sprite_array, int num, int frames)
+    {
+        m_use_sprite_array = use_sprite_array;
+        m_sprite_num = num - 1;
+        PrepareSprites(num);
+        std::vector<uiRect> dst_rects(use_sprite_array ? 0 : num);
+        long long sum = 0;  // keeps the results alive
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            Step();
+            if (use_sprite_array) {
+                sum += m_sprite_array.GetDstRect(num - 1).X;
+            } else {
+                for (int i = 0; i < num; i++)
+                    dst_rects[i] = m_sprites[i].GetDstRect();
+                sum += dst_rects[num - 1].X;
+            }
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        volatile long long sink = sum;
+        (void)sink;
+        return elapsed.count() / frames;
+    }
+
+    // Also resets damage stats. The next frame redraws the whole area.
+    void SetDamageTracking(int enabled, int width, int height)
+    {
+        m_damage_tracking = enabled;
+        m_damage.Resize(width, height);
+        m_dirty_area = 0;
+        m_dirty_rects = 0;
+        m_damage_frames = 0;
+    }
+
+    // average dirty area (%) and dirty rects per frame
+    void GetDamageStats(double *area_percent, double *rects, int width, int height)
+    {
+        int frames = std::max(m_damage_frames, 1);
+        *area_percent = 100.0 * m_dirty_area / frames / ((double)width * height);
+        *rects = (double)m_dirty_rects / frames;
+    }
 
     int HasImage() {
         return m_image_buffers.size() > 0;
@@ -40,8 +597,23 @@ class SpriteHandler {
         return m_error_msg.c_str();
     }
 
+    // c can be NULL to load sprites for SoftRenderer
     int LoadSprites(uiDrawContext *c)
     {
+        if (m_tile_size > 0) {
+            // stream rows into tiles without the whole image in memory
+            m_image_buffers.resize(1);
+            ImageBuffer& buf = m_image_buffers[0];
+            if (buf.CreateTiledFromPng(c, "sprites/palm-tree.png", m_tile_size)) {
+                m_error_msg = std::string("File not found. (sprites/palm-tree.png)");
+                m_image_buffers.clear();
+                return 1;
+            }
+            m_sprite_array.SetBuffer(buf);
+            PrepareSprites(GRID_SPRITES);
+            return 0;
+        }
+
         // load image
         int ret = m_png.ReadFromFile("sprites/palm-tree.png");
         if (ret) {
@@ -59,16 +631,12 @@ class SpriteHandler {
         buf.Create(c, width, height, has_alpha);
         buf.Update(m_png.GetData());
 
-        m_sprites.resize(14400);
-        for (int i = 0; i < 14400; i++) {
-            Sprite &sprite = m_sprites[i];
-            sprite.SetBuffer(buf);
-            uiRect rect = buf.GetRect();
-            sprite.SetSrcRect(rect);
-            sprite.SetPosition(5 * (i / 120), 5 * (i % 120));
-            sprite.SetCenter(width / 2, height / 2);
-            sprite.SetScale(2.0, 2.0);
-        }
+        m_sprite_array.SetBuffer(buf);
+        m_rotation_cache.Clear();
+        if (m_use_rotation_cache || m_use_group)
+            KeepCpuCopy();
+        m_group.Clear();
+        PrepareSprites(GRID_SPRITES);
 
         return 0;
     }
@@ -76,71 +644,216 @@ class SpriteHandler {
     void Update()
     {
         if (HasError()) return;
-        int i = 0;
-        int num = uiSpinboxValue(m_spinbox_buffer);
         ImageBuffer& buf = m_image_buffers[0];
-        for (int i = 0; i < num; i++) {
-            buf.Update(m_png.GetData());
+        int width, height;
+        buf.GetSize(&width, &height);
+        int rows = std::min(m_partial_rows, height);
+        if (rows > 0 && !buf.CanUploadRect())
+            KeepCpuCopy();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        m_profiler.Begin(PHASE_UPDATE);
+        for (int i = 0; i < m_upload_num; i++) {
+            if (rows > 0) {
+                // update a band of rows that moves down the image
+                if (m_partial_y + rows > height) m_partial_y = 0;
+                uiRect rect = { 0, m_partial_y, width, rows };
+                buf.UpdateRect(rect, m_png.GetData() + (size_t)m_partial_y * width * 4, width * 4);
+                m_partial_y += rows;
+            } else if (buf.CanLockInPlace()) {
+                // write into the surface (or the CPU copy) without an extra copy in libui
+                int stride;
+                unsigned char *pixels = buf.Lock(&stride);
+                for (int y = 0; y < height; y++)
+                    memcpy(pixels + (size_t)y * stride, m_png.GetData() + (size_t)y * width * 4, (size_t)width * 4);
+                buf.Unlock();
+            } else {
+                buf.Update(m_png.GetData());
+            }
         }
+        m_profiler.End(PHASE_UPDATE);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        m_upload_sec += elapsed.count();
+        // libui buffers upload the whole buffer for partial updates without image_buffer_ext
+        int uploaded_rows = rows > 0 && buf.CanUploadRect() ? rows : height;
+        m_upload_bytes += (long long)m_upload_num * uploaded_rows * width * 4;
+    }
+
+    // Starts a frame. Call it before Step().
+    void BeginFrame()
+    {
+        m_profiler.Mark();
+        m_frames++;
     }
 
     void Step()
     {
-        int i = 0;
-        int num = uiSpinboxValue(m_spinbox_sprite);
-        for (auto &sprite : m_sprites) {
-            if (i > num) break;
-            sprite.SetAngle((double)(m_step % 200) * uiPi / 100);
-            i++;
+        m_profiler.Begin(PHASE_STEP);
+        int num = GetDrawNum();
+        PrepareSprites(num);
+        double rad = (double)(m_step % 200) * uiPi / 100;
+        StepSprites(num, rad);
+        if (m_rotated_percent > 0)
+            m_group.MarkDirty();  // angles changed
+        if (IsCulling()) {
+            // cells change only when sprites cross cell borders
+            for (int i = 0; i < num; i++)
+                m_grid.Update(i, m_sprites[i].GetBounds());
         }
-        m_step++;
+        m_step = (m_step + 1) % 200;
+        m_profiler.End(PHASE_STEP);
     }
 
     void DrawSprites(uiDrawContext *c)
     {
-        if (HasError()) return;
-        int i = 0;
-        int num = uiSpinboxValue(m_spinbox_sprite);
-        if (uiCheckboxChecked(m_checkbox_fast)) {
-            for (auto &sprite : m_sprites) {
-                if (i > num) break;
-                sprite.DrawFast(c);
-                i++;
-            }
-        } else {
-            for (auto &sprite : m_sprites) {
-                if (i > num) break;
-                sprite.Draw(c);
-                i++;
-            }
-        }
+        m_profiler.Begin(PHASE_DRAW);
+        DrawSpritesTo(c);
+        m_profiler.End(PHASE_DRAW);
+    }
+
+    void DrawSprites(SoftRenderer &r)
+    {
+        m_profiler.Begin(PHASE_DRAW);
+        if (m_damage_tracking && !m_use_sprite_array)
+            DrawDamagedSprites(r);
+        else if (IsUsingCompositor())
+            DrawComposited(r);
+        else
+            DrawSpritesTo(r);
+        m_profiler.End(PHASE_DRAW);
     }
 
+    FrameProfiler &GetProfiler() { return m_profiler; }
+
+    int IsDamageTracking() { return m_damage_tracking && !m_use_sprite_array; }
+
+    // Renders with TileCompositor on thread_num threads. 0 means the number of hardware threads.
+    void SetCompositor(int enabled, int thread_num = 0)
+    {
+        m_use_compositor = enabled;
+        if (enabled)
+            m_compositor.SetThreadNum(thread_num);
+    }
+
+    int IsUsingCompositor() { return m_use_compositor && !m_use_sprite_array; }
+
+    // Renders the sprites into SpriteGroup and draws it as one blit (std::vector<Sprite> only).
+    // The group is rendered again when sprites rotate or scale. Uploads don't change the image.
+    void SetUseGroup(int enabled)
+    {
+        m_use_group = enabled;
+        if (enabled && HasImage())
+            KeepCpuCopy();
+        m_group.Clear();
+    }
+
+    int IsUsingGroup() { return m_use_group; }
+
+    // Draws sprites in batches (DrawSpriteInstances)
+    void SetUseInstances(int enabled) { m_use_instances = enabled; }
+    int IsUsingInstances() { return m_use_instances; }
+    double GetBatchesPerFrame()
+    {
+        return m_instance_frames > 0 ? (double)m_instance_batches / m_instance_frames : 0.0;
+    }
+
+    // Draws sprites through RenderQueue
+    void SetUseQueue(int enabled) { m_use_queue = enabled; }
+    int IsUsingQueue() { return m_use_queue; }
+    double GetSortTimePerFrame() { return m_queue_frames > 0 ? m_sort_ms / m_queue_frames : 0.0; }
+    SpriteGroup &GetGroup() { return m_group; }
+    TileCompositor &GetCompositor() { return m_compositor; }
+
     void CreateControls(uiBox *vbox)
     {
         m_label_fps = uiNewLabel("FPS: 0");
         uiBoxAppend(vbox, uiControl(m_label_fps), 0);
 
         m_spinbox_buffer = uiNewSpinbox(0, 14400);
+        uiSpinboxSetValue(m_spinbox_buffer, m_upload_num);
+        uiSpinboxOnChanged(m_spinbox_buffer, OnBufferChanged, this);
         uiBoxAppend(vbox, uiControl(m_spinbox_buffer), 0);
 
-        m_spinbox_sprite = uiNewSpinbox(1, 14400);
+        uiBoxAppend(vbox, uiControl(uiNewLabel("Partial update rows (0: full update)")), 0);
+        m_spinbox_partial = uiNewSpinbox(0, 4096);
+        uiSpinboxSetValue(m_spinbox_partial, m_partial_rows);
+        uiSpinboxOnChanged(m_spinbox_partial, OnPartialChanged, this);
+        uiBoxAppend(vbox, uiControl(m_spinbox_partial), 0);
+
+        m_spinbox_sprite = uiNewSpinbox(1, MAX_SPRITES);
+        uiSpinboxSetValue(m_spinbox_sprite, m_sprite_num);
+        uiSpinboxOnChanged(m_spinbox_sprite, OnSpriteChanged, this);
         uiBoxAppend(vbox, uiControl(m_spinbox_sprite), 0);
 
         m_checkbox_fast = uiNewCheckbox("Use uiImageBufferDrawFast()");
+        uiCheckboxSetChecked(m_checkbox_fast, m_fast);
+        uiCheckboxOnToggled(m_checkbox_fast, OnFastToggled, this);
         uiBoxAppend(vbox, uiControl(m_checkbox_fast), 0);
+
+        uiBoxAppend(vbox, uiControl(uiNewLabel("Rotated sprites (%)")), 0);
+        m_spinbox_rotated = uiNewSpinbox(0, 100);
+        uiSpinboxSetValue(m_spinbox_rotated, m_rotated_percent);
+        uiSpinboxOnChanged(m_spinbox_rotated, OnRotatedChanged, this);
+        uiBoxAppend(vbox, uiControl(m_spinbox_rotated), 0);
+
+        m_checkbox_axis_aligned = uiNewCheckbox("Skip the matrix stack for unrotated sprites");
+        uiCheckboxSetChecked(m_checkbox_axis_aligned, m_axis_aligned_path);
+        uiCheckboxOnToggled(m_checkbox_axis_aligned, OnAxisAlignedToggled, this);
+        uiBoxAppend(vbox, uiControl(m_checkbox_axis_aligned), 0);
+
+        m_checkbox_sprite_array = uiNewCheckbox("Store sprites in SpriteArray (SoA)");
+        uiCheckboxSetChecked(m_checkbox_sprite_array, m_use_sprite_array);
+        uiCheckboxOnToggled(m_checkbox_sprite_array, OnSpriteArrayToggled, this);
+        uiBoxAppend(vbox, uiControl(m_checkbox_sprite_array), 0);
+
+        m_checkbox_rotation_cache = uiNewCheckbox("Cache rotated sprites");
+        uiCheckboxSetChecked(m_checkbox_rotation_cache, m_use_rotation_cache);
+        uiCheckboxOnToggled(m_checkbox_rotation_cache, OnRotationCacheToggled, this);
+        uiBoxAppend(vbox, uiControl(m_checkbox_rotation_cache), 0);
+
+        m_checkbox_scaled_levels = uiNewCheckbox("Draw pre-scaled levels");
+        uiCheckboxSetChecked(m_checkbox_scaled_levels, m_use_scaled_levels);
+        uiCheckboxOnToggled(m_checkbox_scaled_levels, OnScaledLevelsToggled, this);
+        uiBoxAppend(vbox, uiControl(m_checkbox_scaled_levels), 0);
+
+        m_checkbox_culling = uiNewCheckbox("Cull off-screen sprites with a spatial grid");
+        uiCheckboxSetChecked(m_checkbox_culling, m_culling);
+        uiCheckboxOnToggled(m_checkbox_culling, OnCullingToggled, this);
+        uiBoxAppend(vbox, uiControl(m_checkbox_culling), 0);
+
+        m_checkbox_instances = uiNewCheckbox("Draw sprites in batches");
+        uiCheckboxSetChecked(m_checkbox_instances, m_use_instances);
+        uiCheckboxOnToggled(m_checkbox_instances, OnInstancesToggled, this);
+        uiBoxAppend(vbox, uiControl(m_checkbox_instances), 0);
     }
 
+    // Shows FPS and frame time percentiles every second.
+    // They are wall-clock times. (clock() counts CPU time of the process only)
     void CheckFPS()
     {
-        clock_t current = clock();
-        if ((current - m_start) >= CLOCKS_PER_SEC) {
-            double fps = (double)(m_step - m_start_step) * (double)CLOCKS_PER_SEC / (double)(current - m_start);
-            std::string fps_str = "FPS: " + std::to_string(fps);
-            uiLabelSetText(m_label_fps, fps_str.c_str());
+        std::chrono::steady_clock::time_point current = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = current - m_start;
+        if (elapsed.count() >= 1.0) {
+            double fps = m_frames / elapsed.count();
+            char fps_str[256];
+            int len = snprintf(fps_str, sizeof(fps_str),
+                     "FPS: %.1f  frame p50/p95/p99: %.2f/%.2f/%.2f ms (draw p95: %.2f ms, upload: %.1f MB/s)", fps,
+                     m_profiler.GetPercentile(PHASE_FRAME, 50),
+                     m_profiler.GetPercentile(PHASE_FRAME, 95),
+                     m_profiler.GetPercentile(PHASE_FRAME, 99),
+                     m_profiler.GetPercentile(PHASE_DRAW, 95),
+                     GetUploadRate() / (1024 * 1024));
+            if (IsCulling() && len > 0 && len < (int)sizeof(fps_str)) {
+                double submitted, culled;
+                GetCullStats(&submitted, &culled);
+                snprintf(fps_str + len, sizeof(fps_str) - len,
+                         "\nsubmitted: %.0f, culled: %.0f per frame", submitted, culled);
+            }
+            uiLabelSetText(m_label_fps, fps_str);
             m_start = current;
-            m_step %= 200;
-            m_start_step = m_step;
+            m_frames = 0;
+            ResetUploadStats();
+            ResetCullStats();
         }
     }
 };
@@ -173,7 +886,10 @@ static void HandlerDraw(uiAreaHandler *a, uiArea *area, uiAreaDrawParams *p)
         g_sprite_handler.LoadSprites(p->Context);
         if (g_sprite_handler.HasError()) return;
     }
+    g_sprite_handler.ApplyScaledLevels(p->Context);
+    g_sprite_handler.SetViewSize((int)p->AreaWidth, (int)p->AreaHeight);
 
+    g_sprite_handler.BeginFrame();
     g_sprite_handler.Step();
     g_sprite_handler.Update();
 
@@ -269,8 +985,773 @@ void CreateWindow()
     }
 }
 
-int main(void)
+// Renders frames with the software renderer and returns the elapsed time in seconds.
+// When duration is positive, it renders frames until duration seconds elapse instead.
+static double RenderFrames(SoftRenderer &renderer, int frames, double duration = 0.0,
+                           int *rendered = NULL)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed(0);
+    int i;
+    for (i = 0; duration > 0 ? (i == 0 || elapsed.count() < duration) : i < frames; i++) {
+        g_sprite_handler.BeginFrame();
+        g_sprite_handler.Step();
+        g_sprite_handler.Update();
+        if (!g_sprite_handler.IsDamageTracking() && !g_sprite_handler.IsUsingCompositor())
+            renderer.Clear(0xEEEEEE);
+        g_sprite_handler.DrawSprites(renderer);
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    if (rendered) *rendered = i;
+    return elapsed.count();
+}
+
+// Compares FPS with and without the axis-aligned path for rotated/unrotated mixes.
+static void CompareDrawPaths(SoftRenderer &renderer, int frames)
+{
+    printf("rotated(%%)  all rotated path(FPS)  axis-aligned path(FPS)  speedup\n");
+    const int percents[] = { 0, 25, 50, 75, 100 };
+    for (int percent : percents) {
+        g_sprite_handler.SetRotatedPercent(percent);
+        g_sprite_handler.SetAxisAlignedPath(0);
+        double slow = RenderFrames(renderer, frames);
+        g_sprite_handler.SetAxisAlignedPath(1);
+        double fast = RenderFrames(renderer, frames);
+        printf("%10d  %21.3f  %22.3f  %6.2fx\n", percent,
+               frames / slow, frames / fast, slow / fast);
+    }
+}
+
+// Compares FPS of the serial renderer and the tile compositor for thread counts up to the hardware threads.
+// All frames should have the same checksum as the serial one.
+static void CompareThreads(SoftRenderer &renderer, int frames)
+{
+    g_sprite_handler.SetCompositor(0);
+    g_sprite_handler.ResetStep();
+    double serial = RenderFrames(renderer, frames);
+    uint32_t checksum = renderer.Checksum();
+    printf("serial: %.3f FPS, checksum: %08x\n", frames / serial, (unsigned)checksum);
+
+    int max_threads = std::max((int)std::thread::hardware_concurrency(), 1);
+    std::vector<int> thread_nums;
+    for (int n = 1; n < max_threads; n *= 2)
+        thread_nums.push_back(n);
+    thread_nums.push_back(max_threads);
+
+    printf("threads  FPS         speedup  vs 1 thread  steals  checksum\n");
+    double one_thread = 0.0;
+    for (int n : thread_nums) {
+        g_sprite_handler.SetCompositor(1, n);
+        TileCompositor &compositor = g_sprite_handler.GetCompositor();
+        long long steals = compositor.GetSteals();
+        g_sprite_handler.ResetStep();
+        double sec = RenderFrames(renderer, frames);
+        if (n == 1) one_thread = sec;
+        printf("%7d  %10.3f  %6.2fx  %10.2fx  %6lld  %s\n", n, frames / sec,
+               sec > 0 ? serial / sec : 0.0, sec > 0 ? one_thread / sec : 0.0,
+               compositor.GetSteals() - steals, renderer.Checksum() == checksum ? "same" : "DIFFERENT");
+    }
+    g_sprite_handler.SetCompositor(0);
+}
+
+// Compares FPS of drawing static sprites one by one and drawing them as a cached group.
+// The first frame of the group renders the members, so its time is reported separately.
+static void CompareGroup(SoftRenderer &renderer, int frames)
+{
+    SpriteGroup &group = g_sprite_handler.GetGroup();
+    printf("sprites  individual(FPS)  cached(FPS)  speedup  render(ms)  memory(MB)\n");
+    const int counts[] = { 100, 1000, GRID_SPRITES };
+    for (int count : counts) {
+        g_sprite_handler.SetSpriteNum(count - 1);
+        g_sprite_handler.SetUseGroup(0);
+        g_sprite_handler.ResetStep();
+        double individual = RenderFrames(renderer, frames);
+
+        g_sprite_handler.SetUseGroup(1);
+        g_sprite_handler.ResetStep();
+        RenderFrames(renderer, 1);
+        double cached = RenderFrames(renderer, frames);
+        printf("%7d  %15.3f  %11.3f  %6.2fx  %10.3f  %10.2f\n", count,
+               frames / individual, frames / cached, cached > 0 ? individual / cached : 0.0,
+               group.GetRenderTime(), group.GetBytes() / (1024.0 * 1024.0));
+    }
+
+    // Rotating sprites make the group dirty in every frame
+    g_sprite_handler.SetRotatedPercent(100);
+    g_sprite_handler.ResetStep();
+    long long renders = group.GetRenders();
+    double dirty = RenderFrames(renderer, frames);
+    printf("dirty in every frame (%d sprites, rotated): %.3f FPS, %lld renders\n",
+           GRID_SPRITES, frames / dirty, group.GetRenders() - renders);
+    g_sprite_handler.SetUseGroup(0);
+}
+
+// Sorts random keys of RenderQueue. Sprites are spread over 8 layers, 4096 depths, and 16 image buffers.
+// Submit() builds the keys, including buffer ids. std::stable_sort sorts the same keys prebuilt.
+static void CompareSort(int rounds)
+{
+    std::vector<ImageBuffer> buffers(16);
+    std::vector<Sprite> sprites(buffers.size());
+    for (size_t i = 0; i < buffers.size(); i++)
+        sprites[i].SetBuffer(buffers[i]);
+    RenderQueue queue;
+    printf("sprites  submit(ms)  radix sort(ms)  std::stable_sort(ms)  batches\n");
+    const int counts[] = { 1000, 10000, 100000, MAX_SPRITES };
+    for (int count : counts) {
+        double submit_ms = 0, sort_ms = 0, std_ms = 0;
+        int batches = 0;
+        for (int round = 0; round < rounds; round++) {
+            uint32_t seed = 12345 + round;
+            std::vector<std::pair<uint64_t, int>> keys(count);
+
+            std::vector<uint32_t> seeds(count);
+            for (int i = 0; i < count; i++) {
+                seed = seed * 1664525 + 1013904223;
+                seeds[i] = seed;
+                keys[i] = std::make_pair(RenderQueue::MakeKey(seed >> 29, (seed >> 8) & 0xFFF, (seed >> 4) & 0xF), i);
+            }
+
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            queue.Clear();
+            for (int i = 0; i < count; i++)
+                queue.Submit(&sprites[(seeds[i] >> 4) & 0xF], seeds[i] >> 29, (seeds[i] >> 8) & 0xFFF);
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            submit_ms += elapsed.count();
+
+            queue.Sort();
+            sort_ms += queue.GetSortTime();
+
+            start = std::chrono::steady_clock::now();
+            std::stable_sort(keys.begin(), keys.end(),
+                             [](const std::pair<uint64_t, int> &a, const std::pair<uint64_t, int> &b) {
+                                 return a.first < b.first;
+                             });
+            elapsed = std::chrono::steady_clock::now() - start;
+            std_ms += elapsed.count();
+
+            // runs of the same buffer can be drawn as one batch
+            batches = 0;
+            ImageBuffer *last = NULL;
+            queue.ForEach([&batches, &last](Sprite &s) {
+                if (s.GetBuffer() != last) batches++;
+                last = s.GetBuffer();
+            });
+        }
+        printf("%7d  %10.3f  %14.3f  %20.3f  %7d\n", count,
+               submit_ms / rounds, sort_ms / rounds, std_ms / rounds, batches);
+    }
+}
+
+// Compares update costs of std::vector<Sprite> and SpriteArray
+static void CompareLayouts(int frames)
+{
+    printf("sprites  AoS update(ms)  SoA update(ms)  speedup\n");
+    const int counts[] = { GRID_SPRITES, 100000, MAX_SPRITES };
+    for (int count : counts) {
+        double aos = g_sprite_handler.MeasureUpdate(0, count, frames);
+        double soa = g_sprite_handler.MeasureUpdate(1, count, frames);
+        printf("%7d  %14.3f  %14.3f  %6.2fx\n", count, aos, soa, soa > 0 ? aos / soa : 0.0);
+    }
+}
+
+// Compares FPS of live rotation and the rotation cache for some angle steps.
+// The first frame of the cache rasterizes the variants, so it's excluded by a warmup frame.
+static void CompareRotationCache(SoftRenderer &renderer, int frames)
+{
+    RotationCache &cache = g_sprite_handler.GetRotationCache();
+    g_sprite_handler.SetUseRotationCache(0);
+    g_sprite_handler.ResetStep();
+    double live = RenderFrames(renderer, frames);
+    printf("live rotation: %.3f FPS\n", frames / live);
+
+    printf("steps  cached(FPS)  speedup  hit rate(%%)  variants  memory(MB)  evictions\n");
+    const int steps[] = { 36, 200, 1000 };
+    for (int step : steps) {
+        cache.SetSteps(step);
+        g_sprite_handler.SetUseRotationCache(1);
+        g_sprite_handler.ResetStep();
+        RenderFrames(renderer, 1);
+        cache.ResetStats();
+        double cached = RenderFrames(renderer, frames);
+        long long lookups = cache.GetHits() + cache.GetMisses();
+        printf("%5d  %11.3f  %6.2fx  %11.2f  %8d  %10.2f  %9lld\n", step,
+               frames / cached, cached > 0 ? live / cached : 0.0,
+               lookups > 0 ? 100.0 * cache.GetHits() / lookups : 0.0,
+               cache.GetVariantNum(), cache.GetBytes() / (1024.0 * 1024.0), cache.GetEvictions());
+    }
+    g_sprite_handler.SetUseRotationCache(0);
+}
+
+// Compares draw times with and without pre-scaled levels for some scales.
+static void CompareScaledLevels(SoftRenderer &renderer, int frames)
+{
+    g_sprite_handler.SetUseScaledLevels(1);
+    g_sprite_handler.ApplyScaledLevels(NULL);
+    printf("build levels: %.3f ms, %.2f MB\n", g_sprite_handler.GetLevelBuildTime(),
+           g_sprite_handler.GetLevelBytes() / (1024.0 * 1024.0));
+
+    printf("scale  source draw p50(ms)  levels draw p50(ms)  speedup\n");
+    const double scales[] = { 0.25, 0.5, 1.0, 1.5, 2.0, 3.0 };
+    FrameProfiler &profiler = g_sprite_handler.GetProfiler();
+    for (double scale : scales) {
+        g_sprite_handler.SetScale(scale);
+        double times[2];
+        for (int use_levels = 0; use_levels < 2; use_levels++) {
+            g_sprite_handler.SetUseScaledLevels(use_levels);
+            g_sprite_handler.ApplyScaledLevels(NULL);
+            g_sprite_handler.ResetStep();
+            profiler = FrameProfiler(frames);
+            RenderFrames(renderer, frames);
+            times[use_levels] = profiler.GetPercentile(PHASE_DRAW, 50);
+        }
+        printf("%5.2f  %20.3f  %19.3f  %6.2fx\n", scale, times[0], times[1],
+               times[1] > 0 ? times[0] / times[1] : 0.0);
+    }
+}
+
+// Parameters of a run
+struct BenchConfig {
+    int sprites;
+    int uploads;
+    int partial_rows;  // 0 means full updates
+    int fast;
+    int rotated;  // percent
+    double scale;
+};
+
+struct BenchResult {
+    BenchConfig config;
+    int frames;
+    double sec;
+    double times[PHASE_COUNT][3];  // p50, p95, p99 in ms
+    uint32_t checksum;
+    double dirty_percent;
+    double upload_mb_per_sec;
+    double submitted;  // sprites per frame
+    double culled;
+};
+
+static const double PERCENTILES[3] = { 50, 95, 99 };
+
+// Parses a comma-separated list like "100,1000,14400".
+// Returns 1 when an item is not a number.
+static int ParseList(const char *str, std::vector<double> *values)
+{
+    values->clear();
+    std::string list(str);
+    size_t begin = 0;
+    while (begin <= list.size()) {
+        size_t end = list.find(',', begin);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(begin, end - begin);
+        char *item_end;
+        double value = strtod(item.c_str(), &item_end);
+        if (item.empty() || *item_end != '\0') return 1;
+        values->push_back(value);
+        begin = end + 1;
+    }
+    return 0;
+}
+
+static void ApplyConfig(SoftRenderer &renderer, const BenchConfig &config, int damage)
+{
+    int width, height;
+    renderer.GetSize(&width, &height);
+    g_sprite_handler.SetSpriteNum(config.sprites);
+    g_sprite_handler.SetUploadNum(config.uploads);
+    g_sprite_handler.SetPartialRows(config.partial_rows);
+    g_sprite_handler.SetFast(config.fast);
+    g_sprite_handler.SetRotatedPercent(config.rotated);
+    g_sprite_handler.SetScale(config.scale);
+    g_sprite_handler.SetDamageTracking(damage, width, height);
+    g_sprite_handler.SetViewSize(width, height);
+
+    // The same config renders the same frames regardless of the order in a sweep.
+    g_sprite_handler.ResetStep();
+}
+
+static void RunConfig(SoftRenderer &renderer, const BenchConfig &config,
+                      int frames, double duration, int warmup, int damage,
+                      BenchResult *result)
+{
+    int width, height;
+    renderer.GetSize(&width, &height);
+    ApplyConfig(renderer, config, damage);
+
+    if (warmup > 0)
+        RenderFrames(renderer, warmup);
+
+    // keep all frames for percentiles
+    g_sprite_handler.GetProfiler() = FrameProfiler(duration > 0 ? 100000 : frames);
+
+    g_sprite_handler.ResetUploadStats();
+    g_sprite_handler.ResetCullStats();
+    result->config = config;
+    result->sec = RenderFrames(renderer, frames, duration, &result->frames);
+    FrameProfiler &profiler = g_sprite_handler.GetProfiler();
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        for (int i = 0; i < 3; i++)
+            result->times[phase][i] = profiler.GetPercentile(phase, PERCENTILES[i]);
+    }
+    result->checksum = renderer.Checksum();
+    result->upload_mb_per_sec = g_sprite_handler.GetUploadRate() / (1024 * 1024);
+    double rects;
+    g_sprite_handler.GetDamageStats(&result->dirty_percent, &rects, width, height);
+    g_sprite_handler.GetCullStats(&result->submitted, &result->culled);
+}
+
+static void PrintText(FILE *out, const std::vector<BenchResult> &results, int damage)
+{
+    RotationCache &cache = g_sprite_handler.GetRotationCache();
+    for (const BenchResult &r : results) {
+        if (results.size() > 1) {
+            fprintf(out, "sprites: %d, uploads: %d, partial rows: %d, fast: %d, rotated: %d%%, scale: %g\n",
+                    r.config.sprites, r.config.uploads, r.config.partial_rows, r.config.fast,
+                    r.config.rotated, r.config.scale);
+        }
+        fprintf(out, "frames: %d\n", r.frames);
+        fprintf(out, "time: %f sec\n", r.sec);
+        fprintf(out, "FPS: %f\n", r.sec > 0 ? r.frames / r.sec : 0.0);
+        fprintf(out, "checksum: %08x\n", (unsigned)r.checksum);
+        fprintf(out, "phase      p50(ms)    p95(ms)    p99(ms)\n");
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            fprintf(out, "%-8s %9.3f  %9.3f  %9.3f\n", FrameProfiler::GetPhaseName(phase),
+                    r.times[phase][0], r.times[phase][1], r.times[phase][2]);
+        }
+        if (r.config.uploads > 0)
+            fprintf(out, "upload: %.1f MB/s\n", r.upload_mb_per_sec);
+        if (damage)
+            fprintf(out, "dirty area: %.2f%%\n", r.dirty_percent);
+        if (g_sprite_handler.IsCulling())
+            fprintf(out, "submitted: %.1f, culled: %.1f per frame\n", r.submitted, r.culled);
+        if (g_sprite_handler.IsUsingGroup() && &r == &results.back()) {
+            SpriteGroup &group = g_sprite_handler.GetGroup();
+            fprintf(out, "cached group: %lld renders, last render %.3f ms, %.2f MB\n", group.GetRenders(),
+                    group.GetRenderTime(), group.GetBytes() / (1024.0 * 1024.0));
+        }
+        if (g_sprite_handler.IsUsingQueue() && &r == &results.back())
+            fprintf(out, "render queue: %.4f ms to sort per frame\n", g_sprite_handler.GetSortTimePerFrame());
+        if (g_sprite_handler.IsUsingInstances() && &r == &results.back())
+            fprintf(out, "instances: %.1f batches per frame\n", g_sprite_handler.GetBatchesPerFrame());
+        if (g_sprite_handler.IsUsingCompositor() && &r == &results.back()) {
+            TileCompositor &compositor = g_sprite_handler.GetCompositor();
+            fprintf(out, "compositor: %d threads, %d px tiles, %lld steals\n", compositor.GetThreadNum(),
+                    compositor.GetTileSize(), compositor.GetSteals());
+        }
+        if (g_sprite_handler.IsUsingScaledLevels() && &r == &results.back()) {
+            fprintf(out, "scaled levels: built in %.3f ms, %.2f MB\n", g_sprite_handler.GetLevelBuildTime(),
+                    g_sprite_handler.GetLevelBytes() / (1024.0 * 1024.0));
+        }
+        if (g_sprite_handler.IsUsingRotationCache() && &r == &results.back()) {
+            // the cache is shared by all configs of a sweep
+            fprintf(out, "rotation cache: %d variants, %.2f MB, %lld hits, %lld misses, %lld evictions\n",
+                    cache.GetVariantNum(), cache.GetBytes() / (1024.0 * 1024.0),
+                    cache.GetHits(), cache.GetMisses(), cache.GetEvictions());
+        }
+        if (results.size() > 1)
+            fprintf(out, "\n");
+    }
+}
+
+static void PrintCsv(FILE *out, const std::vector<BenchResult> &results, const std::string &label)
 {
+    fprintf(out, "label,sprites,uploads,partial_rows,fast,rotated,scale,frames,time_sec,fps");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        for (double p : PERCENTILES)
+            fprintf(out, ",%s_p%d_ms", FrameProfiler::GetPhaseName(phase), (int)p);
+    }
+    fprintf(out, ",checksum,dirty_area_percent,upload_mb_per_sec,submitted,culled\n");
+
+    // labels are written as they are except for commas and quotes
+    std::string csv_label = label;
+    for (char &c : csv_label) {
+        if (c == ',' || c == '"') c = '_';
+    }
+    for (const BenchResult &r : results) {
+        fprintf(out, "%s,%d,%d,%d,%d,%d,%g,%d,%f,%f", csv_label.c_str(),
+                r.config.sprites, r.config.uploads, r.config.partial_rows, r.config.fast, r.config.rotated,
+                r.config.scale, r.frames, r.sec, r.sec > 0 ? r.frames / r.sec : 0.0);
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            for (int i = 0; i < 3; i++)
+                fprintf(out, ",%.4f", r.times[phase][i]);
+        }
+        fprintf(out, ",%08x,%.2f,%.2f,%.1f,%.1f\n", (unsigned)r.checksum, r.dirty_percent, r.upload_mb_per_sec,
+                r.submitted, r.culled);
+    }
+}
+
+static std::string EscapeJson(const std::string &str)
+{
+    std::string escaped;
+    for (char c : str) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static void PrintJson(FILE *out, const std::vector<BenchResult> &results, const std::string &label,
+                      int width, int height, int damage)
+{
+    fprintf(out, "{\n");
+    fprintf(out, "  \"label\": \"%s\",\n", EscapeJson(label).c_str());
+    fprintf(out, "  \"width\": %d,\n  \"height\": %d,\n  \"damage\": %s,\n",
+            width, height, damage ? "true" : "false");
+    fprintf(out, "  \"results\": [\n");
+    for (size_t n = 0; n < results.size(); n++) {
+        const BenchResult &r = results[n];
+        fprintf(out, "    {\n");
+        fprintf(out, "      \"sprites\": %d, \"uploads\": %d, \"partial_rows\": %d, \"fast\": %s, \"rotated\": %d, \"scale\": %g,\n",
+                r.config.sprites, r.config.uploads, r.config.partial_rows, r.config.fast ? "true" : "false",
+                r.config.rotated, r.config.scale);
+        fprintf(out, "      \"frames\": %d, \"time_sec\": %f, \"fps\": %f,\n",
+                r.frames, r.sec, r.sec > 0 ? r.frames / r.sec : 0.0);
+        fprintf(out, "      \"checksum\": \"%08x\", \"dirty_area_percent\": %.2f, \"upload_mb_per_sec\": %.2f,\n",
+                (unsigned)r.checksum, r.dirty_percent, r.upload_mb_per_sec);
+        fprintf(out, "      \"submitted\": %.1f, \"culled\": %.1f,\n", r.submitted, r.culled);
+        fprintf(out, "      \"phases_ms\": {\n");
+        for (int phase = 0; phase < PHASE_COUNT; phase++) {
+            fprintf(out, "        \"%s\": { \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }%s\n",
+                    FrameProfiler::GetPhaseName(phase),
+                    r.times[phase][0], r.times[phase][1], r.times[phase][2],
+                    phase + 1 < PHASE_COUNT ? "," : "");
+        }
+        fprintf(out, "      }\n");
+        fprintf(out, "    }%s\n", n + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Renders frames with SoftRenderer instead of uiArea. No display is required.
+// Options marked with <list> take comma-separated values (e.g. --sprites 100,1000,14400),
+// and every combination of them is run as a sweep.
+// usage: sprites_bench --headless [--frames N | --duration <sec>] [--warmup N]
+//                                 [--sprites <list>] [--uploads <list>] [--partial-rows <list>] [--fast [<list>]]
+//                                 [--rotated <list>] [--scale <list>]
+//                                 [--no-axis-aligned] [--compare] [--damage]
+//                                 [--sprite-array] [--compare-layouts]
+//                                 [--rotation-cache [<steps>]] [--cache-mb N] [--cache-prepare] [--compare-cache]
+//                                 [--scaled-levels] [--compare-levels] [--cull] [--tile-size N]
+//                                 [--compositor [<threads>]] [--compositor-tile N] [--compare-threads]
+//                                 [--cached-group] [--compare-group] [--instanced]
+//                                 [--render-queue] [--compare-sort]
+//                                 [--format text|csv|json] [--output <file>] [--label <text>]
+//                                 [--width N] [--height N] [--dump <file.ppm>]
+static int RunHeadless(int argc, char *argv[])
+{
+    int frames = 10;
+    double duration = 0.0;
+    int warmup = 0;
+    int width = 600;
+    int height = 600;
+    int compare = 0;
+    int damage = 0;
+    int compare_layouts = 0;
+    int rotation_cache = 0;
+    int cache_prepare = 0;
+    int compare_cache = 0;
+    int compare_levels = 0;
+    int compositor = 0;
+    int compare_threads = 0;
+    int compare_group = 0;
+    int compare_sort = 0;
+    const char *dump_file = NULL;
+    const char *output_file = NULL;
+    std::string format = "text";
+    std::string label;
+    std::vector<double> sprite_list = { 14400 };
+    std::vector<double> upload_list = { 0 };
+    std::vector<double> partial_list = { 0 };
+    std::vector<double> fast_list = { 0 };
+    std::vector<double> rotated_list = { 100 };
+    std::vector<double> scale_list = { 2.0 };
+
+    for (int i = 2; i < argc; i++) {
+        const char *arg = argv[i];
+        int has_value = i + 1 < argc;
+        int bad_list = 0;
+        if (strcmp(arg, "--fast") == 0) {
+            // --fast without a list means --fast 1
+            if (has_value && strncmp(argv[i + 1], "--", 2) != 0)
+                bad_list = ParseList(argv[++i], &fast_list);
+            else
+                fast_list = { 1 };
+        } else if (strcmp(arg, "--no-axis-aligned") == 0) {
+            g_sprite_handler.SetAxisAlignedPath(0);
+        } else if (strcmp(arg, "--damage") == 0) {
+            damage = 1;
+        } else if (strcmp(arg, "--sprite-array") == 0) {
+            g_sprite_handler.SetUseSpriteArray(1);
+        } else if (strcmp(arg, "--compare-layouts") == 0) {
+            compare_layouts = 1;
+        } else if (strcmp(arg, "--rotation-cache") == 0) {
+            // --rotation-cache without steps uses the default steps
+            rotation_cache = 1;
+            if (has_value && strncmp(argv[i + 1], "--", 2) != 0)
+                g_sprite_handler.GetRotationCache().SetSteps(std::max(atoi(argv[++i]), 1));
+        } else if (strcmp(arg, "--cache-mb") == 0 && has_value) {
+            g_sprite_handler.GetRotationCache().SetMaxBytes((size_t)(atof(argv[++i]) * 1024 * 1024));
+        } else if (strcmp(arg, "--cache-prepare") == 0) {
+            cache_prepare = 1;
+        } else if (strcmp(arg, "--compare-cache") == 0) {
+            compare_cache = 1;
+        } else if (strcmp(arg, "--scaled-levels") == 0) {
+            g_sprite_handler.SetUseScaledLevels(1);
+        } else if (strcmp(arg, "--compare-levels") == 0) {
+            compare_levels = 1;
+        } else if (strcmp(arg, "--cull") == 0) {
+            g_sprite_handler.SetCulling(1);
+        } else if (strcmp(arg, "--tile-size") == 0 && has_value) {
+            g_sprite_handler.SetTileSize(std::max(atoi(argv[++i]), 0));
+        } else if (strcmp(arg, "--compositor") == 0) {
+            // --compositor without threads uses all hardware threads
+            compositor = 1;
+            int threads = 0;
+            if (has_value && strncmp(argv[i + 1], "--", 2) != 0)
+                threads = std::max(atoi(argv[++i]), 0);
+            g_sprite_handler.SetCompositor(1, threads);
+        } else if (strcmp(arg, "--compositor-tile") == 0 && has_value) {
+            g_sprite_handler.GetCompositor().SetTileSize(atoi(argv[++i]));
+        } else if (strcmp(arg, "--compare-threads") == 0) {
+            compare_threads = 1;
+        } else if (strcmp(arg, "--cached-group") == 0) {
+            g_sprite_handler.SetUseGroup(1);
+        } else if (strcmp(arg, "--compare-group") == 0) {
+            compare_group = 1;
+        } else if (strcmp(arg, "--instanced") == 0) {
+            g_sprite_handler.SetUseInstances(1);
+        } else if (strcmp(arg, "--render-queue") == 0) {
+            g_sprite_handler.SetUseQueue(1);
+        } else if (strcmp(arg, "--compare-sort") == 0) {
+            compare_sort = 1;
+        } else if (strcmp(arg, "--compare") == 0) {
+            compare = 1;
+        } else if (strcmp(arg, "--frames") == 0 && has_value) {
+            frames = atoi(argv[++i]);
+        } else if (strcmp(arg, "--duration") == 0 && has_value) {
+            duration = atof(argv[++i]);
+        } else if (strcmp(arg, "--warmup") == 0 && has_value) {
+            warmup = atoi(argv[++i]);
+        } else if (strcmp(arg, "--sprites") == 0 && has_value) {
+            bad_list = ParseList(argv[++i], &sprite_list);
+        } else if (strcmp(arg, "--uploads") == 0 && has_value) {
+            bad_list = ParseList(argv[++i], &upload_list);
+        } else if (strcmp(arg, "--partial-rows") == 0 && has_value) {
+            bad_list = ParseList(argv[++i], &partial_list);
+        } else if (strcmp(arg, "--rotated") == 0 && has_value) {
+            bad_list = ParseList(argv[++i], &rotated_list);
+        } else if (strcmp(arg, "--scale") == 0 && has_value) {
+            bad_list = ParseList(argv[++i], &scale_list);
+        } else if (strcmp(arg, "--format") == 0 && has_value) {
+            format = argv[++i];
+        } else if (strcmp(arg, "--output") == 0 && has_value) {
+            output_file = argv[++i];
+        } else if (strcmp(arg, "--label") == 0 && has_value) {
+            label = argv[++i];
+        } else if (strcmp(arg, "--width") == 0 && has_value) {
+            width = atoi(argv[++i]);
+        } else if (strcmp(arg, "--height") == 0 && has_value) {
+            height = atoi(argv[++i]);
+        } else if (strcmp(arg, "--dump") == 0 && has_value) {
+            dump_file = argv[++i];
+        } else {
+            fprintf(stderr, "Unknown option: %s\n", arg);
+            return 1;
+        }
+        if (bad_list) {
+            fprintf(stderr, "Invalid list for %s: %s\n", arg, argv[i]);
+            return 1;
+        }
+    }
+    if (damage && g_sprite_handler.IsUsingSpriteArray()) {
+        fprintf(stderr, "--damage doesn't support --sprite-array.\n");
+        return 1;
+    }
+    if ((rotation_cache || compare_cache) && g_sprite_handler.IsUsingSpriteArray()) {
+        fprintf(stderr, "--rotation-cache doesn't support --sprite-array.\n");
+        return 1;
+    }
+    if ((g_sprite_handler.IsUsingScaledLevels() || compare_levels) && g_sprite_handler.IsUsingSpriteArray()) {
+        fprintf(stderr, "--scaled-levels doesn't support --sprite-array.\n");
+        return 1;
+    }
+    if (g_sprite_handler.IsCulling() && g_sprite_handler.IsUsingSpriteArray()) {
+        fprintf(stderr, "--cull doesn't support --sprite-array.\n");
+        return 1;
+    }
+    if (g_sprite_handler.GetTileSize() > 0) {
+        int has_uploads = 0;
+        for (double uploads : upload_list)
+            has_uploads |= uploads != 0;
+        if (has_uploads || rotation_cache || compare_cache || compare_layouts ||
+                g_sprite_handler.IsUsingScaledLevels() || compare_levels || g_sprite_handler.IsUsingSpriteArray()) {
+            fprintf(stderr, "--tile-size doesn't support uploads, --rotation-cache, --scaled-levels, or --sprite-array.\n");
+            return 1;
+        }
+    }
+    if (compositor || compare_threads) {
+        if (damage || g_sprite_handler.IsUsingSpriteArray() || rotation_cache || compare_cache ||
+                !g_sprite_handler.IsAxisAlignedPath() || compare) {
+            fprintf(stderr, "--compositor doesn't support --damage, --sprite-array, --rotation-cache, --no-axis-aligned, or --compare.\n");
+            return 1;
+        }
+    }
+    if (g_sprite_handler.IsUsingGroup() || compare_group) {
+        if (damage || g_sprite_handler.IsUsingSpriteArray() || g_sprite_handler.GetTileSize() > 0 ||
+                compositor || compare_threads || g_sprite_handler.IsCulling()) {
+            fprintf(stderr, "--cached-group doesn't support --damage, --sprite-array, --tile-size, --compositor, or --cull.\n");
+            return 1;
+        }
+    }
+    if (g_sprite_handler.IsUsingQueue()) {
+        if (damage || g_sprite_handler.IsUsingSpriteArray() || compositor || compare_threads ||
+                g_sprite_handler.IsUsingGroup() || compare_group || g_sprite_handler.IsCulling()) {
+            fprintf(stderr, "--render-queue doesn't support --damage, --sprite-array, --compositor, --cached-group, or --cull.\n");
+            return 1;
+        }
+    }
+    if (g_sprite_handler.IsUsingInstances()) {
+        if (damage || g_sprite_handler.IsUsingSpriteArray() || compositor || compare_threads ||
+                g_sprite_handler.IsUsingGroup() || compare_group || g_sprite_handler.IsCulling()) {
+            fprintf(stderr, "--instanced doesn't support --damage, --sprite-array, --compositor, --cached-group, or --cull.\n");
+            return 1;
+        }
+    }
+    if (format != "text" && format != "csv" && format != "json") {
+        fprintf(stderr, "Unknown format: %s\n", format.c_str());
+        return 1;
+    }
+
+    // Open the output before changing cwd to read image files
+    FILE *out = stdout;
+    if (output_file) {
+        out = fopen(output_file, "w");
+        if (!out) {
+            fprintf(stderr, "Failed to open %s\n", output_file);
+            return 1;
+        }
+    }
+    SetCwd(GetDirectory(GetExecutablePath()));
+
+    g_sprite_handler.LoadSprites(NULL);
+    if (g_sprite_handler.HasError()) {
+        fprintf(stderr, "Failed to load sprites. %s\n", g_sprite_handler.GetErrorMsg());
+        if (out != stdout) fclose(out);
+        return 1;
+    }
+
+    SoftRenderer renderer;
+    renderer.Resize(width, height);
+
+    if (compare_layouts) {
+        CompareLayouts(frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+
+    if (compare_sort) {
+        CompareSort(frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+
+    if (compare_levels) {
+        BenchConfig config = { (int)sprite_list[0], 0, 0, (int)fast_list[0], (int)rotated_list[0], 1.0 };
+        ApplyConfig(renderer, config, damage);
+        CompareScaledLevels(renderer, frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+    g_sprite_handler.ApplyScaledLevels(NULL);
+
+    if (compare_cache) {
+        BenchConfig config = { (int)sprite_list[0], 0, 0, (int)fast_list[0], 100, scale_list[0] };
+        ApplyConfig(renderer, config, damage);
+        CompareRotationCache(renderer, frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+
+    if (rotation_cache) {
+        g_sprite_handler.SetUseRotationCache(1);
+        if (cache_prepare) {
+            // fast is a part of the key, so prepare variants for all values in the sweep
+            for (double fast : fast_list) {
+                g_sprite_handler.SetFast(fast != 0);
+                g_sprite_handler.PrepareRotationCache(NULL);
+            }
+        }
+    }
+
+    if (compare_group) {
+        BenchConfig config = { (int)sprite_list[0], 0, 0, (int)fast_list[0], 0, scale_list[0] };
+        ApplyConfig(renderer, config, damage);
+        CompareGroup(renderer, frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+
+    if (compare_threads) {
+        BenchConfig config = { (int)sprite_list[0], (int)upload_list[0], (int)partial_list[0],
+                               (int)fast_list[0], (int)rotated_list[0], scale_list[0] };
+        ApplyConfig(renderer, config, damage);
+        CompareThreads(renderer, frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+
+    if (compare) {
+        BenchConfig config = { (int)sprite_list[0], (int)upload_list[0], (int)partial_list[0],
+                               (int)fast_list[0], 100, scale_list[0] };
+        ApplyConfig(renderer, config, damage);
+        g_sprite_handler.GetProfiler() = FrameProfiler(frames);
+        CompareDrawPaths(renderer, frames);
+        if (out != stdout) fclose(out);
+        return 0;
+    }
+
+    std::vector<BenchResult> results;
+    for (double sprites : sprite_list)
+    for (double uploads : upload_list)
+    for (double partial_rows : partial_list)
+    for (double fast : fast_list)
+    for (double rotated : rotated_list)
+    for (double scale : scale_list) {
+        BenchConfig config = { (int)sprites, (int)uploads, (int)partial_rows,
+                               fast != 0, (int)rotated, scale };
+        BenchResult result;
+        RunConfig(renderer, config, frames, duration, warmup, damage, &result);
+        results.push_back(result);
+    }
+
+    if (format == "csv")
+        PrintCsv(out, results, label);
+    else if (format == "json")
+        PrintJson(out, results, label, width, height, damage);
+    else
+        PrintText(out, results, damage);
+    if (out != stdout) fclose(out);
+
+    if (dump_file && renderer.SaveAsPpm(dump_file)) {
+        fprintf(stderr, "Failed to save %s\n", dump_file);
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+        return RunHeadless(argc, argv);
+
     // Initialize libui
     uiInitOptions options;
     const char *err;
@@ -0,0 +1,67 @@
+#include <string.h>
+#include "compact_image.hpp"
+#include "png_reader.hpp"
+
+// Formats smaller than RGBA. Others are converted to RGBA when loading.
+static int is_compact(PIXEL_FORMAT format)
+{
+    return format == PIXEL_FORMAT_GRAY8 || format == PIXEL_FORMAT_GRAY_ALPHA8 ||
+           format == PIXEL_FORMAT_RGB8 || format == PIXEL_FORMAT_INDEXED8;
+}
+
+int CompactImage::LoadFromPng(const char *file)
+{
+    PngReader reader;
+    if (reader.ReadHeader(file)) return 1;
+
+    int width, height;
+    reader.GetSize(&width, &height);
+    PIXEL_FORMAT format = reader.GetPixelFormat();
+    if (!is_compact(format))
+        format = PIXEL_FORMAT_RGBA8;
+
+    size_t row_size = (size_t)width * GetPixelFormatSize(format);
+    std::vector<unsigned char> pixels(row_size * height);
+    int ret;
+    if (format == PIXEL_FORMAT_RGBA8)
+        ret = reader.DecodeInto(pixels.data(), row_size);
+    else
+        ret = reader.DecodeNativeInto(pixels.data(), row_size);
+    if (ret) return 1;
+
+    m_palette.clear();
+    if (format == PIXEL_FORMAT_INDEXED8)
+        m_palette.assign(reader.GetPalette(), reader.GetPalette() + 256 * 4);
+    m_pixels.swap(pixels);
+    m_format = format;
+    m_width = width;
+    m_height = height;
+    m_has_alpha = reader.HasAlpha();
+    return 0;
+}
+
+void CompactImage::SetRgba(const unsigned char *pixels, int width, int height, int stride, int has_alpha)
+{
+    size_t row_size = (size_t)width * 4;
+    m_pixels.resize(row_size * height);
+    for (int y = 0; y < height; y++)
+        memcpy(&m_pixels[y * row_size], pixels + (size_t)y * stride, row_size);
+    m_palette.clear();
+    m_format = PIXEL_FORMAT_RGBA8;
+    m_width = width;
+    m_height = height;
+    m_has_alpha = has_alpha;
+}
+
+void CompactImage::ConvertRect(const uiRect &rect, unsigned char *dst, size_t stride)
+{
+    size_t pixel_size = GetPixelFormatSize(m_format);
+    const unsigned char *palette = m_palette.empty() ? NULL : m_palette.data();
+
+    // RGBA pixels are premultiplied already
+    int premultiply = m_format != PIXEL_FORMAT_RGBA8;
+    for (int y = 0; y < rect.Height; y++) {
+        const unsigned char *src = &m_pixels[((size_t)(rect.Y + y) * m_width + rect.X) * pixel_size];
+        ConvertToRgba(m_format, src, dst + y * stride, rect.Width, premultiply, palette);
+    }
+}
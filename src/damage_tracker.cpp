@@ -0,0 +1,134 @@
+#include <string.h>
+#include <algorithm>
+#include "damage_tracker.hpp"
+#include "rect_utils.hpp"
+
+void DamageTracker::Resize(int width, int height)
+{
+    m_width = width;
+    m_height = height;
+    SetTileSize(m_tile_size);
+}
+
+void DamageTracker::SetCapacity(int count)
+{
+    uiRect empty = { 0, 0, 0, 0 };
+    m_prev_bounds.resize(count, empty);
+    m_tracked.resize(count, 0);
+}
+
+void DamageTracker::SetTileSize(int tile_size)
+{
+    m_tile_size = std::max(tile_size, 1);
+    m_tiles_x = (m_width + m_tile_size - 1) / m_tile_size;
+    m_tiles_y = (m_height + m_tile_size - 1) / m_tile_size;
+    m_tiles.assign((size_t)m_tiles_x * m_tiles_y, 0);
+    m_full = 1;
+}
+
+void DamageTracker::MarkTiles(const uiRect &rect)
+{
+    uiRect area = { 0, 0, m_width, m_height };
+    uiRect r = IntersectRect(rect, area);
+    if (IsRectEmpty(r)) return;
+    int tx0 = r.X / m_tile_size;
+    int ty0 = r.Y / m_tile_size;
+    int tx1 = (r.X + r.Width - 1) / m_tile_size;
+    int ty1 = (r.Y + r.Height - 1) / m_tile_size;
+    for (int ty = ty0; ty <= ty1; ty++)
+        memset(&m_tiles[(size_t)ty * m_tiles_x + tx0], 1, tx1 - tx0 + 1);
+}
+
+void DamageTracker::AddRect(const uiRect &rect)
+{
+    if (!m_full) MarkTiles(rect);
+}
+
+void DamageTracker::Track(int id, const uiRect &bounds, int image_changed)
+{
+    if ((size_t)id >= m_prev_bounds.size())
+        SetCapacity(id + 1);
+    uiRect &prev = m_prev_bounds[id];
+    if (image_changed || !m_tracked[id] || !RectsEqual(prev, bounds)) {
+        AddRect(prev);
+        AddRect(bounds);
+    }
+    prev = bounds;
+    m_tracked[id] = 2;  // tracked in this frame
+}
+
+void DamageTracker::Finish()
+{
+    uiRect empty = { 0, 0, 0, 0 };
+    for (size_t id = 0; id < m_tracked.size(); id++) {
+        if (m_tracked[id] == 2) {
+            m_tracked[id] = 1;
+        } else if (m_tracked[id] == 1) {
+            // removed or hidden in this frame
+            AddRect(m_prev_bounds[id]);
+            m_prev_bounds[id] = empty;
+            m_tracked[id] = 0;
+        }
+    }
+
+    m_rects.clear();
+    if (m_full) {
+        uiRect area = { 0, 0, m_width, m_height };
+        if (!IsRectEmpty(area))
+            m_rects.push_back(area);
+        m_full = 0;
+        return;
+    }
+
+    // Runs of dirty tiles in a row become rects.
+    // A run is merged into the rect above when they have the same span.
+    std::vector<size_t> open;  // rects that end at the previous row
+    std::vector<size_t> next_open;
+    for (int ty = 0; ty < m_tiles_y; ty++) {
+        unsigned char *row = &m_tiles[(size_t)ty * m_tiles_x];
+        next_open.clear();
+        int tx = 0;
+        while (tx < m_tiles_x) {
+            if (!row[tx]) {
+                tx++;
+                continue;
+            }
+            int begin = tx;
+            while (tx < m_tiles_x && row[tx]) tx++;
+
+            uiRect run = { begin * m_tile_size, ty * m_tile_size,
+                           (tx - begin) * m_tile_size, m_tile_size };
+            size_t i = 0;
+            while (i < open.size() &&
+                   (m_rects[open[i]].X != run.X || m_rects[open[i]].Width != run.Width))
+                i++;
+            if (i < open.size()) {
+                m_rects[open[i]].Height += m_tile_size;
+                next_open.push_back(open[i]);
+            } else {
+                next_open.push_back(m_rects.size());
+                m_rects.push_back(run);
+            }
+        }
+        open.swap(next_open);
+        memset(row, 0, m_tiles_x);
+    }
+
+    uiRect area = { 0, 0, m_width, m_height };
+    if ((int)m_rects.size() > m_max_rects) {
+        uiRect bounds = { 0, 0, 0, 0 };
+        for (const uiRect &r : m_rects)
+            bounds = UnionRect(bounds, r);
+        m_rects.assign(1, bounds);
+    }
+    for (uiRect &r : m_rects)
+        r = IntersectRect(r, area);
+}
+
+long long DamageTracker::GetDirtyArea()
+{
+    long long area = 0;
+    for (const uiRect &r : m_rects)
+        area += (long long)r.Width * r.Height;
+    return area;
+}
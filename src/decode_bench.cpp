@@ -0,0 +1,213 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#ifdef __linux__
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include "decode_pool.hpp"
+#include "png_decoder_pool.hpp"
+#include "sprite_pack.hpp"
+#include "env_utils.hpp"  // GetExecutablePath(), SetCwd(), GetDirectory()
+
+// Measures wall time to decode PNG files with DecodePool for each thread count.
+// usage: decode_bench [-r repeat] [png files...]
+//        decode_bench --compare-pack [-r repeat]
+//        decode_bench --pool [-r rounds] [png files...]
+// The sprites of the demo are used when no files are specified.
+
+static const char *DEFAULT_FILES[] = {
+    "sprites/car-running.png",
+    "sprites/back.png",
+    "sprites/buildings.png",
+    "sprites/highway.png",
+    "sprites/palms.png",
+    "sprites/palm-tree.png"
+};
+
+static const char *DEFAULT_PACK = "sprites/sprites.spk";
+
+// Drops a file from the page cache, so the next read comes from the disk.
+// It's best-effort and only works on Linux. Elsewhere, cold runs may hit the cache.
+static void EvictFromCache(const char *file)
+{
+#ifdef __linux__
+    int fd = open(file, O_RDONLY);
+    if (fd < 0) return;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+#endif
+}
+
+static double GetElapsedMs(std::chrono::steady_clock::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+// Decodes and premultiplies the PNG files as the demo does without a pack.
+// Returns a negative value on failure.
+static double LoadPngs(const std::vector<const char *> &files)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    DecodePool pool;
+    std::vector<PngReader> readers;
+    int failed_index;
+    if (pool.DecodeAll(files.data(), (int)files.size(), &readers, &failed_index))
+        return -1;
+    return GetElapsedMs(start);
+}
+
+// Maps the pack and reads every pixel once as an upload would.
+static double LoadPack(const char *pack_file, uint32_t *sum)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    SpritePack pack;
+    if (pack.Open(pack_file)) return -1;
+    for (int p = 0; p < pack.GetPageCount(); p++) {
+        int width, height, stride;
+        const unsigned char *pixels = pack.GetPagePixels(p, &width, &height, &stride);
+        for (int y = 0; y < height; y++) {
+            const uint32_t *row = (const uint32_t *)(pixels + (size_t)y * stride);
+            for (int x = 0; x < width; x++)
+                *sum += row[x];
+        }
+    }
+    return GetElapsedMs(start);
+}
+
+// Compares cold and warm loads of the PNG files and the sprite pack
+static int ComparePack(const char *pack_file, int repeat)
+{
+    std::vector<const char *> files(DEFAULT_FILES, DEFAULT_FILES + sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]));
+    for (const char *file : files)
+        EvictFromCache(file);
+    EvictFromCache(pack_file);
+
+    uint32_t sum = 0;
+    double png_cold = LoadPngs(files);
+    double pack_cold = LoadPack(pack_file, &sum);
+    if (png_cold < 0 || pack_cold < 0) {
+        fprintf(stderr, "Failed to load %s\n", png_cold < 0 ? "PNG files" : pack_file);
+        return 1;
+    }
+
+    double png_warm = 0;
+    double pack_warm = 0;
+    for (int r = 0; r < repeat; r++) {
+        png_warm += LoadPngs(files);
+        pack_warm += LoadPack(pack_file, &sum);
+    }
+    png_warm /= repeat;
+    pack_warm /= repeat;
+
+    printf("path  cold(ms)  warm(ms)\n");
+    printf("png   %8.3f  %8.3f\n", png_cold, png_warm);
+    printf("pack  %8.3f  %8.3f\n", pack_cold, pack_warm);
+    printf("speedup: %.2fx cold, %.2fx warm (pixel sum: %08x)\n",
+           png_cold / pack_cold, png_warm / pack_warm, (unsigned)sum);
+    return 0;
+}
+
+// Decodes the files for some rounds with PngReader and PngDecoderPool.
+// Images of a round are freed before the next one as reloads do,
+// so the pool should allocate nothing after the first round.
+static int ComparePool(const std::vector<const char *> &files, int rounds)
+{
+    PngDecoderPool decoder;
+    printf("round  reader(ms)  pool(ms)  allocations  bytes\n");
+    for (int r = 0; r < rounds; r++) {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        {
+            std::vector<PngReader> readers(files.size());
+            for (size_t i = 0; i < files.size(); i++) {
+                if (readers[i].ReadFromFile(files[i])) {
+                    fprintf(stderr, "Failed to decode %s\n", files[i]);
+                    return 1;
+                }
+            }
+        }
+        double reader_ms = GetElapsedMs(start);
+
+        long long allocations = decoder.GetAllocations();
+        long long bytes = decoder.GetAllocatedBytes();
+        start = std::chrono::steady_clock::now();
+        {
+            std::vector<DecodedPng> images(files.size());
+            for (size_t i = 0; i < files.size(); i++) {
+                if (decoder.Decode(files[i], &images[i])) {
+                    fprintf(stderr, "Failed to decode %s\n", files[i]);
+                    return 1;
+                }
+            }
+        }
+        double pool_ms = GetElapsedMs(start);
+        printf("%5d  %10.3f  %8.3f  %11lld  %lld\n", r, reader_ms, pool_ms,
+               decoder.GetAllocations() - allocations, decoder.GetAllocatedBytes() - bytes);
+    }
+    printf("requests: %lld, reused: %lld\n", decoder.GetRequests(), decoder.GetReuses());
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int repeat = 32;
+    int compare_pack = 0;
+    int compare_pool = 0;
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+            repeat = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--compare-pack") == 0)
+            compare_pack = 1;
+        else if (strcmp(argv[i], "--pool") == 0)
+            compare_pool = 1;
+        else
+            files.push_back(argv[i]);
+    }
+    if (compare_pack) {
+        // the sprites of the demo and the pack built from them
+        SetCwd(GetDirectory(GetExecutablePath()));
+        return ComparePack(DEFAULT_PACK, std::max(repeat, 1));
+    }
+    if (files.empty()) {
+        SetCwd(GetDirectory(GetExecutablePath()));
+        files.assign(DEFAULT_FILES, DEFAULT_FILES + sizeof(DEFAULT_FILES) / sizeof(DEFAULT_FILES[0]));
+    }
+    if (compare_pool)
+        return ComparePool(files, std::max(repeat, 1));
+
+    // simulate a large asset set by decoding the same files many times
+    std::vector<const char *> queue;
+    for (int r = 0; r < repeat; r++)
+        queue.insert(queue.end(), files.begin(), files.end());
+
+    int max_threads = DecodePool().GetThreadNum();
+    std::vector<int> thread_nums;
+    for (int n = 1; n < max_threads; n *= 2)
+        thread_nums.push_back(n);
+    thread_nums.push_back(max_threads);
+
+    printf("images: %d, hardware threads: %d\n", (int)queue.size(), max_threads);
+    printf("threads  time(ms)  speedup\n");
+    double base = 0;
+    for (int n : thread_nums) {
+        DecodePool pool(n);
+        std::vector<PngReader> readers;
+        int failed_index;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int ret = pool.DecodeAll(queue.data(), (int)queue.size(), &readers, &failed_index);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        if (ret) {
+            fprintf(stderr, "Failed to decode %s\n", queue[failed_index]);
+            return 1;
+        }
+        double ms = elapsed.count();
+        if (n == 1) base = ms;
+        printf("%7d  %8.2f  %6.2fx\n", n, ms, base / ms);
+    }
+    return 0;
+}
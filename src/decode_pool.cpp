@@ -0,0 +1,43 @@
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include "decode_pool.hpp"
+
+DecodePool::DecodePool(int thread_num) : m_thread_num(thread_num)
+{
+    if (m_thread_num <= 0)
+        m_thread_num = std::max((int)std::thread::hardware_concurrency(), 1);
+}
+
+int DecodePool::DecodeAll(const char *const *files, int count,
+                          std::vector<PngReader> *readers, int *failed_index,
+                          int premultiply)
+{
+    // PngReader frees its buffer in the destructor,
+    // so the vector should not be resized after decoding.
+    readers->clear();
+    readers->resize(count);
+
+    std::vector<int> results(count, 0);
+    std::atomic<int> next(0);
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++)
+            results[i] = (*readers)[i].ReadFromFile(files[i], premultiply);
+    };
+
+    int thread_num = std::min(m_thread_num, count);
+    std::vector<std::thread> threads;
+    for (int i = 1; i < thread_num; i++)
+        threads.push_back(std::thread(worker));
+    worker();  // the calling thread works as well
+    for (std::thread &t : threads)
+        t.join();
+
+    for (int i = 0; i < count; i++) {
+        if (results[i]) {
+            *failed_index = i;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -88,3 +88,10 @@ std::string GetDirectory(const std::string& path) {
         ? ""
         : path.substr(0, pos);
 }
+
+std::string GetFileName(const std::string& path) {
+    size_t pos = path.find_last_of("/\\");
+    return (std::string::npos == pos)
+        ? path
+        : path.substr(pos + 1);
+}
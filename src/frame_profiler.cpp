@@ -0,0 +1,78 @@
+#include <algorithm>
+#include <cmath>
+#include "frame_profiler.hpp"
+
+FrameProfiler::FrameProfiler(int window_size)
+{
+    m_window_size = (size_t)std::max(window_size, 1);
+    Reset();
+}
+
+void FrameProfiler::Reset()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    for (int i = 0; i < PHASE_COUNT; i++) {
+        m_history[i].samples.assign(m_window_size, 0.0);
+        m_history[i].next = 0;
+        m_history[i].count = 0;
+        m_begin[i] = now;
+    }
+    m_marked = false;
+}
+
+void FrameProfiler::End(int phase)
+{
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - m_begin[phase];
+    AddSample(phase, elapsed.count());
+}
+
+void FrameProfiler::Mark()
+{
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    // The first call has no previous frame.
+    if (m_marked) {
+        std::chrono::duration<double, std::milli> elapsed = now - m_begin[PHASE_FRAME];
+        AddSample(PHASE_FRAME, elapsed.count());
+    }
+    m_begin[PHASE_FRAME] = now;
+    m_marked = true;
+}
+
+void FrameProfiler::AddSample(int phase, double ms)
+{
+    History &h = m_history[phase];
+    h.samples[h.next] = ms;
+    h.next = (h.next + 1) % m_window_size;
+    h.count = std::min(h.count + 1, m_window_size);
+}
+
+double FrameProfiler::GetPercentile(int phase, double p)
+{
+    History &h = m_history[phase];
+    if (h.count == 0) return 0.0;
+    std::vector<double> sorted(h.samples.begin(), h.samples.begin() + h.count);
+
+    // nearest-rank method
+    size_t rank = (size_t)std::ceil(p / 100.0 * sorted.size());
+    rank = std::min(std::max(rank, (size_t)1), sorted.size());
+    std::nth_element(sorted.begin(), sorted.begin() + (rank - 1), sorted.end());
+    return sorted[rank - 1];
+}
+
+double FrameProfiler::GetMean(int phase)
+{
+    History &h = m_history[phase];
+    if (h.count == 0) return 0.0;
+    double sum = 0.0;
+    for (size_t i = 0; i < h.count; i++)
+        sum += h.samples[i];
+    return sum / h.count;
+}
+
+const char *FrameProfiler::GetPhaseName(int phase)
+{
+    static const char *names[PHASE_COUNT] = { "step", "update", "draw", "frame" };
+    if (phase < 0 || phase >= PHASE_COUNT) return "unknown";
+    return names[phase];
+}
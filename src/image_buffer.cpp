@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "image_buffer.hpp"
+#include "soft_renderer.hpp"
+
+// 2x2 box filter of premultiplied RGBA.
+// Odd edges repeat the last row or column.
+static void downscale_half(const unsigned char *src, int src_width, int src_height,
+                           unsigned char *dst, int dst_width, int dst_height)
+{
+    for (int y = 0; y < dst_height; y++) {
+        const unsigned char *row0 = src + (size_t)(2 * y) * src_width * 4;
+        const unsigned char *row1 = src + (size_t)std::min(2 * y + 1, src_height - 1) * src_width * 4;
+        unsigned char *out = dst + (size_t)y * dst_width * 4;
+        for (int x = 0; x < dst_width; x++) {
+            int x0 = 2 * x * 4;
+            int x1 = std::min(2 * x + 1, src_width - 1) * 4;
+            for (int i = 0; i < 4; i++)
+                out[i] = (unsigned char)((row0[x0 + i] + row0[x1 + i] + row1[x0 + i] + row1[x1 + i] + 2) >> 2);
+            out += 4;
+        }
+    }
+}
+
+int ImageBuffer::BuildScaledLevels(uiDrawContext *c, int mip_levels, int max_upscale)
+{
+    FreeScaledLevels();
+    const unsigned char *pixels = GetCpuPixels();
+    if (!pixels) return 1;
+
+    // downscales from the previous level
+    const unsigned char *src = pixels;
+    int src_width = m_width;
+    int src_height = m_height;
+    double scale = 1.0;
+    std::vector<unsigned char> prev;
+    for (int i = 0; i < mip_levels && (src_width > 1 || src_height > 1); i++) {
+        int width = (src_width + 1) / 2;
+        int height = (src_height + 1) / 2;
+        std::vector<unsigned char> half((size_t)width * height * 4);
+        downscale_half(src, src_width, src_height, half.data(), width, height);
+        scale /= 2;
+
+        ImageBuffer *level = new ImageBuffer();
+        level->Create(c, width, height, m_has_alpha);
+        level->Update(half.data());
+        m_levels.push_back({ scale, level });
+
+        prev.swap(half);
+        src = prev.data();
+        src_width = width;
+        src_height = height;
+    }
+    std::reverse(m_levels.begin(), m_levels.end());
+
+    // upscales with the bilinear filter of the software renderer
+    for (int factor = 2; factor <= max_upscale; factor++) {
+        SoftRenderer canvas;
+        canvas.Resize(m_width * factor, m_height * factor);  // transparent
+        uiRect dst = { 0, 0, m_width * factor, m_height * factor };
+        canvas.DrawImageAxisAligned(pixels, m_width, m_height, GetRect(), dst, 0);
+
+        ImageBuffer *level = new ImageBuffer();
+        level->Create(c, dst.Width, dst.Height, m_has_alpha);
+        level->Update(canvas.GetData());
+        m_levels.push_back({ (double)factor, level });
+    }
+    return 0;
+}
+
+void ImageBuffer::CreateTiled(int width, int height, int has_alpha, int tile_size)
+{
+    Free();
+    m_width = width;
+    m_height = height;
+    m_has_alpha = has_alpha;
+    m_tile_size = tile_size;
+    m_tile_cols = (width + tile_size - 1) / tile_size;
+    int tile_rows = (height + tile_size - 1) / tile_size;
+    for (int row = 0; row < tile_rows; row++) {
+        for (int col = 0; col < m_tile_cols; col++) {
+            ImageBuffer *tile = new ImageBuffer();
+            tile->m_width = std::min(tile_size, width - col * tile_size);
+            tile->m_height = std::min(tile_size, height - row * tile_size);
+            tile->m_has_alpha = has_alpha;
+            m_tiles.push_back(tile);
+        }
+    }
+}
+
+int ImageBuffer::CreateTiledFromPng(uiDrawContext *c, const char *file_name, int tile_size)
+{
+    PngReader reader;
+    if (reader.ReadHeader(file_name) || tile_size <= 0) return 1;
+
+    int width, height;
+    reader.GetSize(&width, &height);
+    CreateTiled(width, height, reader.HasAlpha(), tile_size);
+
+    // Lock() memory of the tiles in the current band
+    std::vector<unsigned char *> band(m_tile_cols);
+    int ret = reader.DecodeRows([&](int y, const unsigned char *row) {
+        int tile_row = y / tile_size;
+        int tile_y = y % tile_size;
+        int tile_height = std::min(tile_size, m_height - tile_row * tile_size);
+        ImageBuffer **tiles = &m_tiles[tile_row * m_tile_cols];
+        int stride;
+        for (int col = 0; col < m_tile_cols; col++) {
+            int tile_width = std::min(tile_size, m_width - col * tile_size);
+            if (tile_y == 0) {
+                tiles[col]->Create(c, tile_width, tile_height, m_has_alpha);
+                band[col] = tiles[col]->Lock(&stride);
+            }
+            memcpy(band[col] + (size_t)tile_y * tile_width * 4,
+                   row + (size_t)col * tile_size * 4, (size_t)tile_width * 4);
+        }
+        if (tile_y == tile_height - 1) {
+            for (int col = 0; col < m_tile_cols; col++) {
+                tiles[col]->Unlock();
+                tiles[col]->FreeCpuCopy();
+            }
+        }
+        return 0;
+    });
+    if (ret) {
+        FreeTiles();
+        return 1;
+    }
+    return 0;
+}
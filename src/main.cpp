@@ -1,12 +1,18 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <string>
 #include <cmath>
+#include <algorithm>
 #include "ui.h"
 #include "demo_sprites.hpp"  // DemoSpriteHandler
+#include "frame_scheduler.hpp"
 #include "env_utils.hpp"  // GetExecutablePath(), SetCwd(), GetDirectory()
 
 uiAreaHandler g_handler;
 DemoSpriteHandler g_sprite_handler;
+FrameScheduler g_scheduler(0.01);  // move sprites every 10ms
+uiWindow *g_mainwin;
 
 // helper to quickly set a brush color
 static void SetSolidBrush(uiDrawBrush *brush, uint32_t color, double alpha)
@@ -34,18 +40,39 @@ static void HandlerDraw(uiAreaHandler *a, uiArea *area, uiAreaDrawParams *p)
         if (g_sprite_handler.HasError()) return;
     }
 
-    // fill the area
+    // upload images loaded in the background
+    g_sprite_handler.ApplyUploads(p->Context);
+    if (g_sprite_handler.HasError()) return;
+
+    g_sprite_handler.SetAreaSize((int)p->AreaWidth, (int)p->AreaHeight);
+
+    // Only the clip rect needs to be painted.
+    // It is smaller than the area when the OS redraws a part of the window.
+    uiRect clip = {
+        (int)std::floor(p->ClipX),
+        (int)std::floor(p->ClipY),
+        (int)std::ceil(p->ClipX + p->ClipWidth) - (int)std::floor(p->ClipX),
+        (int)std::ceil(p->ClipY + p->ClipHeight) - (int)std::floor(p->ClipY)
+    };
+
+    // The compositor fills the background by itself
+    if (g_sprite_handler.IsUsingCompositor()) {
+        g_sprite_handler.DrawSprites(p->Context, clip, g_scheduler.GetAlpha());
+        return;
+    }
+
+    // fill the clip rect
     uiDrawPath *path;
     uiDrawBrush brush;
     SetSolidBrush(&brush, 0xEEEEEE, 1.0);
     path = uiDrawNewPath(uiDrawFillModeWinding);
-    uiDrawPathAddRectangle(path, 0, 0, p->AreaWidth, p->AreaHeight);
+    uiDrawPathAddRectangle(path, clip.X, clip.Y, clip.Width, clip.Height);
     uiDrawPathEnd(path);
     uiDrawFill(p->Context, path, &brush);
     uiDrawFreePath(path);
 
-    // draw sprites
-    g_sprite_handler.DrawSprites(p->Context);
+    // draw sprites in the clip rect
+    g_sprite_handler.DrawSprites(p->Context, clip, g_scheduler.GetAlpha());
 }
 
 static void HandlerMouseEvent(uiAreaHandler *a, uiArea *area, uiAreaMouseEvent *e)
@@ -91,10 +118,51 @@ static int OnShouldQuit(void *data)
     return 1;
 }
 
+// Shows loading progress or tile residency stats in the title bar
+static void UpdateTitle()
+{
+    static int loading = 0;
+    static double upload_rate = -1;
+    if (g_sprite_handler.IsLoading()) {
+        int uploaded, total;
+        g_sprite_handler.GetLoadProgress(&uploaded, &total);
+        std::string title = "libui sprites demo (loading " + std::to_string(uploaded) +
+            "/" + std::to_string(total) + ", queue: " +
+            std::to_string(g_sprite_handler.GetUploadQueueDepth()) + ", upload: " +
+            std::to_string(g_sprite_handler.GetLastUploadMs()) + " ms)";
+        uiWindowSetTitle(g_mainwin, title.c_str());
+        loading = 1;
+    } else if (loading) {
+        uiWindowSetTitle(g_mainwin, "libui sprites demo");
+        loading = 0;
+    } else if (g_sprite_handler.IsUsingResidency() && g_sprite_handler.HasImage()) {
+        // The rate is updated every second
+        TileResidency &residency = g_sprite_handler.GetResidency();
+        if (residency.GetUploadRate() != upload_rate) {
+            upload_rate = residency.GetUploadRate();
+            std::string title = "libui sprites demo (resident: " +
+                std::to_string(residency.GetResidentBytes() / 1024) + " KB, uploads/s: " +
+                std::to_string((int)upload_rate) + ", misses: " +
+                std::to_string(residency.GetMisses()) + ")";
+            uiWindowSetTitle(g_mainwin, title.c_str());
+        }
+    }
+}
+
 static int OnAnimating(void *data)
 {
-    g_sprite_handler.MoveSprites();
-    uiAreaQueueRedrawAll(uiArea(data));
+    UpdateTitle();
+
+    // The timer is not accurate. Run as many steps as the elapsed time needs.
+    int steps = g_scheduler.Advance();
+    for (int i = 0; i < steps; i++)
+        g_sprite_handler.MoveSprites();
+
+    // libui can only invalidate the whole area.
+    // So, skip frames that changed nothing, e.g. when sprites are stopped.
+    if (!g_sprite_handler.HasImage() || g_sprite_handler.IsLoading() ||
+        g_sprite_handler.HasDamage())
+        uiAreaQueueRedrawAll(uiArea(data));
     return 1;
 }
 
@@ -102,6 +170,7 @@ void CreateWindow()
 {
     // Main window
     uiWindow* mainwin = uiNewWindow("libui sprites demo", 800, 256, 1);
+    g_mainwin = mainwin;
     uiWindowOnClosing(mainwin, OnClosing, NULL);
     uiOnShouldQuit(OnShouldQuit, mainwin);
     uiWindowSetMargined(mainwin, 0);
@@ -121,7 +190,7 @@ void CreateWindow()
     uiArea *area = uiNewArea(&g_handler);
     uiBoxAppend(vbox, uiControl(area), 1);
 
-    // Call OnAnimating every 10ms to move sprites
+    // Call OnAnimating every 10ms to move sprites and redraw
     uiTimer(10, OnAnimating, area);
 
     // Make them visible and call HandlerDraw() to load sprites
@@ -132,8 +201,33 @@ void CreateWindow()
     }
 }
 
-int main(void)
+// usage: libui_sprites_demo [--async] [--upload-budget <ms>] [--residency <MB>] [--residency-tile <px>]
+//                           [--compositor <threads>]
+int main(int argc, char *argv[])
 {
+    int async = 0;
+    double upload_budget_ms = 2.0;
+    double residency_mb = 0;
+    int residency_tile = 64;
+    int compositor_threads = -1;  // -1 draws sprites with libui
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--async") == 0)
+            async = 1;
+        else if (strcmp(argv[i], "--upload-budget") == 0 && i + 1 < argc)
+            upload_budget_ms = atof(argv[++i]);
+        else if (strcmp(argv[i], "--residency") == 0 && i + 1 < argc)
+            residency_mb = atof(argv[++i]);
+        else if (strcmp(argv[i], "--residency-tile") == 0 && i + 1 < argc)
+            residency_tile = std::max(atoi(argv[++i]), 1);
+        else if (strcmp(argv[i], "--compositor") == 0 && i + 1 < argc)
+            compositor_threads = std::max(atoi(argv[++i]), 0);
+    }
+    g_sprite_handler.SetAsyncLoading(async, upload_budget_ms);
+    if (residency_mb > 0)
+        g_sprite_handler.SetResidency((size_t)(residency_mb * 1024 * 1024), residency_tile);
+    if (compositor_threads >= 0)
+        g_sprite_handler.SetCompositor(compositor_threads);
+
     // Initialize libui
     uiInitOptions options;
     const char *err;
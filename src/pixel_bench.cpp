@@ -0,0 +1,187 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+#include "pixel_convert.hpp"
+
+// Microbenchmark for pixel conversion kernels.
+// usage: pixel_bench [width] [height] [iterations]
+
+// The old conversion in PngReader::ReadFromFile, kept as a baseline
+static void premultiply_alpha_double(unsigned char *image, int width, int height)
+{
+    unsigned char *offset = image;
+    for (int i = 0; i < width * height; i++) {
+        double a = (double)offset[3] / 255.0;
+        double r = (double)offset[0] * a / 255.0;
+        double g = (double)offset[1] * a / 255.0;
+        double b = (double)offset[2] * a / 255.0;
+        offset[0] = (unsigned char)(r * 255.0);
+        offset[1] = (unsigned char)(g * 255.0);
+        offset[2] = (unsigned char)(b * 255.0);
+        offset += 4;
+    }
+}
+
+typedef void (*ConvertFunc)(unsigned char *pixels, size_t count);
+
+static double Measure(ConvertFunc func, const std::vector<unsigned char> &src,
+                      std::vector<unsigned char> &work, int iterations)
+{
+    size_t count = src.size() / 4;
+    double sec = 0;
+    for (int i = 0; i < iterations; i++) {
+        memcpy(work.data(), src.data(), src.size());
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        func(work.data(), count);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        sec += elapsed.count();
+    }
+    return (double)count * iterations / sec / 1000000.0;
+}
+
+// Converts count pixels of format in src to premultiplied RGBA
+static double MeasureFormat(PIXEL_FORMAT format, const std::vector<unsigned char> &src,
+                            std::vector<unsigned char> &dst, const unsigned char *palette,
+                            size_t count, int iterations)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+        ConvertToRgba(format, src.data(), dst.data(), count, 1, palette);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)count * iterations / elapsed.count() / 1000000.0;
+}
+
+// Compares format conversions of a kernel with the scalar ones.
+// The odd count covers the scalar tails of SIMD loops.
+static int VerifyFormats(PIXEL_KERNEL kernel)
+{
+    const size_t count = 1001;
+    std::vector<unsigned char> src(count * 8);
+    std::vector<unsigned char> palette(256 * 4);
+    for (unsigned char &c : src) c = (unsigned char)(rand() & 0xFF);
+    for (unsigned char &c : palette) c = (unsigned char)(rand() & 0xFF);
+    std::vector<unsigned char> expected(count * 4), actual(count * 4);
+    int ret = 0;
+    for (int f = 0; f < PIXEL_FORMAT_COUNT; f++) {
+        PIXEL_FORMAT format = (PIXEL_FORMAT)f;
+        SetPixelKernel(PIXEL_KERNEL_SCALAR);
+        ConvertToRgba(format, src.data(), expected.data(), count, 1, palette.data());
+        SetPixelKernel(kernel);
+        ConvertToRgba(format, src.data(), actual.data(), count, 1, palette.data());
+        if (actual != expected) ret = 1;
+    }
+    return ret;
+}
+
+// Compares a kernel with the scalar one for every (color, alpha) pair.
+static int Verify(PIXEL_KERNEL kernel)
+{
+    std::vector<unsigned char> expected(256 * 256 * 4);
+    for (int i = 0; i < 256 * 256; i++) {
+        expected[i * 4 + 0] = (unsigned char)(i & 0xFF);
+        expected[i * 4 + 1] = (unsigned char)(255 - (i & 0xFF));
+        expected[i * 4 + 2] = (unsigned char)((i * 7) & 0xFF);
+        expected[i * 4 + 3] = (unsigned char)(i >> 8);
+    }
+    std::vector<unsigned char> actual(expected);
+    ConvertFunc funcs[3] = { PremultiplyAlpha, UnpremultiplyAlpha, SwapRedBlue };
+    int ret = 0;
+    for (ConvertFunc func : funcs) {
+        std::vector<unsigned char> input(expected);
+        SetPixelKernel(PIXEL_KERNEL_SCALAR);
+        func(expected.data(), expected.size() / 4);
+        SetPixelKernel(kernel);
+        actual = input;
+        func(actual.data(), actual.size() / 4);
+        if (actual != expected) ret = 1;
+        expected = input;
+    }
+    return ret | VerifyFormats(kernel);
+}
+
+int main(int argc, char *argv[])
+{
+    int width = argc > 1 ? atoi(argv[1]) : 2048;
+    int height = argc > 2 ? atoi(argv[2]) : 2048;
+    int iterations = argc > 3 ? atoi(argv[3]) : 20;
+    if (width <= 0 || height <= 0 || iterations <= 0) {
+        fprintf(stderr, "usage: pixel_bench [width] [height] [iterations]\n");
+        return 1;
+    }
+
+    // sprite-like data: transparent, opaque, and translucent pixels
+    std::vector<unsigned char> src((size_t)width * height * 4);
+    srand(0);
+    for (size_t i = 0; i < src.size(); i += 4) {
+        int kind = rand() % 4;
+        src[i + 0] = (unsigned char)(rand() & 0xFF);
+        src[i + 1] = (unsigned char)(rand() & 0xFF);
+        src[i + 2] = (unsigned char)(rand() & 0xFF);
+        src[i + 3] = kind == 0 ? 0 : kind == 1 ? 255 : (unsigned char)(rand() & 0xFF);
+    }
+    std::vector<unsigned char> work(src.size());
+
+    printf("image: %dx%d, iterations: %d\n", width, height, iterations);
+    {
+        double sec = 0;
+        for (int i = 0; i < iterations; i++) {
+            memcpy(work.data(), src.data(), src.size());
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            premultiply_alpha_double(work.data(), width, height);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            sec += elapsed.count();
+        }
+        printf("%-8s premultiply: %8.1f MPix/s\n", "double",
+               (double)width * height * iterations / sec / 1000000.0);
+    }
+
+    PIXEL_KERNEL best = GetPixelKernel();
+    int ret = 0;
+    for (int k = 0; k < PIXEL_KERNEL_COUNT; k++) {
+        PIXEL_KERNEL kernel = (PIXEL_KERNEL)k;
+        const char *name = GetPixelKernelName(kernel);
+        if (!IsPixelKernelSupported(kernel)) {
+            printf("%-8s (not supported)\n", name);
+            continue;
+        }
+        if (Verify(kernel)) {
+            printf("%-8s mismatch with the scalar kernel!\n", name);
+            ret = 1;
+        }
+        SetPixelKernel(kernel);
+        printf("%-8s premultiply: %8.1f MPix/s, unpremultiply: %8.1f MPix/s, swizzle: %8.1f MPix/s\n",
+               name,
+               Measure(PremultiplyAlpha, src, work, iterations),
+               Measure(UnpremultiplyAlpha, src, work, iterations),
+               Measure(SwapRedBlue, src, work, iterations));
+    }
+
+    // conversions of decoded PNG rows to premultiplied RGBA
+    size_t count = (size_t)width * height;
+    std::vector<unsigned char> format_src(count * 8);
+    std::vector<unsigned char> palette(256 * 4);
+    for (unsigned char &c : format_src) c = (unsigned char)(rand() & 0xFF);
+    for (unsigned char &c : palette) c = (unsigned char)(rand() & 0xFF);
+    PremultiplyAlpha(palette.data(), 256);
+    printf("\nformat to premultiplied RGBA (MPix/s):\n%-13s", "");
+    for (int k = 0; k < PIXEL_KERNEL_COUNT; k++)
+        printf(" %8s", GetPixelKernelName((PIXEL_KERNEL)k));
+    printf("\n");
+    for (int f = 0; f < PIXEL_FORMAT_COUNT; f++) {
+        PIXEL_FORMAT format = (PIXEL_FORMAT)f;
+        printf("%-13s", GetPixelFormatName(format));
+        for (int k = 0; k < PIXEL_KERNEL_COUNT; k++) {
+            if (SetPixelKernel((PIXEL_KERNEL)k)) {
+                printf(" %8s", "-");
+                continue;
+            }
+            printf(" %8.1f", MeasureFormat(format, format_src, work, palette.data(), count, iterations));
+        }
+        printf("\n");
+    }
+    SetPixelKernel(best);
+    printf("selected kernel: %s\n", GetPixelKernelName(best));
+    return ret;
+}
@@ -0,0 +1,579 @@
+#include <stdint.h>
+#include <string.h>
+#include "pixel_convert.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PIXEL_CONVERT_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// scalar kernels
+
+static inline unsigned char mul_div255(uint32_t c, uint32_t a)
+{
+    uint32_t t = c * a + 128;
+    return (unsigned char)((t + (t >> 8)) >> 8);
+}
+
+static inline unsigned char unpremultiply_channel(uint32_t c, uint32_t a)
+{
+    uint32_t v = (c * 255 + a / 2) / a;
+    return (unsigned char)(v > 255 ? 255 : v);
+}
+
+static void premultiply_scalar(unsigned char *pixels, size_t count)
+{
+    unsigned char *offset = pixels;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t a = offset[3];
+        offset[0] = mul_div255(offset[0], a);
+        offset[1] = mul_div255(offset[1], a);
+        offset[2] = mul_div255(offset[2], a);
+        offset += 4;
+    }
+}
+
+static void unpremultiply_scalar(unsigned char *pixels, size_t count)
+{
+    unsigned char *offset = pixels;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t a = offset[3];
+        if (a == 0) {
+            offset[0] = offset[1] = offset[2] = 0;
+        } else if (a != 255) {
+            offset[0] = unpremultiply_channel(offset[0], a);
+            offset[1] = unpremultiply_channel(offset[1], a);
+            offset[2] = unpremultiply_channel(offset[2], a);
+        }
+        offset += 4;
+    }
+}
+
+static void swap_red_blue_scalar(unsigned char *pixels, size_t count)
+{
+    unsigned char *offset = pixels;
+    for (size_t i = 0; i < count; i++) {
+        unsigned char r = offset[0];
+        offset[0] = offset[2];
+        offset[2] = r;
+        offset += 4;
+    }
+}
+
+
+// format conversions
+
+static void rgb8_to_rgba_scalar(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[0] = src[0];
+        dst[1] = src[1];
+        dst[2] = src[2];
+        dst[3] = 255;
+        src += 3;
+        dst += 4;
+    }
+}
+
+static void gray8_to_rgba_scalar(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[0] = dst[1] = dst[2] = src[i];
+        dst[3] = 255;
+        dst += 4;
+    }
+}
+
+static void gray_alpha8_to_rgba_scalar(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        dst[0] = dst[1] = dst[2] = src[0];
+        dst[3] = src[1];
+        src += 2;
+        dst += 4;
+    }
+}
+
+static void indexed8_to_rgba_scalar(const unsigned char *src, unsigned char *dst, size_t count,
+                                    const unsigned char *palette)
+{
+    for (size_t i = 0; i < count; i++)
+        memcpy(dst + i * 4, palette + src[i] * 4, 4);
+}
+
+// round(v * 255 / 65535)
+static inline unsigned char sample16_to_8(const unsigned char *p)
+{
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return (unsigned char)((v + 128u) / 257u);
+}
+
+// 16-bit formats are rare, so they have scalar kernels only
+static void convert16_to_rgba(const unsigned char *src, unsigned char *dst, size_t count,
+                              int channels)
+{
+    for (size_t i = 0; i < count; i++) {
+        if (channels >= 3) {
+            dst[0] = sample16_to_8(src);
+            dst[1] = sample16_to_8(src + 2);
+            dst[2] = sample16_to_8(src + 4);
+            dst[3] = channels == 4 ? sample16_to_8(src + 6) : 255;
+        } else {
+            dst[0] = dst[1] = dst[2] = sample16_to_8(src);
+            dst[3] = channels == 2 ? sample16_to_8(src + 2) : 255;
+        }
+        src += channels * 2;
+        dst += 4;
+    }
+}
+
+#ifdef PIXEL_CONVERT_X86
+
+// SSE2 kernels (4 pixels per iteration)
+
+// c * a / 255 for 8 x 16-bit lanes of 2 pixels. Alpha lanes are kept as is.
+TARGET_SSE2
+static inline __m128i premultiply_2px_sse2(__m128i px)
+{
+    __m128i a = _mm_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm_or_si128(a, _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(px, a), _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+TARGET_SSE2
+static void premultiply_sse2(unsigned char *pixels, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p = (__m128i *)(pixels + i * 4);
+        __m128i v = _mm_loadu_si128(p);
+        __m128i lo = premultiply_2px_sse2(_mm_unpacklo_epi8(v, zero));
+        __m128i hi = premultiply_2px_sse2(_mm_unpackhi_epi8(v, zero));
+        _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+    }
+    premultiply_scalar(pixels + i * 4, count - i);
+}
+
+// (c * 255 + a / 2) / a for 4 x 32-bit lanes of a pixel.
+// The float division is exact enough to give the same result as integers.
+TARGET_SSE2
+static inline __m128i unpremultiply_1px_sse2(__m128i px)
+{
+    __m128i a = _mm_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 3));
+    __m128i num = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(px, 8), px), _mm_srli_epi32(a, 1));
+    __m128 fa = _mm_max_ps(_mm_cvtepi32_ps(a), _mm_set1_ps(1.0f));
+    __m128 q = _mm_min_ps(_mm_div_ps(_mm_cvtepi32_ps(num), fa), _mm_set1_ps(255.0f));
+    __m128i c = _mm_cvttps_epi32(q);
+    __m128i alpha_mask = _mm_set_epi32(-1, 0, 0, 0);
+    c = _mm_or_si128(_mm_andnot_si128(alpha_mask, c), _mm_and_si128(alpha_mask, px));
+    return _mm_andnot_si128(_mm_cmpeq_epi32(a, _mm_setzero_si128()), c);
+}
+
+TARGET_SSE2
+static void unpremultiply_sse2(unsigned char *pixels, size_t count)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p = (__m128i *)(pixels + i * 4);
+        __m128i v = _mm_loadu_si128(p);
+
+        // skip when all pixels are opaque
+        __m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(v, alpha), alpha);
+        if (_mm_movemask_epi8(opaque) == 0xFFFF) continue;
+
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i p0 = unpremultiply_1px_sse2(_mm_unpacklo_epi16(lo, zero));
+        __m128i p1 = unpremultiply_1px_sse2(_mm_unpackhi_epi16(lo, zero));
+        __m128i p2 = unpremultiply_1px_sse2(_mm_unpacklo_epi16(hi, zero));
+        __m128i p3 = unpremultiply_1px_sse2(_mm_unpackhi_epi16(hi, zero));
+        __m128i p01 = _mm_packs_epi32(p0, p1);
+        __m128i p23 = _mm_packs_epi32(p2, p3);
+        _mm_storeu_si128(p, _mm_packus_epi16(p01, p23));
+    }
+    unpremultiply_scalar(pixels + i * 4, count - i);
+}
+
+TARGET_SSE2
+static void swap_red_blue_sse2(unsigned char *pixels, size_t count)
+{
+    const __m128i ga_mask = _mm_set1_epi32((int)0xFF00FF00);
+    const __m128i rb_mask = _mm_set1_epi32(0x00FF00FF);
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i *p = (__m128i *)(pixels + i * 4);
+        __m128i v = _mm_loadu_si128(p);
+        __m128i rb = _mm_and_si128(v, rb_mask);
+        rb = _mm_or_si128(_mm_slli_epi32(rb, 16), _mm_srli_epi32(rb, 16));
+        _mm_storeu_si128(p, _mm_or_si128(_mm_and_si128(v, ga_mask), rb));
+    }
+    swap_red_blue_scalar(pixels + i * 4, count - i);
+}
+
+TARGET_SSE2
+static void gray8_to_rgba_sse2(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    const __m128i alpha = _mm_set1_epi32((int)0xFF000000);
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16) {
+        __m128i g = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i lo = _mm_unpacklo_epi8(g, g);
+        __m128i hi = _mm_unpackhi_epi8(g, g);
+        __m128i *p = (__m128i *)(dst + i * 4);
+        _mm_storeu_si128(p, _mm_or_si128(_mm_unpacklo_epi16(lo, lo), alpha));
+        _mm_storeu_si128(p + 1, _mm_or_si128(_mm_unpackhi_epi16(lo, lo), alpha));
+        _mm_storeu_si128(p + 2, _mm_or_si128(_mm_unpacklo_epi16(hi, hi), alpha));
+        _mm_storeu_si128(p + 3, _mm_or_si128(_mm_unpackhi_epi16(hi, hi), alpha));
+    }
+    gray8_to_rgba_scalar(src + i, dst + i * 4, count - i);
+}
+
+// 8 pixels per iteration
+TARGET_SSE2
+static void gray_alpha8_to_rgba_sse2(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    const __m128i gray_mask = _mm_set1_epi16(0x00FF);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m128i ga = _mm_loadu_si128((const __m128i *)(src + i * 2));
+        __m128i g = _mm_and_si128(ga, gray_mask);
+        __m128i gg = _mm_or_si128(g, _mm_slli_epi16(g, 8));
+        __m128i *p = (__m128i *)(dst + i * 4);
+        _mm_storeu_si128(p, _mm_unpacklo_epi16(gg, ga));
+        _mm_storeu_si128(p + 1, _mm_unpackhi_epi16(gg, ga));
+    }
+    gray_alpha8_to_rgba_scalar(src + i * 2, dst + i * 4, count - i);
+}
+
+// AVX2 kernels (8 pixels per iteration)
+
+TARGET_AVX2
+static inline __m256i premultiply_4px_avx2(__m256i px)
+{
+    __m256i a = _mm256_shufflelo_epi16(px, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+    a = _mm256_or_si256(a, _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0,
+                                            255, 0, 0, 0, 255, 0, 0, 0));
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(px, a), _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+}
+
+TARGET_AVX2
+static void premultiply_avx2(unsigned char *pixels, size_t count)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i *p = (__m256i *)(pixels + i * 4);
+        __m256i v = _mm256_loadu_si256(p);
+        __m256i lo = premultiply_4px_avx2(_mm256_unpacklo_epi8(v, zero));
+        __m256i hi = premultiply_4px_avx2(_mm256_unpackhi_epi8(v, zero));
+        _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+    }
+    premultiply_sse2(pixels + i * 4, count - i);
+}
+
+// 2 pixels as 8 x 32-bit lanes
+TARGET_AVX2
+static inline __m256i unpremultiply_2px_avx2(__m256i px)
+{
+    __m256i a = _mm256_shuffle_epi32(px, _MM_SHUFFLE(3, 3, 3, 3));
+    __m256i num = _mm256_add_epi32(_mm256_mullo_epi32(px, _mm256_set1_epi32(255)),
+                                   _mm256_srli_epi32(a, 1));
+    __m256 fa = _mm256_cvtepi32_ps(_mm256_max_epi32(a, _mm256_set1_epi32(1)));
+    __m256i c = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(num), fa));
+    c = _mm256_min_epi32(c, _mm256_set1_epi32(255));
+    c = _mm256_blend_epi32(c, px, 0x88);
+    return _mm256_andnot_si256(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()), c);
+}
+
+TARGET_AVX2
+static void unpremultiply_avx2(unsigned char *pixels, size_t count)
+{
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        unsigned char *p = pixels + i * 4;
+        __m256i v = _mm256_loadu_si256((__m256i *)p);
+
+        // skip when all pixels are opaque
+        __m256i opaque = _mm256_cmpeq_epi32(_mm256_and_si256(v, alpha), alpha);
+        if (_mm256_movemask_epi8(opaque) == -1) continue;
+
+        __m256i p01 = unpremultiply_2px_avx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)p)));
+        __m256i p23 = unpremultiply_2px_avx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(p + 8))));
+        __m256i p45 = unpremultiply_2px_avx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(p + 16))));
+        __m256i p67 = unpremultiply_2px_avx2(_mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)(p + 24))));
+
+        // packs work in 128-bit lanes, so pixels are ordered as 0, 2, 4, 6, 1, 3, 5, 7
+        __m256i packed = _mm256_packus_epi16(_mm256_packs_epi32(p01, p23),
+                                             _mm256_packs_epi32(p45, p67));
+        _mm256_storeu_si256((__m256i *)p, _mm256_permutevar8x32_epi32(packed, order));
+    }
+    unpremultiply_sse2(pixels + i * 4, count - i);
+}
+
+TARGET_AVX2
+static void swap_red_blue_avx2(unsigned char *pixels, size_t count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+        2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i *p = (__m256i *)(pixels + i * 4);
+        _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle));
+    }
+    swap_red_blue_sse2(pixels + i * 4, count - i);
+}
+
+TARGET_AVX2
+static void rgb8_to_rgba_avx2(const unsigned char *src, unsigned char *dst, size_t count)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+        0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m256i alpha = _mm256_set1_epi32((int)0xFF000000);
+    size_t i = 0;
+    // Each lane loads 16 bytes for 4 pixels, so stop before reading past the row.
+    for (; i + 10 <= count; i += 8) {
+        const unsigned char *s = src + i * 3;
+        __m256i v = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)s)),
+            _mm_loadu_si128((const __m128i *)(s + 12)), 1);
+        v = _mm256_or_si256(_mm256_shuffle_epi8(v, shuffle), alpha);
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), v);
+    }
+    rgb8_to_rgba_scalar(src + i * 3, dst + i * 4, count - i);
+}
+
+TARGET_AVX2
+static void indexed8_to_rgba_avx2(const unsigned char *src, unsigned char *dst, size_t count,
+                                  const unsigned char *palette)
+{
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i index = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+        __m256i v = _mm256_i32gather_epi32((const int *)palette, index, 4);
+        _mm256_storeu_si256((__m256i *)(dst + i * 4), v);
+    }
+    indexed8_to_rgba_scalar(src + i, dst + i * 4, count - i, palette);
+}
+
+static int cpu_has_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return 1;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] >> 26) & 1;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static int cpu_has_avx2()
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) return 0;
+
+    // the OS should save YMM registers
+    __cpuid(info, 1);
+    int osxsave = (info[2] >> 27) & 1;
+    int avx = (info[2] >> 28) & 1;
+    if (!osxsave || !avx || (_xgetbv(0) & 6) != 6) return 0;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] >> 5) & 1;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif  // PIXEL_CONVERT_X86
+
+struct PixelKernels {
+    void (*premultiply)(unsigned char *pixels, size_t count);
+    void (*unpremultiply)(unsigned char *pixels, size_t count);
+    void (*swap_red_blue)(unsigned char *pixels, size_t count);
+    void (*rgb8_to_rgba)(const unsigned char *src, unsigned char *dst, size_t count);
+    void (*gray8_to_rgba)(const unsigned char *src, unsigned char *dst, size_t count);
+    void (*gray_alpha8_to_rgba)(const unsigned char *src, unsigned char *dst, size_t count);
+    void (*indexed8_to_rgba)(const unsigned char *src, unsigned char *dst, size_t count,
+                             const unsigned char *palette);
+};
+
+#define SCALAR_KERNELS \
+    { premultiply_scalar, unpremultiply_scalar, swap_red_blue_scalar, rgb8_to_rgba_scalar, \
+      gray8_to_rgba_scalar, gray_alpha8_to_rgba_scalar, indexed8_to_rgba_scalar }
+
+static const PixelKernels KERNELS[PIXEL_KERNEL_COUNT] = {
+    SCALAR_KERNELS,
+#ifdef PIXEL_CONVERT_X86
+    { premultiply_sse2, unpremultiply_sse2, swap_red_blue_sse2, rgb8_to_rgba_scalar,
+      gray8_to_rgba_sse2, gray_alpha8_to_rgba_sse2, indexed8_to_rgba_scalar },
+    { premultiply_avx2, unpremultiply_avx2, swap_red_blue_avx2, rgb8_to_rgba_avx2,
+      gray8_to_rgba_sse2, gray_alpha8_to_rgba_sse2, indexed8_to_rgba_avx2 },
+#else
+    SCALAR_KERNELS,
+    SCALAR_KERNELS,
+#endif
+};
+
+#undef SCALAR_KERNELS
+
+static PIXEL_KERNEL detect_kernel()
+{
+    if (IsPixelKernelSupported(PIXEL_KERNEL_AVX2)) return PIXEL_KERNEL_AVX2;
+    if (IsPixelKernelSupported(PIXEL_KERNEL_SSE2)) return PIXEL_KERNEL_SSE2;
+    return PIXEL_KERNEL_SCALAR;
+}
+
+static PIXEL_KERNEL &current_kernel()
+{
+    static PIXEL_KERNEL kernel = detect_kernel();
+    return kernel;
+}
+
+void PremultiplyAlpha(unsigned char *pixels, size_t count)
+{
+    KERNELS[current_kernel()].premultiply(pixels, count);
+}
+
+void UnpremultiplyAlpha(unsigned char *pixels, size_t count)
+{
+    KERNELS[current_kernel()].unpremultiply(pixels, count);
+}
+
+void SwapRedBlue(unsigned char *pixels, size_t count)
+{
+    KERNELS[current_kernel()].swap_red_blue(pixels, count);
+}
+
+size_t GetPixelFormatSize(PIXEL_FORMAT format)
+{
+    switch (format) {
+        case PIXEL_FORMAT_RGBA8: return 4;
+        case PIXEL_FORMAT_RGB8: return 3;
+        case PIXEL_FORMAT_GRAY8: return 1;
+        case PIXEL_FORMAT_GRAY_ALPHA8: return 2;
+        case PIXEL_FORMAT_RGBA16: return 8;
+        case PIXEL_FORMAT_RGB16: return 6;
+        case PIXEL_FORMAT_GRAY16: return 2;
+        case PIXEL_FORMAT_GRAY_ALPHA16: return 4;
+        case PIXEL_FORMAT_INDEXED8: return 1;
+        default: return 0;
+    }
+}
+
+int PixelFormatHasAlpha(PIXEL_FORMAT format)
+{
+    return format == PIXEL_FORMAT_RGBA8 || format == PIXEL_FORMAT_GRAY_ALPHA8 ||
+           format == PIXEL_FORMAT_RGBA16 || format == PIXEL_FORMAT_GRAY_ALPHA16;
+}
+
+const char *GetPixelFormatName(PIXEL_FORMAT format)
+{
+    switch (format) {
+        case PIXEL_FORMAT_RGBA8: return "RGBA8";
+        case PIXEL_FORMAT_RGB8: return "RGB8";
+        case PIXEL_FORMAT_GRAY8: return "gray8";
+        case PIXEL_FORMAT_GRAY_ALPHA8: return "gray-alpha8";
+        case PIXEL_FORMAT_RGBA16: return "RGBA16";
+        case PIXEL_FORMAT_RGB16: return "RGB16";
+        case PIXEL_FORMAT_GRAY16: return "gray16";
+        case PIXEL_FORMAT_GRAY_ALPHA16: return "gray-alpha16";
+        case PIXEL_FORMAT_INDEXED8: return "indexed8";
+        default: return "(invalid)";
+    }
+}
+
+void ConvertToRgba(PIXEL_FORMAT format, const unsigned char *src, unsigned char *dst, size_t count,
+                   int premultiply, const unsigned char *palette)
+{
+    const PixelKernels &kernels = KERNELS[current_kernel()];
+    switch (format) {
+        case PIXEL_FORMAT_RGBA8:
+            if (src != dst) memcpy(dst, src, count * 4);
+            break;
+        case PIXEL_FORMAT_RGB8: kernels.rgb8_to_rgba(src, dst, count); break;
+        case PIXEL_FORMAT_GRAY8: kernels.gray8_to_rgba(src, dst, count); break;
+        case PIXEL_FORMAT_GRAY_ALPHA8: kernels.gray_alpha8_to_rgba(src, dst, count); break;
+        case PIXEL_FORMAT_RGBA16: convert16_to_rgba(src, dst, count, 4); break;
+        case PIXEL_FORMAT_RGB16: convert16_to_rgba(src, dst, count, 3); break;
+        case PIXEL_FORMAT_GRAY16: convert16_to_rgba(src, dst, count, 1); break;
+        case PIXEL_FORMAT_GRAY_ALPHA16: convert16_to_rgba(src, dst, count, 2); break;
+        case PIXEL_FORMAT_INDEXED8: kernels.indexed8_to_rgba(src, dst, count, palette); return;
+        default: return;
+    }
+    if (premultiply && PixelFormatHasAlpha(format))
+        kernels.premultiply(dst, count);
+}
+
+void UnpackIndices(const unsigned char *src, unsigned char *dst, size_t count, int bit_depth)
+{
+    if (bit_depth == 8) {
+        memcpy(dst, src, count);
+        return;
+    }
+    int per_byte = 8 / bit_depth;
+    unsigned char mask = (unsigned char)((1 << bit_depth) - 1);
+    for (size_t i = 0; i < count; i++) {
+        int shift = 8 - bit_depth * (int)(i % per_byte + 1);
+        dst[i] = (src[i / per_byte] >> shift) & mask;
+    }
+}
+
+PIXEL_KERNEL GetPixelKernel()
+{
+    return current_kernel();
+}
+
+int SetPixelKernel(PIXEL_KERNEL kernel)
+{
+    if (!IsPixelKernelSupported(kernel)) return 1;
+    current_kernel() = kernel;
+    return 0;
+}
+
+int IsPixelKernelSupported(PIXEL_KERNEL kernel)
+{
+    switch (kernel) {
+        case PIXEL_KERNEL_SCALAR: return 1;
+#ifdef PIXEL_CONVERT_X86
+        case PIXEL_KERNEL_SSE2: return cpu_has_sse2();
+        case PIXEL_KERNEL_AVX2: return cpu_has_sse2() && cpu_has_avx2();
+#endif
+        default: return 0;
+    }
+}
+
+const char *GetPixelKernelName(PIXEL_KERNEL kernel)
+{
+    switch (kernel) {
+        case PIXEL_KERNEL_SCALAR: return "scalar";
+        case PIXEL_KERNEL_SSE2: return "SSE2";
+        case PIXEL_KERNEL_AVX2: return "AVX2";
+        default: return "(invalid)";
+    }
+}
@@ -0,0 +1,130 @@
+#include <stdio.h>
+#include <string.h>
+#include <utility>
+#include "spng.h"
+#include "png_decoder_pool.hpp"
+#include "png_reader.hpp"
+
+// spng allocates through plain function pointers without user data,
+// so the pool of the current Decode() call is passed by a thread-local variable.
+static thread_local BufferPool *t_spng_pool = NULL;
+
+// spng frees blocks without their sizes. A header before each block keeps it.
+static const size_t BLOCK_HEADER_SIZE = 16;  // keeps the alignment of malloc
+
+static void *pool_malloc(size_t size)
+{
+    size_t capacity;
+    unsigned char *block = (unsigned char *)t_spng_pool->Allocate(size + BLOCK_HEADER_SIZE, &capacity);
+    if (!block) return NULL;
+    memcpy(block, &capacity, sizeof(capacity));
+    return block + BLOCK_HEADER_SIZE;
+}
+
+static void pool_free(void *ptr)
+{
+    if (!ptr) return;
+    unsigned char *block = (unsigned char *)ptr - BLOCK_HEADER_SIZE;
+    size_t capacity;
+    memcpy(&capacity, block, sizeof(capacity));
+    t_spng_pool->Free(block, capacity);
+}
+
+static void *pool_realloc(void *ptr, size_t size)
+{
+    if (!ptr) return pool_malloc(size);
+    unsigned char *block = (unsigned char *)ptr - BLOCK_HEADER_SIZE;
+    size_t capacity;
+    memcpy(&capacity, block, sizeof(capacity));
+    if (size + BLOCK_HEADER_SIZE <= capacity) return ptr;
+    void *new_ptr = pool_malloc(size);
+    if (!new_ptr) return NULL;
+    memcpy(new_ptr, ptr, capacity - BLOCK_HEADER_SIZE);
+    pool_free(ptr);
+    return new_ptr;
+}
+
+static void *pool_calloc(size_t count, size_t size)
+{
+    if (size && count > (size_t)-1 / size) return NULL;
+    void *ptr = pool_malloc(count * size);
+    if (ptr) memset(ptr, 0, count * size);
+    return ptr;
+}
+
+// Sets the pool for spng while it's alive
+class SpngPoolScope {
+ private:
+    BufferPool *m_prev;
+
+ public:
+    explicit SpngPoolScope(BufferPool *pool) : m_prev(t_spng_pool) { t_spng_pool = pool; }
+    ~SpngPoolScope() { t_spng_pool = m_prev; }
+};
+
+int PngDecoderPool::Decode(const char *file_name, DecodedPng *out, int premultiply)
+{
+    FILE *file = fopen(file_name, "rb");
+    if (!file) return 1;
+    setvbuf(file, NULL, _IONBF, 0);  // read straight into the pooled memory
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        size = ftell(file);
+    if (size <= 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return 1;
+    }
+    PooledBuffer data = m_files.Acquire((size_t)size);
+    size_t read_size = data.GetData() ? fread(data.GetData(), 1, (size_t)size, file) : 0;
+    fclose(file);
+    if (read_size != (size_t)size) return 1;
+
+    // the reader frees its context before the scope ends
+    SpngPoolScope scope(&m_contexts);
+    PngReader reader;
+    spng_alloc alloc = { pool_malloc, pool_realloc, pool_calloc, pool_free };
+    if (reader.ReadHeaderFromMemory(data.GetData(), data.GetSize(), &alloc))
+        return 1;
+
+    int width, height;
+    reader.GetSize(&width, &height);
+    size_t row_size = reader.GetRowSize();
+    PooledBuffer pixels = m_pixels.Acquire(row_size * height);
+    if (!pixels.GetData()) return 1;
+    if (reader.DecodeInto(pixels.GetData(), row_size, premultiply))
+        return 1;
+
+    out->pixels = std::move(pixels);
+    out->width = width;
+    out->height = height;
+    out->has_alpha = reader.HasAlpha();
+    out->row_size = row_size;
+    return 0;
+}
+
+long long PngDecoderPool::GetAllocations()
+{
+    return m_files.GetAllocations() + m_contexts.GetAllocations() + m_pixels.GetAllocations();
+}
+
+long long PngDecoderPool::GetAllocatedBytes()
+{
+    return m_files.GetAllocatedBytes() + m_contexts.GetAllocatedBytes() + m_pixels.GetAllocatedBytes();
+}
+
+long long PngDecoderPool::GetRequests()
+{
+    return m_files.GetRequests() + m_contexts.GetRequests() + m_pixels.GetRequests();
+}
+
+long long PngDecoderPool::GetReuses()
+{
+    return m_files.GetReuses() + m_contexts.GetReuses() + m_pixels.GetReuses();
+}
+
+void PngDecoderPool::Trim()
+{
+    m_files.Trim();
+    m_contexts.Trim();
+    m_pixels.Trim();
+}
@@ -1,6 +1,9 @@
 #include <stdio.h>
+#include <string.h>
+#include <vector>
 #include "spng.h"
 #include "png_reader.hpp"
+#include "pixel_convert.hpp"
 
 static const char *color_type_str(uint8_t color_type)
 {
@@ -15,36 +18,92 @@ static const char *color_type_str(uint8_t color_type)
     }
 }
 
-static int has_alpha(uint8_t color_type)
+struct DecodeFormat {
+    int fmt;  // spng output format
+    int flags;  // spng decode flags
+    PIXEL_FORMAT pixel_format;  // layout of the decoded rows
+};
+
+// spng converts pixels only for tRNS and low bit depths of grayscale.
+// Other rows are decoded as they are and converted by ConvertToRgba().
+static DecodeFormat select_format(const struct spng_ihdr &ihdr, int has_trns)
 {
-    return color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA || color_type == SPNG_COLOR_TYPE_TRUECOLOR_ALPHA;
+    int is16 = ihdr.bit_depth == 16;
+    switch (ihdr.color_type) {
+        case SPNG_COLOR_TYPE_TRUECOLOR_ALPHA:
+            if (is16) return { SPNG_FMT_PNG, 0, PIXEL_FORMAT_RGBA16 };
+            return { SPNG_FMT_RGBA8, 0, PIXEL_FORMAT_RGBA8 };
+        case SPNG_COLOR_TYPE_TRUECOLOR:
+            if (has_trns && is16) return { SPNG_FMT_RGBA16, SPNG_DECODE_TRNS, PIXEL_FORMAT_RGBA16 };
+            if (has_trns) return { SPNG_FMT_RGBA8, SPNG_DECODE_TRNS, PIXEL_FORMAT_RGBA8 };
+            return { SPNG_FMT_PNG, 0, is16 ? PIXEL_FORMAT_RGB16 : PIXEL_FORMAT_RGB8 };
+        case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA:
+            return { SPNG_FMT_PNG, 0, is16 ? PIXEL_FORMAT_GRAY_ALPHA16 : PIXEL_FORMAT_GRAY_ALPHA8 };
+        case SPNG_COLOR_TYPE_GRAYSCALE:
+            if (has_trns && is16) return { SPNG_FMT_GA16, SPNG_DECODE_TRNS, PIXEL_FORMAT_GRAY_ALPHA16 };
+            if (has_trns) return { SPNG_FMT_GA8, SPNG_DECODE_TRNS, PIXEL_FORMAT_GRAY_ALPHA8 };
+            if (is16) return { SPNG_FMT_PNG, 0, PIXEL_FORMAT_GRAY16 };
+            return { SPNG_FMT_G8, 0, PIXEL_FORMAT_GRAY8 };  // scales 1, 2, and 4 bits to 8 bits
+        default:
+            // 1, 2, and 4-bit indices are unpacked by UnpackIndices()
+            return { SPNG_FMT_PNG, 0, PIXEL_FORMAT_INDEXED8 };
+    }
 }
 
-static void premultiply_alpha(unsigned char *image, int width, int height)
+int PngReader::ReadFromFile(const char* file_name, int premultiply)
 {
-    unsigned char *offset = image;
-    for (int i = 0; i < width * height; i++) {
-        double a = (double)offset[3] / 255.0;
-        double r = (double)offset[0] * a / 255.0;
-        double g = (double)offset[1] * a / 255.0;
-        double b = (double)offset[2] * a / 255.0;
-        offset[0] = (unsigned char)(r * 255.0);
-        offset[1] = (unsigned char)(g * 255.0);
-        offset[2] = (unsigned char)(b * 255.0);
-        offset += 4;
+    int ret = ReadHeader(file_name);
+    if (ret) return 1;
+
+    unsigned char *image = (unsigned char *)malloc(m_row_size * m_height);
+    if (!image) {
+        Close();
+        return 1;
     }
+
+    ret = DecodeInto(image, m_row_size, premultiply);
+    if (ret) {
+        free(image);
+        return 1;
+    }
+
+    if (m_data)
+        free(m_data);
+    m_data = image;
+    return 0;
 }
 
-int PngReader::ReadFromFile(const char* file_name)
+int PngReader::ReadHeader(const char* file_name)
 {
+    Close();
+
     FILE *png = fopen(file_name, "rb");
     if (!png) return 1;
 
     spng_ctx *ctx = spng_ctx_new(0);
+    if (!ctx) {
+        fclose(png);
+        return 1;
+    }
+    spng_set_png_file(ctx, png);
+    m_file = png;
+    return ReadHeader(ctx);
+}
+
+int PngReader::ReadHeaderFromMemory(const void *data, size_t size, spng_alloc *alloc)
+{
+    Close();
+
+    spng_ctx *ctx = alloc ? spng_ctx_new2(alloc, 0) : spng_ctx_new(0);
     if (!ctx) return 1;
+    spng_set_png_buffer(ctx, data, size);
+    return ReadHeader(ctx);
+}
 
+// Reads the header with a new context. It takes over ctx and m_file.
+int PngReader::ReadHeader(spng_ctx *ctx)
+{
     int ret = 0;
-    unsigned char *image = NULL;
 
     // ignore chunk crc's
     spng_set_crc_action(ctx, SPNG_CRC_USE, SPNG_CRC_USE);
@@ -53,15 +112,14 @@ int PngReader::ReadFromFile(const char* file_name)
     size_t limit = 1024 * 1024 * 64;
     spng_set_chunk_limits(ctx, limit, limit);
 
-    spng_set_png_file(ctx, png);
-
+    m_ctx = ctx;
     struct spng_ihdr ihdr;
     ret = spng_get_ihdr(ctx, &ihdr);
 
     if(ret)
     {
         printf("spng_get_ihdr() error: %s\n", spng_strerror(ret));
-        spng_ctx_free(ctx);
+        Close();
         return 1;
     }
 
@@ -75,30 +133,93 @@ int PngReader::ReadFromFile(const char* file_name)
         ihdr.width, ihdr.height, ihdr.bit_depth, ihdr.color_type, color_name);
     */
 
-    size_t image_size, image_width;
-    int fmt = SPNG_FMT_PNG;
-    if(ihdr.color_type == SPNG_COLOR_TYPE_INDEXED) fmt = SPNG_FMT_RGB8;
+    struct spng_trns trns;
+    int has_trns = spng_get_trns(ctx, &trns) == 0;
+    DecodeFormat format = select_format(ihdr, has_trns);
 
-    ret = spng_decoded_image_size(ctx, fmt, &image_size);
+    size_t image_size;
+    ret = spng_decoded_image_size(ctx, format.fmt, &image_size);
     if (ret)
     {
-        spng_ctx_free(ctx);
+        Close();
         return 1;
     }
 
-    image = (unsigned char *)malloc(image_size);
+    m_palette.clear();
+    m_premultiplied_palette.clear();
+    if (ihdr.color_type == SPNG_COLOR_TYPE_INDEXED) {
+        struct spng_plte plte;
+        if (spng_get_plte(ctx, &plte)) {
+            Close();
+            return 1;
+        }
+        // indices out of the palette are transparent black
+        m_palette.assign(256 * 4, 0);
+        for (uint32_t i = 0; i < plte.n_entries && i < 256; i++) {
+            unsigned char *entry = &m_palette[i * 4];
+            entry[0] = plte.entries[i].red;
+            entry[1] = plte.entries[i].green;
+            entry[2] = plte.entries[i].blue;
+            entry[3] = has_trns && i < trns.n_type3_entries ? trns.type3_alpha[i] : 255;
+        }
+        m_premultiplied_palette = m_palette;
+        PremultiplyAlpha(m_premultiplied_palette.data(), 256);
+    }
+
+    m_fmt = format.fmt;
+    m_flags = format.flags;
+    m_pixel_format = format.pixel_format;
+    m_bit_depth = ihdr.bit_depth;
+    m_width = ihdr.width;
+    m_height = ihdr.height;
+    m_row_size = (size_t)m_width * 4;
+    m_native_row_size = image_size / ihdr.height;
+    m_has_alpha = PixelFormatHasAlpha(m_pixel_format) || (!m_palette.empty() && has_trns);
+
+    // RGBA rows are decoded into the destination itself
+    m_native_row.clear();
+    if (m_pixel_format != PIXEL_FORMAT_RGBA8)
+        m_native_row.resize(m_native_row_size);
+    if (m_pixel_format == PIXEL_FORMAT_INDEXED8 && m_bit_depth < 8)
+        m_indices.resize(m_width);
+    return 0;
+}
+
+// Converts a decoded row into RGBA. src can be dst for PIXEL_FORMAT_RGBA8.
+void PngReader::ConvertRow(const unsigned char *src, unsigned char *dst, int premultiply)
+{
+    if (m_pixel_format == PIXEL_FORMAT_INDEXED8 && m_bit_depth < 8) {
+        UnpackIndices(src, m_indices.data(), m_width, m_bit_depth);
+        src = m_indices.data();
+    }
+    ConvertToRgba(m_pixel_format, src, dst, m_width, premultiply, GetPalette(premultiply));
+}
+
+// Decodes rows into dst. When convert is nonzero, they are converted to RGBA.
+int PngReader::DecodeProgressive(unsigned char *dst, size_t stride, int convert, int premultiply)
+{
+    if (!m_ctx) return 1;
+    spng_ctx *ctx = m_ctx;
 
-    ret = spng_decode_image(ctx, NULL, 0, fmt, SPNG_DECODE_PROGRESSIVE);
+    int ret = spng_decode_image(ctx, NULL, 0, m_fmt, SPNG_DECODE_PROGRESSIVE | m_flags);
 
     if(ret)
     {
         printf("progressive spng_decode_image() error: %s\n", spng_strerror(ret));
-        spng_ctx_free(ctx);
-        free(image);
+        Close();
         return 1;
     }
 
-    image_width = image_size / ihdr.height;
+    struct spng_ihdr ihdr;
+    spng_get_ihdr(ctx, &ihdr);
+
+    // RGBA rows are decoded into dst, and others into a row to be converted.
+    // Rows of interlaced images are finished at the last pass,
+    // so they are converted from the whole decoded image.
+    int direct = !convert || m_pixel_format == PIXEL_FORMAT_RGBA8;
+    std::vector<unsigned char> image;
+    if (!direct && ihdr.interlace_method)
+        image.resize(m_native_row_size * m_height);
 
     struct spng_row_info row_info = {0};
 
@@ -107,7 +228,16 @@ int PngReader::ReadFromFile(const char* file_name)
         ret = spng_get_row_info(ctx, &row_info);
         if(ret) break;
 
-        ret = spng_decode_row(ctx, image + row_info.row_num * image_width, image_width);
+        unsigned char *row = m_native_row.data();
+        if (direct)
+            row = dst + row_info.row_num * stride;
+        else if (!image.empty())
+            row = &image[row_info.row_num * m_native_row_size];
+        ret = spng_decode_row(ctx, row, m_native_row_size);
+
+        // SPNG_EOI comes with the last row
+        if (convert && !ihdr.interlace_method && (!ret || ret == SPNG_EOI))
+            ConvertRow(row, dst + row_info.row_num * stride, premultiply);
     }
     while(!ret);
 
@@ -122,14 +252,109 @@ int PngReader::ReadFromFile(const char* file_name)
             printf("last row: %u\n", row_info.row_num);
     }
 
-    // We should convert the raw data to the libui format
-    premultiply_alpha(image, ihdr.width, ihdr.height);
+    if (convert && ihdr.interlace_method) {
+        for (int y = 0; y < m_height; y++) {
+            unsigned char *row = dst + y * stride;
+            ConvertRow(direct ? row : &image[y * m_native_row_size], row, premultiply);
+        }
+    }
 
-    m_data = image;
-    m_width = ihdr.width;
-    m_height = ihdr.height;
-    m_has_alpha = has_alpha(ihdr.color_type);
+    Close();
+    return 0;
+}
+
+int PngReader::DecodeInto(unsigned char *dst, size_t stride, int premultiply)
+{
+    return DecodeProgressive(dst, stride, 1, premultiply);
+}
+
+int PngReader::DecodeNativeInto(unsigned char *dst, size_t stride)
+{
+    if (!m_ctx) return 1;
+    if (m_pixel_format != PIXEL_FORMAT_INDEXED8 || m_bit_depth == 8)
+        return DecodeProgressive(dst, stride, 0, 0);
+
+    // packed rows of interlaced images are finished at the last pass,
+    // so the packed image is decoded as a whole. It's 1/2 of the indices at most.
+    std::vector<unsigned char> packed(m_native_row_size * m_height);
+    int ret = spng_decode_image(m_ctx, packed.data(), packed.size(), m_fmt, m_flags);
+    Close();
+    if (ret) {
+        printf("spng_decode_image() error: %s\n", spng_strerror(ret));
+        return 1;
+    }
+    for (int y = 0; y < m_height; y++)
+        UnpackIndices(&packed[y * m_native_row_size], dst + y * stride, m_width, m_bit_depth);
+    return 0;
+}
+
+int PngReader::DecodeRows(const RowCallback &callback, int premultiply)
+{
+    if (!m_ctx) return 1;
+    spng_ctx *ctx = m_ctx;
+
+    struct spng_ihdr ihdr;
+    spng_get_ihdr(ctx, &ihdr);
+    if (ihdr.interlace_method) {
+        std::vector<unsigned char> image(m_row_size * m_height);
+        if (DecodeInto(image.data(), m_row_size, premultiply))
+            return 1;
+        for (int y = 0; y < m_height; y++) {
+            if (callback(y, image.data() + y * m_row_size))
+                return 1;
+        }
+        return 0;
+    }
+
+    int ret = spng_decode_image(ctx, NULL, 0, m_fmt, SPNG_DECODE_PROGRESSIVE | m_flags);
+
+    if(ret)
+    {
+        printf("progressive spng_decode_image() error: %s\n", spng_strerror(ret));
+        Close();
+        return 1;
+    }
+
+    std::vector<unsigned char> row(m_row_size);
+    struct spng_row_info row_info;
+    memset(&row_info, 0, sizeof(row_info));
+
+    do
+    {
+        ret = spng_get_row_info(ctx, &row_info);
+        if(ret) break;
+
+        // SPNG_EOI comes with the last row
+        unsigned char *native = m_pixel_format == PIXEL_FORMAT_RGBA8 ? row.data() : m_native_row.data();
+        ret = spng_decode_row(ctx, native, m_native_row_size);
+        if(ret && ret != SPNG_EOI) break;
+
+        ConvertRow(native, row.data(), premultiply);
+        if (callback(row_info.row_num, row.data())) {
+            Close();
+            return 1;
+        }
+    }
+    while(!ret);
 
-    spng_ctx_free(ctx);
+    Close();
+    if(ret != SPNG_EOI)
+    {
+        printf("progressive decode error: %s\n", spng_strerror(ret));
+        printf("last row: %u\n", row_info.row_num);
+        return 1;
+    }
     return 0;
 }
+
+void PngReader::Close()
+{
+    if (m_ctx) {
+        spng_ctx_free(m_ctx);
+        m_ctx = NULL;
+    }
+    if (m_file) {
+        fclose(m_file);
+        m_file = NULL;
+    }
+}
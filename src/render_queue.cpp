@@ -0,0 +1,96 @@
+#include <chrono>
+#include <utility>
+#include "render_queue.hpp"
+
+void RenderQueue::Clear()
+{
+    m_items.clear();
+    m_diff = 0;
+    m_is_sorted = 1;
+}
+
+int RenderQueue::GetBufferId(ImageBuffer *buf)
+{
+    uintptr_t addr = (uintptr_t)buf;
+    int slot = (int)((addr >> 4 ^ addr >> 10) & (ID_CACHE_SIZE - 1));
+    if (m_id_cache[slot] == buf)
+        return m_id_cache_ids[slot];
+    size_t id = 0;
+    while (id < m_buffers.size() && m_buffers[id] != buf) id++;
+    if (id == m_buffers.size())
+        m_buffers.push_back(buf);
+    m_id_cache[slot] = buf;
+    m_id_cache_ids[slot] = (int)id;
+    return (int)id;
+}
+
+void RenderQueue::Submit(Sprite *sprite, int layer, unsigned depth)
+{
+    if (!sprite->IsReady()) return;
+    Item item = { MakeKey(layer, depth, GetBufferId(sprite->GetBuffer())), sprite };
+    if (!m_items.empty()) {
+        // Keys that are already in order (e.g. sprites submitted in draw order) skip sorting.
+        if (item.key < m_items.back().key) m_is_sorted = 0;
+        m_diff |= item.key ^ m_items[0].key;
+    }
+    m_items.push_back(item);
+}
+
+void RenderQueue::Sort()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    size_t count = m_items.size();
+
+    if (!m_is_sorted) {
+        // Digits are placed only over bits that differ between keys, and each is trimmed to the last of them.
+        // e.g. a frame with a single layer skips the layer byte,
+        // and 8 layers, 4096 depths, and 16 buffers take 3 passes of 3, 12, and 4 bits.
+        int shifts[64];
+        uint32_t masks[64];
+        size_t bases[64];  // first bucket of each pass in m_counts
+        int pass_num = 0;
+        size_t total = 0;
+        for (int bit = 0; bit < 64; bit++) {
+            if (!(m_diff >> bit & 1)) continue;
+            int width = 1;
+            for (int b = 1; b < RADIX_BITS && bit + b < 64; b++) {
+                if (m_diff >> (bit + b) & 1) width = b + 1;
+            }
+            shifts[pass_num] = bit;
+            masks[pass_num] = ((uint32_t)1 << width) - 1;
+            bases[pass_num] = total;
+            total += (size_t)1 << width;
+            pass_num++;
+            bit += width - 1;
+        }
+
+        m_counts.assign(total, 0);
+        for (const Item &item : m_items) {
+            for (int pass = 0; pass < pass_num; pass++)
+                m_counts[bases[pass] + ((item.key >> shifts[pass]) & masks[pass])]++;
+        }
+
+        m_temp.resize(count);
+        Item *src = m_items.data();
+        Item *dst = m_temp.data();
+        for (int pass = 0; pass < pass_num; pass++) {
+            uint32_t *bucket = m_counts.data() + bases[pass];
+            uint32_t offset = 0;
+            for (size_t digit = 0; digit <= masks[pass]; digit++) {
+                uint32_t num = bucket[digit];
+                bucket[digit] = offset;
+                offset += num;
+            }
+            int shift = shifts[pass];
+            uint32_t mask = masks[pass];
+            for (size_t i = 0; i < count; i++)
+                dst[bucket[(src[i].key >> shift) & mask]++] = src[i];
+            std::swap(src, dst);
+        }
+        if (src != m_items.data())
+            m_items.swap(m_temp);
+        m_is_sorted = 1;
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    m_sort_ms = elapsed.count();
+}
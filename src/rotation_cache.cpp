@@ -0,0 +1,112 @@
+#include <cmath>
+#include <algorithm>
+#include "rotation_cache.hpp"
+#include "soft_renderer.hpp"
+#include "rect_utils.hpp"
+
+bool RotationCache::Key::operator<(const Key &k) const
+{
+    const int a[] = { src_x, src_y, src_w, src_h, dst_w, dst_h, pivot_x, pivot_y, angle, fast };
+    const int b[] = { k.src_x, k.src_y, k.src_w, k.src_h, k.dst_w, k.dst_h,
+                      k.pivot_x, k.pivot_y, k.angle, k.fast };
+    if (source != k.source) return source < k.source;
+    return std::lexicographical_compare(a, a + 10, b, b + 10);
+}
+
+RotationCache::RotationCache(int steps, size_t max_bytes)
+    : m_entries(), m_index(), m_steps(std::max(steps, 1)), m_max_bytes(max_bytes),
+      m_bytes(0), m_hits(0), m_misses(0), m_evictions(0) {}
+
+void RotationCache::SetSteps(int steps)
+{
+    m_steps = std::max(steps, 1);
+    Clear();
+}
+
+void RotationCache::SetMaxBytes(size_t max_bytes)
+{
+    m_max_bytes = max_bytes;
+    Evict();
+}
+
+void RotationCache::Clear()
+{
+    m_index.clear();
+    m_entries.clear();
+    m_bytes = 0;
+}
+
+void RotationCache::Evict()
+{
+    // keep the most recent one even if it's larger than the cap
+    while (m_bytes > m_max_bytes && m_entries.size() > 1) {
+        Variant &v = m_entries.back().second;
+        m_bytes -= (size_t)v.width * v.height * 4;
+        m_index.erase(m_entries.back().first);
+        m_entries.pop_back();
+        m_evictions++;
+    }
+}
+
+const RotationCache::Variant *RotationCache::Get(uiDrawContext *c, ImageBuffer &source,
+                                                 const uiRect &src_rect, int dst_w, int dst_h,
+                                                 double pivot_x, double pivot_y,
+                                                 double rad, int fast)
+{
+    const double two_pi = 2 * uiPi;
+    int angle = (int)std::floor(rad / two_pi * m_steps + 0.5) % m_steps;
+    if (angle < 0) angle += m_steps;
+
+    Key key = { &source, src_rect.X, src_rect.Y, src_rect.Width, src_rect.Height,
+                dst_w, dst_h,
+                (int)std::floor(pivot_x * 8 + 0.5), (int)std::floor(pivot_y * 8 + 0.5),
+                angle, fast };
+    std::map<Key, Entries::iterator>::iterator found = m_index.find(key);
+    if (found != m_index.end()) {
+        // move to the front
+        m_entries.splice(m_entries.begin(), m_entries, found->second);
+        m_hits++;
+        return &found->second->second;
+    }
+
+    const unsigned char *pixels = source.GetPixels();
+    if (!pixels || dst_w <= 0 || dst_h <= 0) return NULL;
+    m_misses++;
+
+    // rasterize the rotated image with the software renderer
+    double q_rad = angle * two_pi / m_steps;
+    double px = key.pivot_x / 8.0;
+    double py = key.pivot_y / 8.0;
+    uiRect local = { 0, 0, dst_w, dst_h };
+    uiRect bounds = RotatedBounds(local, px, py, q_rad);
+
+    SoftRenderer canvas;
+    canvas.Resize(bounds.Width, bounds.Height);  // transparent
+    uiRect dst = { -bounds.X, -bounds.Y, dst_w, dst_h };
+    int width, height;
+    source.GetSize(&width, &height);
+    canvas.DrawImage(pixels, width, height, src_rect, dst,
+                     px - bounds.X, py - bounds.Y, q_rad, fast);
+
+    Variant variant;
+    variant.buffer.reset(new ImageBuffer());
+    variant.buffer->Create(c, bounds.Width, bounds.Height, 1);
+    variant.buffer->Update(canvas.GetData());
+    variant.offset_x = bounds.X;
+    variant.offset_y = bounds.Y;
+    variant.width = bounds.Width;
+    variant.height = bounds.Height;
+
+    m_entries.push_front(std::make_pair(key, std::move(variant)));
+    m_index[key] = m_entries.begin();
+    m_bytes += (size_t)bounds.Width * bounds.Height * 4;
+    Evict();
+    return &m_entries.front().second;
+}
+
+void RotationCache::Prepare(uiDrawContext *c, ImageBuffer &source, const uiRect &src_rect,
+                            int dst_w, int dst_h, double pivot_x, double pivot_y, int fast)
+{
+    for (int i = 0; i < m_steps; i++)
+        Get(c, source, src_rect, dst_w, dst_h, pivot_x, pivot_y, i * 2 * uiPi / m_steps, fast);
+}
@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <algorithm>
+#include "soft_renderer.hpp"
+#include "rect_utils.hpp"
+
+// x / 255 for x in [0, 255 * 255] without division
+static inline uint32_t div255(uint32_t x)
+{
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// source-over for premultiplied RGBA
+static inline void blend_pixel(unsigned char *dst, const unsigned char *src)
+{
+    uint32_t a = src[3];
+    if (a == 0) return;
+    if (a == 255) {
+        memcpy(dst, src, 4);
+        return;
+    }
+    uint32_t inv = 255 - a;
+    dst[0] = (unsigned char)(src[0] + div255(dst[0] * inv));
+    dst[1] = (unsigned char)(src[1] + div255(dst[1] * inv));
+    dst[2] = (unsigned char)(src[2] + div255(dst[2] * inv));
+    dst[3] = (unsigned char)(a + div255(dst[3] * inv));
+}
+
+// u and v are 16.16 fixed-point coordinates of the sample point.
+// Taps outside of the src rect are clamped to its edges.
+static inline void sample_bilinear(const unsigned char *image, int stride,
+                                   int x_min, int y_min, int x_max, int y_max,
+                                   int64_t u, int64_t v, unsigned char *out)
+{
+    int x0 = (int)(u >> 16);
+    int y0 = (int)(v >> 16);
+    uint32_t fx = (uint32_t)(u >> 8) & 0xFF;
+    uint32_t fy = (uint32_t)(v >> 8) & 0xFF;
+    int x1 = std::min(std::max(x0 + 1, x_min), x_max);
+    int y1 = std::min(std::max(y0 + 1, y_min), y_max);
+    x0 = std::min(std::max(x0, x_min), x_max);
+    y0 = std::min(std::max(y0, y_min), y_max);
+
+    const unsigned char *p00 = image + (size_t)y0 * stride + x0 * 4;
+    const unsigned char *p01 = image + (size_t)y0 * stride + x1 * 4;
+    const unsigned char *p10 = image + (size_t)y1 * stride + x0 * 4;
+    const unsigned char *p11 = image + (size_t)y1 * stride + x1 * 4;
+    for (int i = 0; i < 4; i++) {
+        uint32_t top = p00[i] * (256 - fx) + p01[i] * fx;
+        uint32_t bottom = p10[i] * (256 - fx) + p11[i] * fx;
+        out[i] = (unsigned char)((top * (256 - fy) + bottom * fy) >> 16);
+    }
+}
+
+void SoftRenderer::Clear(uint32_t color)
+{
+    uiRect rect = { 0, 0, m_width, m_height };
+    FillRect(rect, color);
+}
+
+void SoftRenderer::FillRect(const uiRect &rect, uint32_t color)
+{
+    unsigned char rgba[4] = {
+        (unsigned char)((color >> 16) & 0xFF),
+        (unsigned char)((color >> 8) & 0xFF),
+        (unsigned char)(color & 0xFF),
+        255
+    };
+    uiRect r = IntersectRect(rect, m_clip);
+    for (int y = r.Y; y < r.Y + r.Height; y++) {
+        unsigned char *offset = m_pixels + ((size_t)y * m_width + r.X) * 4;
+        for (int x = 0; x < r.Width; x++) {
+            memcpy(offset, rgba, 4);
+            offset += 4;
+        }
+    }
+}
+
+void SoftRenderer::DrawImage(const unsigned char *image, int image_width, int image_height,
+                             const uiRect &src_rect, const uiRect &dst_rect,
+                             double x, double y, double rad, int fast)
+{
+    if (!image || dst_rect.Width <= 0 || dst_rect.Height <= 0)
+        return;
+
+    // clip the src rect to the image
+    int src_x0 = std::max(src_rect.X, 0);
+    int src_y0 = std::max(src_rect.Y, 0);
+    int src_x1 = std::min(src_rect.X + src_rect.Width, image_width);
+    int src_y1 = std::min(src_rect.Y + src_rect.Height, image_height);
+    if (src_x0 >= src_x1 || src_y0 >= src_y1)
+        return;
+
+    double c = std::cos(rad);
+    double s = std::sin(rad);
+
+    // bounding box of the rotated dst rect
+    uiRect full = RotatedBounds(dst_rect, x, y, rad);
+    uiRect bounds = IntersectRect(full, m_clip);
+    int x_begin = bounds.X;
+    int y_begin = bounds.Y;
+    int x_end = bounds.X + bounds.Width;
+    int y_end = bounds.Y + bounds.Height;
+    if (x_begin >= x_end || y_begin >= y_end)
+        return;
+
+    // A point in the framebuffer is mapped to the source image
+    // by the inverse rotation and the dst-to-src scaling.
+    // Coordinates are stepped in 16.16 fixed point along each row.
+    const double one = 65536.0;
+    double scale_x = (double)src_rect.Width / dst_rect.Width;
+    double scale_y = (double)src_rect.Height / dst_rect.Height;
+    int64_t du = (int64_t)std::floor(c * scale_x * one + 0.5);
+    int64_t dv = (int64_t)std::floor(-s * scale_y * one + 0.5);
+    int64_t u_min = (int64_t)src_x0 << 16;
+    int64_t v_min = (int64_t)src_y0 << 16;
+    int64_t u_max = (int64_t)src_x1 << 16;
+    int64_t v_max = (int64_t)src_y1 << 16;
+    int64_t half = 1 << 15;
+    int stride = image_width * 4;
+
+    // Rows are mapped at the left edge of the bounds in the framebuffer and stepped to the clip rect,
+    // so pixels don't depend on the clip rect.
+    int x_origin = std::max(full.X, 0);
+    int64_t skip = x_begin - x_origin;
+    for (int py = y_begin; py < y_end; py++) {
+        double fx = x_origin + 0.5 - x;
+        double fy = py + 0.5 - y;
+        double u = src_rect.X + (x + c * fx + s * fy - dst_rect.X) * scale_x;
+        double v = src_rect.Y + (y - s * fx + c * fy - dst_rect.Y) * scale_y;
+        int64_t fu = (int64_t)std::floor(u * one) + skip * du;
+        int64_t fv = (int64_t)std::floor(v * one) + skip * dv;
+        unsigned char *out = m_pixels + ((size_t)py * m_width + x_begin) * 4;
+
+        for (int px = x_begin; px < x_end; px++) {
+            if (fu >= u_min && fu < u_max && fv >= v_min && fv < v_max) {
+                if (fast) {
+                    blend_pixel(out, image + (size_t)(fv >> 16) * stride + (fu >> 16) * 4);
+                } else {
+                    unsigned char texel[4];
+                    sample_bilinear(image, stride,
+                                    src_x0, src_y0, src_x1 - 1, src_y1 - 1,
+                                    fu - half, fv - half, texel);
+                    blend_pixel(out, texel);
+                }
+            }
+            fu += du;
+            fv += dv;
+            out += 4;
+        }
+    }
+}
+
+void SoftRenderer::DrawImageAxisAligned(const unsigned char *image, int image_width, int image_height,
+                                        const uiRect &src_rect, const uiRect &dst_rect, int fast)
+{
+    if (!image || dst_rect.Width <= 0 || dst_rect.Height <= 0)
+        return;
+
+    int src_x0 = std::max(src_rect.X, 0);
+    int src_y0 = std::max(src_rect.Y, 0);
+    int src_x1 = std::min(src_rect.X + src_rect.Width, image_width);
+    int src_y1 = std::min(src_rect.Y + src_rect.Height, image_height);
+    if (src_x0 >= src_x1 || src_y0 >= src_y1)
+        return;
+
+    // At 1:1, bilinear taps hit texel centers. So, it's the same as nearest-neighbor.
+    if (src_rect.Width == dst_rect.Width && src_rect.Height == dst_rect.Height)
+        fast = 1;
+
+    uiRect bounds = IntersectRect(dst_rect, m_clip);
+    int x_begin = bounds.X;
+    int y_begin = bounds.Y;
+    int x_end = bounds.X + bounds.Width;
+    int y_end = bounds.Y + bounds.Height;
+    if (x_begin >= x_end || y_begin >= y_end)
+        return;
+
+    const double one = 65536.0;
+    double scale_x = (double)src_rect.Width / dst_rect.Width;
+    double scale_y = (double)src_rect.Height / dst_rect.Height;
+    int64_t du = (int64_t)std::floor(scale_x * one + 0.5);
+    // u steps from the left edge of the dst rect in the framebuffer as DrawImage() does
+    int x_origin = std::max(dst_rect.X, 0);
+    int64_t u_begin = (int64_t)std::floor((src_rect.X + (x_origin + 0.5 - dst_rect.X) * scale_x) * one) +
+                      (int64_t)(x_begin - x_origin) * du;
+    int64_t u_min = (int64_t)src_x0 << 16;
+    int64_t u_max = (int64_t)src_x1 << 16;
+    int64_t half = 1 << 15;
+    int stride = image_width * 4;
+
+    for (int py = y_begin; py < y_end; py++) {
+        // v is constant along a row
+        int64_t fv = (int64_t)std::floor((src_rect.Y + (py + 0.5 - dst_rect.Y) * scale_y) * one);
+        if (fv < ((int64_t)src_y0 << 16) || fv >= ((int64_t)src_y1 << 16))
+            continue;
+
+        const unsigned char *row = image + (size_t)(fv >> 16) * stride;
+        unsigned char *out = m_pixels + ((size_t)py * m_width + x_begin) * 4;
+        int64_t fu = u_begin;
+        for (int px = x_begin; px < x_end; px++) {
+            if (fu >= u_min && fu < u_max) {
+                if (fast) {
+                    blend_pixel(out, row + (fu >> 16) * 4);
+                } else {
+                    unsigned char texel[4];
+                    sample_bilinear(image, stride,
+                                    src_x0, src_y0, src_x1 - 1, src_y1 - 1,
+                                    fu - half, fv - half, texel);
+                    blend_pixel(out, texel);
+                }
+            }
+            fu += du;
+            out += 4;
+        }
+    }
+}
+
+uint32_t SoftRenderer::Checksum()
+{
+    uint32_t hash = 2166136261u;
+    size_t size = (size_t)m_width * m_height * 4;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= m_pixels[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+int SoftRenderer::SaveAsPpm(const char *file_name)
+{
+    FILE *ppm = fopen(file_name, "wb");
+    if (!ppm) return 1;
+
+    fprintf(ppm, "P6\n%d %d\n255\n", m_width, m_height);
+    const unsigned char *offset = m_pixels;
+    for (int i = 0; i < m_width * m_height; i++) {
+        fwrite(offset, 1, 3, ppm);
+        offset += 4;
+    }
+
+    fclose(ppm);
+    return 0;
+}
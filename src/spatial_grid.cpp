@@ -0,0 +1,129 @@
+#include <algorithm>
+#include "spatial_grid.hpp"
+#include "rect_utils.hpp"
+
+void SpatialGrid::Resize(int width, int height)
+{
+    m_width = std::max(width, 0);
+    m_height = std::max(height, 0);
+    SetCellSize(m_cell_size);
+}
+
+void SpatialGrid::SetCellSize(int cell_size)
+{
+    m_cell_size = std::max(cell_size, 1);
+    m_cols = (m_width + m_cell_size - 1) / m_cell_size;
+    m_rows = (m_height + m_cell_size - 1) / m_cell_size;
+    m_cells.assign((size_t)m_cols * m_rows, std::vector<int>());
+    for (size_t id = 0; id < m_entries.size(); id++) {
+        Entry &e = m_entries[id];
+        if (!e.active) continue;
+        GetCellRange(e.bounds, &e.x0, &e.y0, &e.x1, &e.y1);
+        Link((int)id);
+    }
+}
+
+void SpatialGrid::GetCellRange(const uiRect &bounds, int *x0, int *y0, int *x1, int *y1)
+{
+    uiRect area = { 0, 0, m_width, m_height };
+    uiRect r = IntersectRect(bounds, area);
+    if (IsRectEmpty(r)) {
+        *x0 = *y0 = 0;
+        *x1 = *y1 = -1;
+        return;
+    }
+    *x0 = r.X / m_cell_size;
+    *y0 = r.Y / m_cell_size;
+    *x1 = (r.X + r.Width - 1) / m_cell_size;
+    *y1 = (r.Y + r.Height - 1) / m_cell_size;
+}
+
+void SpatialGrid::Link(int id)
+{
+    Entry &e = m_entries[id];
+    for (int y = e.y0; y <= e.y1; y++) {
+        for (int x = e.x0; x <= e.x1; x++)
+            m_cells[(size_t)y * m_cols + x].push_back(id);
+    }
+}
+
+void SpatialGrid::Unlink(int id)
+{
+    Entry &e = m_entries[id];
+    for (int y = e.y0; y <= e.y1; y++) {
+        for (int x = e.x0; x <= e.x1; x++) {
+            // cells are short, so a linear search is enough
+            std::vector<int> &cell = m_cells[(size_t)y * m_cols + x];
+            std::vector<int>::iterator it = std::find(cell.begin(), cell.end(), id);
+            if (it != cell.end()) {
+                *it = cell.back();
+                cell.pop_back();
+            }
+        }
+    }
+}
+
+void SpatialGrid::Update(int id, const uiRect &bounds)
+{
+    if ((size_t)id >= m_entries.size()) {
+        Entry empty = { { 0, 0, 0, 0 }, 0, 0, -1, -1, 0, 0 };
+        m_entries.resize(id + 1, empty);
+    }
+    Entry &e = m_entries[id];
+    e.bounds = bounds;
+    int x0, y0, x1, y1;
+    GetCellRange(bounds, &x0, &y0, &x1, &y1);
+    if (e.active && x0 == e.x0 && y0 == e.y0 && x1 == e.x1 && y1 == e.y1)
+        return;
+    if (e.active) {
+        Unlink(id);
+        m_cell_moves++;
+    }
+    e.x0 = x0;
+    e.y0 = y0;
+    e.x1 = x1;
+    e.y1 = y1;
+    e.active = 1;
+    Link(id);
+}
+
+void SpatialGrid::Remove(int id)
+{
+    if ((size_t)id >= m_entries.size() || !m_entries[id].active) return;
+    Unlink(id);
+    m_entries[id].active = 0;
+}
+
+void SpatialGrid::Clear()
+{
+    m_entries.clear();
+    for (std::vector<int> &cell : m_cells)
+        cell.clear();
+}
+
+void SpatialGrid::Query(const uiRect &rect, std::vector<int> *ids)
+{
+    ids->clear();
+    int x0, y0, x1, y1;
+    GetCellRange(rect, &x0, &y0, &x1, &y1);
+    if (x0 > x1) return;
+
+    // stamps skip sprites that are listed in several cells
+    if (++m_stamp == 0) {
+        for (Entry &e : m_entries)
+            e.stamp = 0;
+        m_stamp = 1;
+    }
+    for (int y = y0; y <= y1; y++) {
+        for (int x = x0; x <= x1; x++) {
+            for (int id : m_cells[(size_t)y * m_cols + x]) {
+                Entry &e = m_entries[id];
+                if (e.stamp == m_stamp) continue;
+                e.stamp = m_stamp;
+                if (RectsIntersect(e.bounds, rect))
+                    ids->push_back(id);
+            }
+        }
+    }
+    std::sort(ids->begin(), ids->end());
+}
@@ -0,0 +1,97 @@
+#include "sprite_array.hpp"
+
+void SpriteArray::Resize(int count)
+{
+    uiRect rect = { 0, 0, 0, 0 };
+    if (m_buffer) rect = m_buffer->GetRect();
+    m_x.resize(count, 0.0f);
+    m_y.resize(count, 0.0f);
+    m_cx.resize(count, 0.0f);
+    m_cy.resize(count, 0.0f);
+    m_sx.resize(count, 1.0f);
+    m_sy.resize(count, 1.0f);
+    m_rad.resize(count, 0.0f);
+    m_src_x.resize(count, rect.X);
+    m_src_y.resize(count, rect.Y);
+    m_src_w.resize(count, rect.Width);
+    m_src_h.resize(count, rect.Height);
+    m_dst_x.resize(count, 0);
+    m_dst_y.resize(count, 0);
+    m_dst_w.resize(count, 0);
+    m_dst_h.resize(count, 0);
+}
+
+// Loops below have no branches and no aliasing between arrays.
+// So, compilers can vectorize them. (e.g. -O3 or release builds)
+
+void SpriteArray::SetScales(int begin, int end, float sx, float sy)
+{
+    float *__restrict xs = m_sx.data();
+    float *__restrict ys = m_sy.data();
+    for (int i = begin; i < end; i++) {
+        xs[i] = sx;
+        ys[i] = sy;
+    }
+}
+
+void SpriteArray::UpdateDstRects(int begin, int end)
+{
+    const float *__restrict x = m_x.data();
+    const float *__restrict y = m_y.data();
+    const float *__restrict cx = m_cx.data();
+    const float *__restrict cy = m_cy.data();
+    const float *__restrict sx = m_sx.data();
+    const float *__restrict sy = m_sy.data();
+    const int *__restrict src_w = m_src_w.data();
+    const int *__restrict src_h = m_src_h.data();
+    int *__restrict dst_x = m_dst_x.data();
+    int *__restrict dst_y = m_dst_y.data();
+    int *__restrict dst_w = m_dst_w.data();
+    int *__restrict dst_h = m_dst_h.data();
+    for (int i = begin; i < end; i++) {
+        dst_x[i] = (int)(x[i] - cx[i] * sx[i]);
+        dst_y[i] = (int)(y[i] - cy[i] * sy[i]);
+        dst_w[i] = (int)(src_w[i] * sx[i]);
+        dst_h[i] = (int)(src_h[i] * sy[i]);
+    }
+}
+
+void SpriteArray::Draw(uiDrawContext *c, int begin, int end, int fast, int axis_aligned)
+{
+    if (!m_buffer) return;
+    uiImageBuffer *image = m_buffer->GetLibuiBuffer();
+    for (int i = begin; i < end; i++) {
+        uiRect src = GetSrcRect(i);
+        uiRect dst = GetDstRect(i);
+        int rotated = !axis_aligned || m_rad[i] != 0.0f;
+        if (rotated) {
+            uiDrawSave(c);
+            uiDrawMatrix rm;
+            uiDrawMatrixSetIdentity(&rm);
+            uiDrawMatrixRotate(&rm, m_x[i], m_y[i], m_rad[i]);
+            uiDrawTransform(c, &rm);
+        }
+        if (fast)
+            uiImageBufferDrawFast(c, image, &src, &dst);
+        else
+            uiImageBufferDraw(c, image, &src, &dst);
+        if (rotated)
+            uiDrawRestore(c);
+    }
+}
+
+void SpriteArray::Draw(SoftRenderer &r, int begin, int end, int fast, int axis_aligned)
+{
+    if (!m_buffer) return;
+    int width, height;
+    m_buffer->GetSize(&width, &height);
+    const unsigned char *pixels = m_buffer->GetPixels();
+    for (int i = begin; i < end; i++) {
+        uiRect src = GetSrcRect(i);
+        uiRect dst = GetDstRect(i);
+        if (axis_aligned && m_rad[i] == 0.0f)
+            r.DrawImageAxisAligned(pixels, width, height, src, dst, fast);
+        else
+            r.DrawImage(pixels, width, height, src, dst, m_x[i], m_y[i], m_rad[i], fast);
+    }
+}
@@ -0,0 +1,69 @@
+#include <string.h>
+#include <chrono>
+#include "sprite_group.hpp"
+#include "rect_utils.hpp"
+
+void SpriteGroup::Clear()
+{
+    m_members.clear();
+    m_buffer.Free();
+    m_bounds = { 0, 0, 0, 0 };
+    m_dirty = 1;
+}
+
+void SpriteGroup::Update(uiDrawContext *c, int fast)
+{
+    if (!m_dirty && fast == m_fast) return;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    uiRect bounds = { 0, 0, 0, 0 };
+    for (Sprite *member : m_members) {
+        if (member->IsReady())
+            bounds = UnionRect(bounds, member->GetBounds());
+    }
+    if (bounds.Width != m_bounds.Width || bounds.Height != m_bounds.Height) {
+        m_buffer.Free();
+        if (!IsRectEmpty(bounds))
+            m_buffer.Create(c, bounds.Width, bounds.Height, 1);
+    }
+    m_bounds = bounds;
+    m_dirty = 0;
+    m_fast = fast;
+    if (IsRectEmpty(bounds)) return;
+
+    m_buffer.BeginRender(m_canvas);
+    memset(m_canvas.GetData(), 0, GetBytes());  // transparent
+    for (Sprite *member : m_members) {
+        if (!member->IsReady()) continue;
+        // Move the member into the buffer. The copy doesn't use the rotation cache,
+        // whose images would be created without a draw context.
+        Sprite sprite = *member;
+        double x, y;
+        sprite.GetPosition(&x, &y);
+        sprite.SetPosition(x - bounds.X, y - bounds.Y);
+        sprite.SetRotationCache(NULL);
+        if (sprite.IsRotated())
+            sprite.DrawRotated(m_canvas, fast);
+        else
+            sprite.DrawAxisAligned(m_canvas, fast);
+    }
+    m_buffer.EndRender();
+
+    m_renders++;
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    m_render_ms = elapsed.count();
+}
+
+void SpriteGroup::Draw(uiDrawContext *c)
+{
+    if (!m_buffer.GetLibuiBuffer()) return;
+    uiRect src = m_buffer.GetRect();
+    uiImageBufferDrawFast(c, m_buffer.GetLibuiBuffer(), &src, &m_bounds);
+}
+
+void SpriteGroup::Draw(SoftRenderer &r)
+{
+    if (!m_buffer.GetPixels()) return;
+    uiRect src = m_buffer.GetRect();
+    r.DrawImageAxisAligned(m_buffer.GetPixels(), m_bounds.Width, m_bounds.Height, src, m_bounds, 1);
+}
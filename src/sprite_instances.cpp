@@ -0,0 +1,68 @@
+#include "sprite_instances.hpp"
+
+// Draws src of the buffer into dst piece by piece when the buffer is tiled
+static void DrawInstance(uiDrawContext *c, ImageBuffer &buf, const SpriteInstance &instance, int fast)
+{
+    buf.ForEachTile(instance.src, instance.dst, [c, fast](ImageBuffer *tile, uiRect tile_src, uiRect tile_dst) {
+        if (!tile->GetLibuiBuffer()) return;  // not resident (see TileResidency)
+        if (fast)
+            uiImageBufferDrawFast(c, tile->GetLibuiBuffer(), &tile_src, &tile_dst);
+        else
+            uiImageBufferDraw(c, tile->GetLibuiBuffer(), &tile_src, &tile_dst);
+    });
+}
+
+void DrawImageInstances(uiDrawContext *c, ImageBuffer &buf, const SpriteInstance *list, int count, int fast)
+{
+    if (count <= 0) return;
+#ifdef UI_IMAGE_BUFFER_EXT
+    if (!buf.IsTiled()) {
+        if (buf.GetLibuiBuffer())
+            uiImageBufferDrawInstances(c, buf.GetLibuiBuffer(), list, count, fast);
+        return;
+    }
+#endif
+    uiDrawSave(c);
+
+    // rotation applied to the context now
+    double x = 0.0, y = 0.0, rad = 0.0;
+    for (int i = 0; i < count; i++) {
+        const SpriteInstance &instance = list[i];
+        if (instance.rad != rad || (rad != 0.0 && (instance.x != x || instance.y != y))) {
+            // uiDrawTransform applies the matrix before the current one.
+            // So, the matrix rotates for the instance and then undoes the current rotation.
+            uiDrawMatrix m;
+            uiDrawMatrixSetIdentity(&m);
+            uiDrawMatrixRotate(&m, instance.x, instance.y, instance.rad);
+            if (rad != 0.0) {
+                uiDrawMatrix undo;
+                uiDrawMatrixSetIdentity(&undo);
+                uiDrawMatrixRotate(&undo, x, y, -rad);
+                uiDrawMatrixMultiply(&m, &undo);
+            }
+            uiDrawTransform(c, &m);
+            x = instance.x;
+            y = instance.y;
+            rad = instance.rad;
+        }
+        DrawInstance(c, buf, instance, fast);
+    }
+
+    uiDrawRestore(c);  // drops the rotation and rounding errors of the batch
+}
+
+void DrawImageInstances(SoftRenderer &r, ImageBuffer &buf, const SpriteInstance *list, int count, int fast)
+{
+    for (int i = 0; i < count; i++) {
+        const SpriteInstance &instance = list[i];
+        double x = instance.x, y = instance.y, rad = instance.rad;
+        buf.ForEachTile(instance.src, instance.dst, [&r, x, y, rad, fast](ImageBuffer *tile, const uiRect &src, const uiRect &dst) {
+            int width, height;
+            tile->GetSize(&width, &height);
+            if (rad == 0.0)
+                r.DrawImageAxisAligned(tile->GetPixels(), width, height, src, dst, fast);
+            else
+                r.DrawImage(tile->GetPixels(), width, height, src, dst, x, y, rad, fast);
+        });
+    }
+}
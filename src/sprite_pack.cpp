@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+#include "sprite_pack.hpp"
+
+static_assert(sizeof(SpritePackHeader) == 16, "unexpected padding in SpritePackHeader");
+static_assert(sizeof(SpritePackPage) == 24, "unexpected padding in SpritePackPage");
+static_assert(sizeof(SpritePackImage) == 88, "unexpected padding in SpritePackImage");
+
+static uint64_t AlignUp(uint64_t offset)
+{
+    return (offset + SPRITE_PACK_ALIGNMENT - 1) / SPRITE_PACK_ALIGNMENT * SPRITE_PACK_ALIGNMENT;
+}
+
+int SaveSpritePack(const char *file_name, const AtlasTable &table,
+                   const std::vector<const unsigned char *> &pages)
+{
+    if (pages.size() != table.page_widths.size() || table.names.size() != table.rects.size())
+        return 1;
+
+    SpritePackHeader header;
+    memcpy(header.magic, SPRITE_PACK_MAGIC, 4);
+    header.version = SPRITE_PACK_VERSION;
+    header.page_count = (uint32_t)pages.size();
+    header.image_count = (uint32_t)table.names.size();
+
+    std::vector<SpritePackPage> page_entries(pages.size());
+    uint64_t offset = sizeof(header) + sizeof(SpritePackPage) * pages.size() +
+                      sizeof(SpritePackImage) * table.names.size();
+    for (size_t p = 0; p < pages.size(); p++) {
+        SpritePackPage &e = page_entries[p];
+        e.width = table.page_widths[p];
+        e.height = table.page_heights[p];
+        e.stride = e.width * 4;
+        e.reserved = 0;
+        e.offset = AlignUp(offset);
+        offset = e.offset + (uint64_t)e.stride * e.height;
+    }
+
+    std::vector<SpritePackImage> image_entries(table.names.size());
+    for (size_t i = 0; i < table.names.size(); i++) {
+        SpritePackImage &e = image_entries[i];
+        memset(&e, 0, sizeof(e));
+        if (table.names[i].size() >= sizeof(e.name))
+            return 1;
+        memcpy(e.name, table.names[i].c_str(), table.names[i].size());
+        const AtlasRect &r = table.rects[i];
+        e.page = r.page;
+        e.x = r.x;
+        e.y = r.y;
+        e.width = r.width;
+        e.height = r.height;
+    }
+
+    FILE *file = fopen(file_name, "wb");
+    if (!file) return 1;
+    int ret = fwrite(&header, sizeof(header), 1, file) != 1;
+    if (!ret && !page_entries.empty())
+        ret = fwrite(page_entries.data(), sizeof(SpritePackPage), page_entries.size(), file) != page_entries.size();
+    if (!ret && !image_entries.empty())
+        ret = fwrite(image_entries.data(), sizeof(SpritePackImage), image_entries.size(), file) != image_entries.size();
+    for (size_t p = 0; p < pages.size() && !ret; p++) {
+        // zero padding up to the aligned offset
+        static const unsigned char zeros[SPRITE_PACK_ALIGNMENT] = {};
+        long pos = ftell(file);
+        size_t padding = (size_t)(page_entries[p].offset - (uint64_t)pos);
+        size_t size = (size_t)page_entries[p].stride * page_entries[p].height;
+        ret = (padding > 0 && fwrite(zeros, 1, padding, file) != padding) ||
+              fwrite(pages[p], 1, size, file) != size;
+    }
+    fclose(file);
+    return ret;
+}
+
+int SpritePack::Open(const char *file_name)
+{
+    Close();
+#ifdef _WIN32
+    HANDLE file = CreateFileA(file_name, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return 1;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        CloseHandle(file);
+        return 1;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping) {
+        CloseHandle(file);
+        return 1;
+    }
+    void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return 1;
+    }
+    m_file = file;
+    m_mapping = mapping;
+    m_size = (size_t)size.QuadPart;
+#else
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) return 1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return 1;
+    }
+    void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);  // the mapping keeps the file
+    if (data == MAP_FAILED) return 1;
+    m_size = (size_t)st.st_size;
+#endif
+    m_data = (const unsigned char *)data;
+
+    // validate the index so that lookups don't read out of the mapping
+    const SpritePackHeader *header = (const SpritePackHeader *)m_data;
+    if (m_size < sizeof(SpritePackHeader) ||
+        memcmp(header->magic, SPRITE_PACK_MAGIC, 4) != 0 ||
+        header->version != SPRITE_PACK_VERSION) {
+        Close();
+        return 1;
+    }
+    uint64_t index_size = sizeof(SpritePackHeader) +
+                          (uint64_t)sizeof(SpritePackPage) * header->page_count +
+                          (uint64_t)sizeof(SpritePackImage) * header->image_count;
+    if (index_size > m_size) {
+        Close();
+        return 1;
+    }
+    const SpritePackPage *pages = (const SpritePackPage *)(m_data + sizeof(SpritePackHeader));
+    const SpritePackImage *images = (const SpritePackImage *)(pages + header->page_count);
+    for (uint32_t p = 0; p < header->page_count; p++) {
+        const SpritePackPage &e = pages[p];
+        if (e.stride < (uint64_t)e.width * 4 ||
+            e.offset > m_size || (uint64_t)e.stride * e.height > m_size - e.offset) {
+            Close();
+            return 1;
+        }
+    }
+    for (uint32_t i = 0; i < header->image_count; i++) {
+        const SpritePackImage &e = images[i];
+        if (e.page < 0 || (uint32_t)e.page >= header->page_count ||
+            e.x < 0 || e.y < 0 || e.width < 0 || e.height < 0 ||
+            (uint32_t)e.x + e.width > pages[e.page].width ||
+            (uint32_t)e.y + e.height > pages[e.page].height ||
+            memchr(e.name, '\0', sizeof(e.name)) == NULL) {
+            Close();
+            return 1;
+        }
+    }
+    m_header = header;
+    m_pages = pages;
+    m_images = images;
+    return 0;
+}
+
+void SpritePack::Close()
+{
+    if (m_data) {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+        CloseHandle((HANDLE)m_mapping);
+        CloseHandle((HANDLE)m_file);
+        m_mapping = NULL;
+        m_file = NULL;
+#else
+        munmap((void *)m_data, m_size);
+#endif
+    }
+    m_data = NULL;
+    m_size = 0;
+    m_header = NULL;
+    m_pages = NULL;
+    m_images = NULL;
+}
+
+const unsigned char *SpritePack::GetPagePixels(int page, int *width, int *height, int *stride)
+{
+    if (!m_header || page < 0 || page >= (int)m_header->page_count) return NULL;
+    const SpritePackPage &e = m_pages[page];
+    *width = (int)e.width;
+    *height = (int)e.height;
+    *stride = (int)e.stride;
+    return m_data + e.offset;
+}
+
+int SpritePack::FindImage(const std::string &name, AtlasRect *rect)
+{
+    if (!m_header) return 1;
+    for (uint32_t i = 0; i < m_header->image_count; i++) {
+        const SpritePackImage &e = m_images[i];
+        if (name != e.name) continue;
+        rect->page = e.page;
+        rect->x = e.x;
+        rect->y = e.y;
+        rect->width = e.width;
+        rect->height = e.height;
+        return 0;
+    }
+    return 1;
+}
@@ -0,0 +1,103 @@
+#include <algorithm>
+#include "tile_compositor.hpp"
+#include "rect_utils.hpp"
+
+TileCompositor::TileCompositor(int thread_num, int tile_size)
+    : m_sprites(), m_tiles(), m_active(), m_renderers(), m_pool(thread_num), m_target(NULL), m_output(),
+      m_tile_size(std::max(tile_size, 16)), m_cols(0), m_rows(0), m_width(0), m_height(0),
+      m_clip(), m_background(0), m_bin_entries(0) {}
+
+void TileCompositor::SetTileSize(int tile_size)
+{
+    m_tile_size = std::max(tile_size, 16);
+    m_tiles.clear();  // Begin() splits the area again
+}
+
+void TileCompositor::Begin(SoftRenderer &target, const uiRect &clip, uint32_t background)
+{
+    int width, height;
+    target.GetSize(&width, &height);
+    m_target = &target;
+    if (width != m_width || height != m_height || m_tiles.empty()) {
+        m_width = width;
+        m_height = height;
+        m_cols = (width + m_tile_size - 1) / m_tile_size;
+        m_rows = (height + m_tile_size - 1) / m_tile_size;
+        m_tiles.resize((size_t)m_cols * m_rows);
+        uiRect area = { 0, 0, width, height };
+        for (int row = 0; row < m_rows; row++) {
+            for (int col = 0; col < m_cols; col++) {
+                uiRect rect = { col * m_tile_size, row * m_tile_size, m_tile_size, m_tile_size };
+                m_tiles[row * m_cols + col].rect = IntersectRect(rect, area);
+            }
+        }
+    }
+
+    m_clip = IntersectRect(clip, { 0, 0, width, height });
+    m_background = background;
+    m_sprites.clear();
+    m_active.clear();
+    for (int i = 0; i < (int)m_tiles.size(); i++) {
+        m_tiles[i].sprites.clear();
+        if (RectsIntersect(m_tiles[i].rect, m_clip))
+            m_active.push_back(i);
+    }
+    m_bin_entries = 0;
+}
+
+void TileCompositor::Add(const Sprite &sprite)
+{
+    Sprite copy = sprite;
+    uiRect bounds = IntersectRect(copy.GetBounds(), m_clip);
+    if (IsRectEmpty(bounds)) return;
+    copy.SetRotationCache(NULL);
+
+    int id = (int)m_sprites.size();
+    m_sprites.push_back(copy);
+    int col1 = (bounds.X + bounds.Width - 1) / m_tile_size;
+    int row1 = (bounds.Y + bounds.Height - 1) / m_tile_size;
+    for (int row = bounds.Y / m_tile_size; row <= row1; row++) {
+        for (int col = bounds.X / m_tile_size; col <= col1; col++) {
+            m_tiles[row * m_cols + col].sprites.push_back(id);
+            m_bin_entries++;
+        }
+    }
+}
+
+void TileCompositor::Render(int fast)
+{
+    if (!m_target) return;
+    int thread_num = m_pool.GetThreadNum();
+    while ((int)m_renderers.size() < thread_num)
+        m_renderers.emplace_back(new SoftRenderer());
+    for (std::unique_ptr<SoftRenderer> &r : m_renderers)
+        r->SetTarget(m_target->GetData(), m_width, m_height);
+
+    // Tiles don't overlap, so workers never write the same pixels
+    m_pool.Run((int)m_active.size(), [this, fast](int task, int worker) {
+        Tile &tile = m_tiles[m_active[task]];
+        SoftRenderer &r = *m_renderers[worker];
+        r.SetClip(IntersectRect(tile.rect, m_clip));
+        r.FillRect(tile.rect, m_background);
+        for (int id : tile.sprites) {
+            Sprite &sprite = m_sprites[id];
+            if (sprite.IsRotated())
+                sprite.DrawRotated(r, fast);
+            else
+                sprite.DrawAxisAligned(r, fast);
+        }
+    });
+}
+
+void TileCompositor::Present(uiDrawContext *c)
+{
+    if (!c || !m_target || IsRectEmpty(m_clip)) return;
+    int width, height;
+    m_output.GetSize(&width, &height);
+    if (!m_output.GetLibuiBuffer() || width != m_width || height != m_height) {
+        m_output.Free();
+        m_output.Create(c, m_width, m_height, 0);
+    }
+    m_output.Update(m_target->GetData());
+    uiImageBufferDraw(c, m_output.GetLibuiBuffer(), &m_clip, &m_clip);
+}
@@ -0,0 +1,189 @@
+#include <utility>
+#include <algorithm>
+#include "tile_residency.hpp"
+
+TileResidency::TileResidency(int tile_size, size_t budget)
+    : m_images(), m_lru(), m_requested(), m_prefetch(), m_staging(),
+      m_tile_size(std::max(tile_size, 1)), m_budget(budget), m_max_prefetch(8), m_frame(0),
+      m_resident_bytes(0), m_uploads(0), m_misses(0), m_prefetches(0), m_evictions(0),
+      m_rate_start(std::chrono::steady_clock::now()), m_rate_uploads(0), m_upload_rate(0) {}
+
+int TileResidency::AddImage(const unsigned char *pixels, int width, int height, int stride, int has_alpha)
+{
+    CompactImage image;
+    image.SetRgba(pixels, width, height, stride, has_alpha);
+    return AddImage(std::move(image));
+}
+
+int TileResidency::AddImage(CompactImage &&pixels)
+{
+    std::unique_ptr<Image> image(new Image());
+    image->pixels = std::move(pixels);
+    image->pixels.GetSize(&image->width, &image->height);
+    image->buffer.CreateTiled(image->width, image->height, image->pixels.HasAlpha(), m_tile_size);
+
+    int id = (int)m_images.size();
+    int cols, rows;
+    image->buffer.GetTileGrid(&cols, &rows);
+    image->tiles.resize((size_t)cols * rows);
+    for (int row = 0; row < rows; row++) {
+        for (int col = 0; col < cols; col++) {
+            Tile &tile = image->tiles[row * cols + col];
+            tile.image = id;
+            tile.col = col;
+            tile.row = row;
+            tile.resident = 0;
+            tile.last_used = tile.last_drawn = -1;
+        }
+    }
+    m_images.push_back(std::move(image));
+    return id;
+}
+
+void TileResidency::Clear()
+{
+    m_lru.clear();
+    m_requested.clear();
+    m_prefetch.clear();
+    m_images.clear();
+    m_resident_bytes = 0;
+}
+
+size_t TileResidency::GetCpuBytes()
+{
+    size_t bytes = 0;
+    for (std::unique_ptr<Image> &image : m_images)
+        bytes += image->pixels.GetBytes();
+    return bytes;
+}
+
+size_t TileResidency::GetTileBytes(Tile *tile)
+{
+    int width, height;
+    m_images[tile->image]->buffer.GetTile(tile->col, tile->row)->GetSize(&width, &height);
+    return (size_t)width * height * 4;
+}
+
+void TileResidency::Touch(Tile *tile)
+{
+    tile->last_used = m_frame;
+    if (tile->resident)
+        m_lru.splice(m_lru.begin(), m_lru, tile->lru);
+}
+
+void TileResidency::Upload(uiDrawContext *c, Tile *tile)
+{
+    Image &image = *m_images[tile->image];
+    ImageBuffer *buf = image.buffer.GetTile(tile->col, tile->row);
+    int width, height;
+    buf->GetSize(&width, &height);
+
+    uiRect rect = { tile->col * m_tile_size, tile->row * m_tile_size, width, height };
+    buf->Create(c, width, height, buf->HasAlpha());  // re-uploaded whole from the image
+    if (buf->CanLockInPlace()) {
+        // convert straight into the surface of the tile
+        int stride;
+        image.pixels.ConvertRect(rect, buf->Lock(&stride), (size_t)stride);
+        buf->Unlock();
+    } else {
+        // uiImageBufferUpdate takes packed rows
+        m_staging.resize((size_t)width * height * 4);
+        image.pixels.ConvertRect(rect, m_staging.data(), (size_t)width * 4);
+        buf->Update(m_staging.data());
+    }
+
+    tile->resident = 1;
+    m_lru.push_front(tile);
+    tile->lru = m_lru.begin();
+    m_resident_bytes += GetTileBytes(tile);
+    m_uploads++;
+}
+
+void TileResidency::Evict(Tile *tile)
+{
+    m_resident_bytes -= GetTileBytes(tile);
+    m_images[tile->image]->buffer.GetTile(tile->col, tile->row)->Free();
+    m_lru.erase(tile->lru);
+    tile->resident = 0;
+    m_evictions++;
+}
+
+template <class Func>
+void TileResidency::ForEachTileIn(int image_id, const uiRect &src, Func func)
+{
+    Image &image = *m_images[image_id];
+    int x0 = std::max(src.X, 0);
+    int y0 = std::max(src.Y, 0);
+    int x1 = std::min(src.X + src.Width, image.width);
+    int y1 = std::min(src.Y + src.Height, image.height);
+    if (x0 >= x1 || y0 >= y1) return;
+    int cols, rows;
+    image.buffer.GetTileGrid(&cols, &rows);
+    for (int row = y0 / m_tile_size; row <= (y1 - 1) / m_tile_size; row++) {
+        for (int col = x0 / m_tile_size; col <= (x1 - 1) / m_tile_size; col++)
+            func(&image.tiles[row * cols + col]);
+    }
+}
+
+void TileResidency::Request(int image, const uiRect &src)
+{
+    ForEachTileIn(image, src, [this](Tile *tile) {
+        if (tile->last_drawn == m_frame) return;
+        tile->last_drawn = m_frame;
+        Touch(tile);
+        m_requested.push_back(tile);
+    });
+}
+
+void TileResidency::Prefetch(int image, const uiRect &src)
+{
+    ForEachTileIn(image, src, [this](Tile *tile) {
+        if (tile->last_used == m_frame) return;
+        Touch(tile);
+        m_prefetch.push_back(tile);
+    });
+}
+
+void TileResidency::Update(uiDrawContext *c)
+{
+    // visible tiles are uploaded whatever the budget is
+    for (Tile *tile : m_requested) {
+        if (tile->resident) continue;
+        Upload(c, tile);
+        m_misses++;
+    }
+
+    // Prefetched tiles only replace tiles that were not used in this frame
+    int prefetched = 0;
+    for (Tile *tile : m_prefetch) {
+        if (tile->resident) continue;
+        if (prefetched >= m_max_prefetch) break;
+        size_t bytes = GetTileBytes(tile);
+        while (m_resident_bytes + bytes > m_budget && !m_lru.empty() && m_lru.back()->last_used < m_frame)
+            Evict(m_lru.back());
+        if (m_resident_bytes + bytes > m_budget) break;
+        Upload(c, tile);
+        m_prefetches++;
+        prefetched++;
+    }
+
+    // Evict the least recently used tiles. Prefetched tiles can go, but requested ones stay.
+    std::list<Tile *>::iterator it = m_lru.end();
+    while (m_resident_bytes > m_budget && it != m_lru.begin()) {
+        Tile *tile = *--it;
+        if (tile->last_drawn == m_frame) continue;
+        ++it;  // Evict() erases the tile from the list
+        Evict(tile);
+    }
+
+    m_requested.clear();
+    m_prefetch.clear();
+    m_frame++;
+
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - m_rate_start;
+    if (elapsed.count() >= 1.0) {
+        m_upload_rate = (m_uploads - m_rate_uploads) / elapsed.count();
+        m_rate_uploads = m_uploads;
+        m_rate_start = std::chrono::steady_clock::now();
+    }
+}
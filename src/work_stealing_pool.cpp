@@ -0,0 +1,131 @@
+#include <algorithm>
+#include "work_stealing_pool.hpp"
+
+WorkStealingPool::WorkStealingPool(int thread_num)
+    : m_threads(), m_queues(), m_func(), m_mutex(), m_start(), m_done(),
+      m_generation(0), m_busy(0), m_quit(0), m_thread_num(0), m_steals(0)
+{
+    SetThreadNum(thread_num);
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    StopThreads();
+}
+
+void WorkStealingPool::SetThreadNum(int thread_num)
+{
+    if (thread_num <= 0)
+        thread_num = std::max((int)std::thread::hardware_concurrency(), 1);
+    if (thread_num == m_thread_num) return;
+    StopThreads();
+    m_thread_num = thread_num;
+    StartThreads();
+}
+
+void WorkStealingPool::StartThreads()
+{
+    m_queues.clear();
+    for (int i = 0; i < m_thread_num; i++)
+        m_queues.emplace_back(new Queue());
+    unsigned int generation;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = 0;
+        generation = m_generation;
+    }
+    for (int i = 1; i < m_thread_num; i++)
+        m_threads.push_back(std::thread(&WorkStealingPool::WorkerMain, this, i, generation));
+}
+
+void WorkStealingPool::StopThreads()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quit = 1;
+    }
+    m_start.notify_all();
+    for (std::thread &t : m_threads)
+        t.join();
+    m_threads.clear();
+}
+
+void WorkStealingPool::WorkerMain(int worker, unsigned int generation)
+{
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_start.wait(lock, [this, generation]() { return m_quit || m_generation != generation; });
+            if (m_quit) return;
+            generation = m_generation;
+        }
+        Work(worker);
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_busy--;
+        }
+        m_done.notify_one();
+    }
+}
+
+int WorkStealingPool::Pop(int worker, int *task)
+{
+    {
+        Queue &own = *m_queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            *task = own.tasks.front();
+            own.tasks.pop_front();
+            return 1;
+        }
+    }
+
+    // Steal the last task of another worker. It's the farthest one from the tasks the owner is running.
+    for (int i = 1; i < m_thread_num; i++) {
+        Queue &victim = *m_queues[(worker + i) % m_thread_num];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = victim.tasks.back();
+            victim.tasks.pop_back();
+            m_steals++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void WorkStealingPool::Work(int worker)
+{
+    int task;
+    while (Pop(worker, &task))
+        m_func(task, worker);
+}
+
+void WorkStealingPool::Run(int count, const std::function<void(int task, int worker)> &func)
+{
+    if (count <= 0) return;
+
+    // Neighboring tasks go to the same worker
+    for (int i = 0; i < m_thread_num; i++) {
+        std::lock_guard<std::mutex> lock(m_queues[i]->mutex);
+        std::deque<int> &tasks = m_queues[i]->tasks;
+        int begin = (int)((long long)count * i / m_thread_num);
+        int end = (int)((long long)count * (i + 1) / m_thread_num);
+        for (int task = begin; task < end; task++)
+            tasks.push_back(task);
+    }
+
+    m_func = func;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_busy = m_thread_num - 1;
+        m_generation++;
+    }
+    m_start.notify_all();
+
+    Work(0);  // the calling thread works as well
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this]() { return m_busy == 0; });
+    m_func = nullptr;
+}